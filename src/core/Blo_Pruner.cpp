@@ -0,0 +1,306 @@
+#include "core/Blo_Pruner.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+
+#include "set_manipulators.hpp"
+#include "util/logging.hpp"
+
+// fast mode: added to the largest relative BLO gain seen, in logl units
+constexpr double GAIN_MARGIN = 1.0;
+
+// exact mode: weight the pruned candidates of a query may carry together at their bound,
+// relative to its best preplacement. Small enough to rarely change a written LWR, which
+// verify() checks
+constexpr double EXACT_WEIGHT = 1e-9;
+
+// relative room for the rounding of the LWR computation
+constexpr double WRITTEN_SLACK = 1e-12;
+
+// whether all values in [lo, hi] are written alike (see placement_to_jplace_string)
+static bool written_alike(const double lo, const double hi)
+{
+  return std::to_string(lo * (1.0 - WRITTEN_SLACK)) == std::to_string(hi * (1.0 + WRITTEN_SLACK));
+}
+
+Blo_Pruner::Blo_Pruner(const Options& options)
+  : mode_(options.pruning)
+  , acc_threshold_(options.acc_threshold)
+  , support_threshold_(options.support_threshold)
+  , filter_min_(options.filter_min)
+  , filter_max_(options.filter_max)
+{ }
+
+double Blo_Pruner::gain_bound() const
+{
+  return calibrated_ ? std::max(max_gain_, 0.0) + GAIN_MARGIN
+                     : std::numeric_limits<double>::infinity();
+}
+
+Work Blo_Pruner::prune( const Work& work,
+                        const Prescores& prescores,
+                        const Encoded_MSA * msa)
+{
+  pruned_.clear();
+  candidates_ += work.size();
+
+  const bool exact = (mode_ == blo_pruning::EXACT);
+  if (mode_ == blo_pruning::OFF
+    or (exact and not (bounds_ and msa))
+    or (not exact and not calibrated_)) {
+    return work;
+  }
+
+  // fast mode: the LWR a candidate may at most reach must leave it a chance to pass the
+  // filter, even if all candidates of the query share that chance
+  const double cutoff = acc_threshold_ ? 1.0 - support_threshold_ : support_threshold_;
+  const double bound = gain_bound();
+
+  std::vector<Work::Work_Pair> kept;
+  for (const auto& it : work) {
+    const auto& candidates = prescores.candidates(it.sequence_id);
+    const auto gap = prescores.gap(it.sequence_id, it.branch_id);
+
+    // gap of the <filter_min>-th best candidate: those up to it are always optimized
+    bool protect = candidates.size() <= filter_min_;
+    if (not protect) {
+      const auto better = std::count_if(candidates.begin(), candidates.end(),
+        [gap](const Prescores::entry_type& c) { return c.second < gap; });
+      protect = static_cast<size_t>(better) < filter_min_;
+    }
+
+    double logl_bound = 0.0;
+    bool skip = false;
+    if (protect) {
+      // optimized in any case
+    } else if (exact) {
+      logl_bound = bounds_->sum_precomputed_sitelk(it.branch_id, (*msa)[it.sequence_id]);
+      skip = logl_bound - prescores.best(it.sequence_id)
+           < std::log(EXACT_WEIGHT / candidates.size());
+    } else {
+      skip = std::exp(bound - gap) * candidates.size() < cutoff;
+    }
+
+    if (not skip) {
+      kept.push_back({it.branch_id, it.sequence_id});
+    } else {
+      if (it.sequence_id >= pruned_.size()) {
+        pruned_.resize(it.sequence_id + 1);
+      }
+      pruned_[it.sequence_id].emplace_back(it.branch_id, logl_bound);
+      ++pruned_count_;
+    }
+  }
+
+  return Work(kept);
+}
+
+std::vector<unsigned int> Blo_Pruner::kept_(const std::vector<Placement>& placements) const
+{
+  Sample<Placement> sample;
+  sample.emplace_back(0);
+  sample.back().data() = placements;
+
+  if (acc_threshold_) {
+    discard_by_accumulated_threshold(sample, support_threshold_, filter_min_, filter_max_);
+  } else {
+    discard_by_support_threshold(sample, support_threshold_, filter_min_, filter_max_);
+  }
+
+  std::vector<unsigned int> branch_ids;
+  for (const auto& p : sample.back()) {
+    branch_ids.push_back(p.branch_id());
+  }
+  std::sort(branch_ids.begin(), branch_ids.end());
+  return branch_ids;
+}
+
+bool Blo_Pruner::order_free_(const std::vector<Placement>& placements) const
+{
+  if (acc_threshold_) {
+    return true;
+  }
+  // the support threshold falls back to the first placements, in the order they come
+  // in, when too few or too many pass it
+  const auto passing = static_cast<size_t>(std::count_if(placements.begin(), placements.end(),
+    [this](const Placement& p) { return p.lwr() > support_threshold_; }));
+  return (passing >= filter_min_ or filter_min_ == 1) and passing <= filter_max_;
+}
+
+bool Blo_Pruner::stable_( const std::vector<Placement>& placements,
+                          const std::vector<pruned_type>& pruned,
+                          const std::vector<double>& pruned_lwrs) const
+{
+  double pruned_mass = 0.0;
+  double max_pruned = 0.0;
+  for (const auto lwr : pruned_lwrs) {
+    pruned_mass += lwr;
+    max_pruned = std::max(max_pruned, lwr);
+  }
+  const double shrink = 1.0 / (1.0 + pruned_mass);
+
+  // the pruned candidates weigh anything from nothing to their bound, which takes up to
+  // all of that weight from the others. The filter has to keep the same at both ends
+  auto light = placements;
+  auto heavy = placements;
+  for (auto& p : heavy) {
+    p.lwr(p.lwr() * shrink);
+  }
+  for (size_t i = 0; i < pruned.size(); ++i) {
+    light.emplace_back(pruned[i].first, pruned[i].second, 0.0, 0.0);
+    heavy.emplace_back(pruned[i].first, pruned[i].second, 0.0, 0.0);
+    heavy.back().lwr(pruned_lwrs[i]);
+  }
+
+  if (not order_free_(light) or not order_free_(heavy)) {
+    return false;
+  }
+
+  const auto kept = kept_(light);
+  if (kept != kept_(heavy)) {
+    return false;
+  }
+  for (const auto& p : pruned) {
+    if (std::binary_search(kept.begin(), kept.end(), p.first)) {
+      return false;
+    }
+  }
+
+  // ... and in between, as long as the pruned ones rank below all kept placements
+  double min_kept = std::numeric_limits<double>::infinity();
+  for (const auto& p : heavy) {
+    if (std::binary_search(kept.begin(), kept.end(), p.branch_id())) {
+      min_kept = std::min(min_kept, p.lwr());
+    }
+  }
+  if (max_pruned >= min_kept) {
+    return false;
+  }
+
+  // the written LWRs of the kept placements
+  double entropy = 0.0;
+  for (const auto& p : placements) {
+    if (p.lwr() > 0.0) {
+      entropy -= p.lwr() * std::log(p.lwr());
+    }
+    if (std::binary_search(kept.begin(), kept.end(), p.branch_id())
+      and not written_alike(p.lwr() * shrink, p.lwr())) {
+      return false;
+    }
+  }
+
+  // the written entropy: the terms of the optimized placements shrink, and gain up to
+  // log(1 + mass). A pruned one of weight w adds -w log(w), which grows up to w = 1/e
+  double max_entropy = entropy + std::log1p(pruned_mass);
+  for (const auto lwr : pruned_lwrs) {
+    const auto w = std::min(lwr, std::exp(-1.0));
+    if (w > 0.0) {
+      max_entropy -= w * std::log(w);
+    }
+  }
+  return written_alike(entropy * shrink, max_entropy);
+}
+
+Work Blo_Pruner::verify(const Sample<Placement>& sample, const size_t seq_id_offset)
+{
+  std::vector<Work::Work_Pair> recover;
+  if (mode_ != blo_pruning::EXACT or pruned_.empty()) {
+    return Work(recover);
+  }
+
+  std::vector<const PQuery<Placement> *> by_seq_id(pruned_.size(), nullptr);
+  for (const auto& pq : sample) {
+    const auto seq_id = pq.sequence_id() - seq_id_offset;
+    if (seq_id < by_seq_id.size()) {
+      by_seq_id[seq_id] = &pq;
+    }
+  }
+
+  for (size_t seq_id = 0; seq_id < pruned_.size(); ++seq_id) {
+    const auto& pruned = pruned_[seq_id];
+    if (pruned.empty()) {
+      continue;
+    }
+
+    bool stable = false;
+    if (by_seq_id[seq_id] and by_seq_id[seq_id]->size()) {
+      std::vector<Placement> placements(by_seq_id[seq_id]->begin(), by_seq_id[seq_id]->end());
+
+      // LWRs among the optimized placements, as the output gets them
+      double max_logl = -std::numeric_limits<double>::infinity();
+      for (const auto& p : placements) {
+        max_logl = std::max(max_logl, p.likelihood());
+      }
+      double total = 0.0;
+      for (const auto& p : placements) {
+        total += std::exp(p.likelihood() - max_logl);
+      }
+      for (auto& p : placements) {
+        p.lwr(std::exp(p.likelihood() - max_logl) / total);
+      }
+
+      // the pruned candidates at their bound, relative to the same normalization
+      std::vector<double> pruned_lwrs;
+      for (const auto& p : pruned) {
+        pruned_lwrs.push_back(std::exp(p.second - max_logl) / total);
+      }
+
+      stable = stable_(placements, pruned, pruned_lwrs);
+    }
+
+    if (not stable) {
+      for (const auto& p : pruned) {
+        recover.push_back({p.first, seq_id});
+      }
+      recovered_ += pruned.size();
+    }
+  }
+
+  return Work(recover);
+}
+
+void Blo_Pruner::calibrate( const Sample<Placement>& sample,
+                            const Prescores& prescores,
+                            const size_t seq_id_offset)
+{
+  for (const auto& pq : sample) {
+    const auto seq_id = pq.sequence_id() - seq_id_offset;
+
+    // relative to the optimized placement of the best preplacement candidate
+    double lead_logl = 0.0;
+    double lead_gap = std::numeric_limits<double>::infinity();
+    for (const auto& p : pq) {
+      const auto gap = prescores.gap(seq_id, p.branch_id());
+      if (gap < lead_gap) {
+        lead_gap = gap;
+        lead_logl = p.likelihood();
+      }
+    }
+
+    for (const auto& p : pq) {
+      const auto gap = prescores.gap(seq_id, p.branch_id());
+      if (gap == lead_gap) {
+        continue;
+      }
+      max_gain_ = std::max(max_gain_, (p.likelihood() - lead_logl) + (gap - lead_gap));
+      calibrated_ = true;
+    }
+  }
+}
+
+void Blo_Pruner::log_stats() const
+{
+  if (mode_ == blo_pruning::OFF) {
+    return;
+  }
+
+  if (mode_ == blo_pruning::EXACT) {
+    LOG_INFO << "Exact BLO pruning: " << pruned_count_ - recovered_ << " of " << candidates_
+             << " candidates skipped (" << recovered_ << " optimized after all)";
+  } else {
+    LOG_INFO << "Fast BLO pruning: " << pruned_count_ << " of " << candidates_
+             << " candidates skipped, gain bound " << gain_bound();
+  }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+#include "core/Work.hpp"
+#include "core/Lookup_Store.hpp"
+#include "sample/Sample.hpp"
+#include "sample/Prescores.hpp"
+#include "seq/Encoded_MSA.hpp"
+#include "util/Options.hpp"
+
+/**
+ * Bound-and-prune of the thorough placement (see Options::pruning): the BLO of candidates
+ * too unlikely to matter for the output is skipped. The best <filter_min> candidates of
+ * every query are always kept.
+ *
+ * Exact mode prunes against a provable upper bound of the logl of a candidate (see
+ * build_logl_bounds): a candidate is pruned if, even at its bound, it carries next to no
+ * weight compared to the best preplacement of its query. After the thorough placement,
+ * every query is checked: if its pruned candidates, at any weight up to their bound, could
+ * change which placements the final filter keeps, or an LWR or entropy as written to the
+ * output, they are optimized after all. The output is then the same as without pruning.
+ * As the bound is far from tight, few candidates are pruned.
+ *
+ * Fast mode prunes by the preplacement logl instead. A candidate whose preplacement logl
+ * is <gap> below the best one of its query ends up with an LWR of at most exp(G - gap),
+ * where G bounds how much more BLO gains on it than on the best candidate. There is no
+ * closed form for G: it is calibrated as the largest such relative gain of the placements
+ * optimized so far, plus a margin. Until there is anything to calibrate with, nothing is
+ * pruned. Candidates whose LWR bound is too small to pass the final filter
+ * (Options::support_threshold), even when shared by all candidates of the query, are not
+ * optimized. As G is empirical, this is a heuristic: a candidate can gain more than G, and
+ * then be pruned although it would have passed the filter. The LWRs of the kept
+ * placements are normalized over the optimized placements only, and so are larger by up
+ * to the weight of the pruned candidates.
+ */
+class Blo_Pruner
+{
+public:
+  explicit Blo_Pruner(const Options& options);
+  Blo_Pruner() = delete;
+  ~Blo_Pruner() = default;
+
+  // exact mode: the logl bounds of all branches. Without them, nothing is pruned
+  void logl_bounds(std::shared_ptr<Lookup_Store> bounds) { bounds_ = std::move(bounds); }
+
+  // the pairs of <work> worth optimizing. The others are remembered for verify(). In
+  // exact mode, <msa> holds the queries of the work
+  Work prune( const Work& work,
+              const Prescores& prescores,
+              const Encoded_MSA * msa=nullptr);
+
+  /**
+   * Exact mode: the pairs pruned by the last prune() that have to be optimized after all,
+   * given the placements of the others in <sample> (whose sequence ids are offset by
+   * <seq_id_offset> against those of the work). Empty in fast mode.
+   */
+  Work verify(const Sample<Placement>& sample, const size_t seq_id_offset);
+
+  // fast mode: learns the gain bound from the optimized placements of a chunk
+  void calibrate( const Sample<Placement>& sample,
+                  const Prescores& prescores,
+                  const size_t seq_id_offset);
+
+  bool calibrated() const { return calibrated_; }
+  double gain_bound() const;
+
+  size_t candidates() const { return candidates_; }
+  size_t pruned() const { return pruned_count_; }
+  size_t recovered() const { return recovered_; }
+
+  void log_stats() const;
+
+private:
+  // branch id and logl bound (exact mode) of a pruned candidate
+  using pruned_type = std::pair<unsigned int, double>;
+
+  // whether the output of a query stays the same with the pruned candidates added
+  bool stable_( const std::vector<Placement>& placements,
+                const std::vector<pruned_type>& pruned,
+                const std::vector<double>& pruned_lwrs) const;
+  std::vector<unsigned int> kept_(const std::vector<Placement>& placements) const;
+  bool order_free_(const std::vector<Placement>& placements) const;
+
+  blo_pruning mode_;
+  bool acc_threshold_;
+  double support_threshold_;
+  size_t filter_min_;
+  size_t filter_max_;
+
+  std::shared_ptr<Lookup_Store> bounds_;
+
+  bool calibrated_ = false;
+  double max_gain_ = 0.0;
+
+  // the pairs pruned by the last prune(), per query
+  std::vector<std::vector<pruned_type>> pruned_;
+
+  size_t candidates_ = 0;
+  size_t pruned_count_ = 0;
+  size_t recovered_ = 0;
+};
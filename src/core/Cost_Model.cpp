@@ -0,0 +1,177 @@
+#include "core/Cost_Model.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <numeric>
+
+#include "util/logging.hpp"
+
+// CLV sized evaluations (each a states x states product) of one branch length optimization
+constexpr double BLO_EVALUATIONS = 16.0;
+
+Cost_Model::Cost_Model( std::vector<bool> tip_branch,
+                        const size_t sites,
+                        const double query_sites,
+                        const size_t states,
+                        const size_t rate_cats,
+                        const size_t lookup_cols,
+                        const bool do_blo,
+                        const bool lookups_ready)
+  : tip_branch_(std::move(tip_branch))
+  , clv_ops_(static_cast<double>(sites) * rate_cats * states)
+{
+  // copying the CLVs of both ends, then the partial toward the new tip. With a tip at
+  // one end, there is only one CLV to copy and its half of the update is a lookup
+  setup_inner_ = 2.0 * clv_ops_ + 2.0 * clv_ops_ * states;
+  setup_tip_   = clv_ops_ + clv_ops_ * (states + 1);
+
+  if (not do_blo and not lookups_ready) {
+    // one evaluation per column of the lookup table
+    const double table = lookup_cols * clv_ops_;
+    setup_inner_ += table;
+    setup_tip_ += table;
+  }
+
+  pair_cost_ = do_blo ? BLO_EVALUATIONS * clv_ops_ * states : query_sites;
+}
+
+double Cost_Model::setup(const size_t branch_id) const
+{
+  const bool tip = branch_id < tip_branch_.size() and tip_branch_[branch_id];
+  return tip ? setup_tip_ : setup_inner_;
+}
+
+double Cost_Model::pair(const size_t) const
+{
+  return pair_cost_;
+}
+
+double Cost_Model::predict(const Work& work) const
+{
+  double cost = 0.0;
+  bool first = true;
+  size_t prev_branch_id = 0;
+  for (const auto& it : work) {
+    if (first or it.branch_id != prev_branch_id) {
+      cost += setup(it.branch_id);
+      first = false;
+    }
+    cost += pair(it.branch_id);
+    prev_branch_id = it.branch_id;
+  }
+  return cost;
+}
+
+std::vector<double> split( const Work& src,
+                           std::vector<Work>& parts,
+                           const unsigned int num_parts,
+                           const Cost_Model& model)
+{
+  // runs of consecutive pairs on the same branch
+  struct Run
+  {
+    size_t branch_id;
+    size_t begin;
+    size_t end;
+  };
+  std::vector<Run> runs;
+  size_t pos = 0;
+  for (const auto& it : src) {
+    if (runs.empty() or runs.back().branch_id != it.branch_id) {
+      runs.push_back({it.branch_id, pos, pos});
+    }
+    runs.back().end = ++pos;
+  }
+
+  // cost at the start of every run, if computed as one piece
+  std::vector<double> run_start(runs.size() + 1, 0.0);
+  for (size_t r = 0; r < runs.size(); ++r) {
+    const auto& run = runs[r];
+    run_start[r + 1] = run_start[r]
+                     + model.setup(run.branch_id)
+                     + (run.end - run.begin) * model.pair(run.branch_id);
+  }
+  const double target = run_start.back() / std::max(num_parts, 1u);
+
+  // place every part boundary at the pair where the cost reaches a multiple of the target
+  std::vector<size_t> cuts{0};
+  size_t r = 0;
+  for (size_t k = 1; k < num_parts; ++k) {
+    const double t = k * target;
+    while (r < runs.size() and run_start[r + 1] <= t) {
+      ++r;
+    }
+
+    size_t cut = src.size();
+    if (r < runs.size()) {
+      const auto& run = runs[r];
+      const double run_cost = run_start[r + 1] - run_start[r];
+      if (run_cost <= target) {
+        // keep the branch in one piece: end the part before or after it
+        cut = (t - run_start[r] < run_start[r + 1] - t) ? run.begin : run.end;
+      } else {
+        const double inside = (t - run_start[r] - model.setup(run.branch_id))
+                            / model.pair(run.branch_id);
+        const auto num_pairs = static_cast<size_t>(std::max(0.0, std::round(inside)));
+        cut = run.begin + std::min(num_pairs, run.end - run.begin);
+      }
+    }
+    cuts.push_back(std::max(cut, cuts.back()));
+  }
+  cuts.push_back(src.size());
+
+  // predicted cost of the pairs [begin, end), setting up every branch they touch
+  auto part_cost = [&](const size_t begin, const size_t end) {
+    double cost = 0.0;
+    if (begin == end) {
+      return cost;
+    }
+    auto run = std::upper_bound(runs.begin(), runs.end(), begin,
+      [](const size_t p, const Run& run) { return p < run.end; });
+    for (; run != runs.end() and run->begin < end; ++run) {
+      const auto num_pairs = std::min(end, run->end) - std::max(begin, run->begin);
+      cost += model.setup(run->branch_id) + num_pairs * model.pair(run->branch_id);
+    }
+    return cost;
+  };
+
+  parts.clear();
+  parts.reserve(num_parts);
+  std::vector<double> predicted;
+  for (size_t k = 0; k < num_parts; ++k) {
+    parts.push_back(src.slice(cuts[k], cuts[k + 1]));
+    parts.back().status(token_status::DATA);
+    predicted.push_back(part_cost(cuts[k], cuts[k + 1]));
+  }
+  return predicted;
+}
+
+void log_prediction(const std::vector<double>& predicted, const std::vector<double>& measured)
+{
+  const double total_predicted = std::accumulate(predicted.begin(), predicted.end(), 0.0);
+  const double total_measured = std::accumulate(measured.begin(), measured.end(), 0.0);
+  if (predicted.empty() or total_predicted <= 0.0 or total_measured <= 0.0) {
+    return;
+  }
+
+  // predictions in the time unit of the measurements, fitted to their total
+  const double scale = total_measured / total_predicted;
+  const double mean = total_measured / measured.size();
+
+  double max_predicted = 0.0;
+  double max_measured = 0.0;
+  double deviation = 0.0;
+  for (size_t k = 0; k < predicted.size(); ++k) {
+    const double expected = predicted[k] * scale;
+    max_predicted = std::max(max_predicted, expected);
+    max_measured = std::max(max_measured, measured[k]);
+    deviation += std::fabs(measured[k] - expected);
+    LOG_DBG1 << "Part " << k << ": predicted " << expected << "us, measured "
+             << measured[k] << "us";
+  }
+
+  LOG_DBG << "Cost model: " << scale << "us per unit, parts max/mean predicted "
+          << max_predicted / mean << ", measured " << max_measured / mean
+          << ", mean deviation " << 100.0 * deviation / total_measured << "%";
+}
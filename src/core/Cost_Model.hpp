@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include "core/Work.hpp"
+
+/**
+ * Estimates the cost of computing a Work object within place(), in units of roughly
+ * one per-site operation on a CLV entry (one rate category, one state).
+ *
+ * Placing a query on a branch requires the branch's Tiny_Tree, whose setup (CLV copies,
+ * the partial toward the new tip and, for the preplacement, the lookup table) is paid
+ * again whenever consecutive pairs switch branches. Pairs then cost one table lookup
+ * per site, or a full branch length optimization when BLO is on.
+ *
+ * The weights are estimates: place() logs the predicted against the measured time per
+ * part, which is what they should be tuned with.
+ */
+class Cost_Model
+{
+public:
+  /**
+   * @param tip_branch    per branch id: true if one end of the branch is a tip
+   * @param sites         sites of the reference alignment
+   * @param query_sites   sites actually scored per query (the mean span, in ranged mode)
+   * @param states        states of the model
+   * @param rate_cats     rate categories of the model
+   * @param lookup_cols   columns of a lookup table (size of the character map)
+   * @param do_blo        whether pairs are placed with branch length optimization
+   * @param lookups_ready whether all lookup tables are already computed
+   */
+  Cost_Model( std::vector<bool> tip_branch,
+              const size_t sites,
+              const double query_sites,
+              const size_t states,
+              const size_t rate_cats,
+              const size_t lookup_cols,
+              const bool do_blo,
+              const bool lookups_ready);
+
+  Cost_Model() = delete;
+  ~Cost_Model() = default;
+
+  // cost of setting up the Tiny_Tree of a branch
+  double setup(const size_t branch_id) const;
+
+  // cost of placing one query on a branch whose Tiny_Tree is set up already
+  double pair(const size_t branch_id) const;
+
+  // cost of computing the pairs of a Work object in iteration order
+  double predict(const Work& work) const;
+
+private:
+  std::vector<bool> tip_branch_;
+  double clv_ops_;
+  double setup_inner_;
+  double setup_tip_;
+  double pair_cost_;
+};
+
+/**
+ * Splits <src> into exactly <num_parts> parts of roughly equal predicted cost. Parts are
+ * contiguous slices of <src>; a part boundary only falls inside the run of pairs of one
+ * branch if that run alone costs more than a part should. Some parts may be empty.
+ *
+ * Returns the predicted cost of every part.
+ */
+std::vector<double> split( const Work& src,
+                           std::vector<Work>& parts,
+                           const unsigned int num_parts,
+                           const Cost_Model& model);
+
+/**
+ * Logs the predicted cost of parts computed in parallel against their measured times,
+ * along with the load imbalance of both.
+ */
+void log_prediction(const std::vector<double>& predicted, const std::vector<double>& measured);
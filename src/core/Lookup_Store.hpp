@@ -1,14 +1,25 @@
 #pragma once
 
 #include <mutex>
+#include <memory>
 #include <vector>
+#include <list>
 #include <map>
+#include <array>
+#include <string>
+#include <stdexcept>
 #include <utility>
 #include <limits>
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
 
 #include "util/Matrix.hpp"
 #include "util/maps.hpp"
+#include "util/Options.hpp"
+#include "core/lookup_kernels.hpp"
 
 constexpr size_t INVALID = std::numeric_limits<size_t>::max();
 
@@ -17,12 +28,31 @@ class Lookup_Store
 public:
   using lookup_type = Matrix<double>;
 
-  Lookup_Store(const size_t num_branches, const size_t num_states) 
+  Lookup_Store(const size_t num_branches,
+               const size_t num_states,
+               const lookup_precision precision=lookup_precision::DOUBLE)
     : branch_(num_branches)
-    , store_(num_branches)
+    , precision_(precision)
+    , pins_(num_branches, 0)
+    , lru_pos_(num_branches)
+    , resident_(num_branches, false)
     , char_map_size_((num_states == 4) ? NT_MAP_SIZE : AA_MAP_SIZE)
     , char_map_((num_states == 4) ? NT_MAP : AA_MAP)
   {
+    // only the store of the selected precision is populated
+    switch (precision_) {
+      case lookup_precision::DOUBLE:
+        store_.resize(num_branches);
+        break;
+      case lookup_precision::FLOAT:
+        store_float_.resize(num_branches);
+        break;
+      case lookup_precision::INT16:
+        store_int16_.resize(num_branches);
+        quantization_.resize(num_branches);
+        break;
+    }
+
     for (size_t i = 0; i < 128; ++i) {
       char_to_posish_[i] = INVALID;
     }
@@ -38,13 +68,41 @@ public:
 
   void init_branch(const size_t branch_id, std::vector<std::vector<double>> precomps)
   {
-    store_[branch_id] = Matrix<double>(precomps[0].size(), char_map_size_);
+    Matrix<double> table(precomps[0].size(), char_map_size_);
 
     for(size_t ch = 0; ch < precomps.size(); ++ch) {
       for(size_t site = 0; site < precomps[ch].size(); ++site) {
-        store_[branch_id](site, ch) = precomps[ch][site];
+        table(site, ch) = precomps[ch][site];
       }
     }
+
+    init_branch(branch_id, std::move(table));
+  }
+
+  // takes a table that is already laid out as sites x char_map_size
+  void init_branch(const size_t branch_id, Matrix<double>&& table)
+  {
+    switch (precision_) {
+      case lookup_precision::DOUBLE:
+        store_[branch_id] = std::move(table);
+        break;
+      case lookup_precision::FLOAT:
+        store_float_[branch_id] = convert_matrix_<float>(table,
+                                                         [](const double v){ return static_cast<float>(v); });
+        break;
+      case lookup_precision::INT16:
+        init_branch_int16_(branch_id, table);
+        break;
+    }
+
+    if (ranged_) {
+      init_gap_prefix_(branch_id);
+    }
+  }
+
+  size_t num_branches() const
+  {
+    return branch_.size();
   }
 
   std::mutex& get_mutex(const size_t branch_id)
@@ -54,15 +112,224 @@ public:
 
   bool has_branch(const size_t branch_id) 
   {
-    return store_[branch_id].size() != 0; 
+    return sites(branch_id) != 0;
+  }
+
+  size_t sites(const size_t branch_id) const
+  {
+    if (mapped_) {
+      return mapped_sites_;
+    }
+    switch (precision_) {
+      case lookup_precision::FLOAT:
+        return store_float_[branch_id].rows();
+      case lookup_precision::INT16:
+        return store_int16_[branch_id].rows();
+      default:
+        return store_[branch_id].rows();
+    }
+  }
+
+  lookup_precision precision() const
+  {
+    return precision_;
+  }
+
+  // once all tables are built, they are only ever read, and no locking is needed
+  void mark_complete()
+  {
+    complete_ = true;
+  }
+
+  bool complete() const
+  {
+    return complete_;
+  }
+
+  /**
+   * Validation of the table builder, done once per store: the first caller runs
+   * <check>, every caller gets its result. Concurrent callers wait for the first one.
+   */
+  template <class Check>
+  bool builder_valid(Check check) const
+  {
+    std::call_once(builder_checked_, [&]() { builder_valid_ = check(); });
+    return builder_valid_;
+  }
+
+  size_t value_size() const
+  {
+    switch (precision_) {
+      case lookup_precision::FLOAT:
+        return sizeof(float);
+      case lookup_precision::INT16:
+        return sizeof(int16_t);
+      default:
+        return sizeof(double);
+    }
+  }
+
+  size_t size_in_bytes() const
+  {
+    if (mapped_) {
+      return branch_.size() * mapped_sites_ * char_map_size_ * value_size();
+    }
+    size_t bytes = 0;
+    for (const auto& m : store_) {
+      bytes += m.size() * sizeof(double);
+    }
+    for (const auto& m : store_float_) {
+      bytes += m.size() * sizeof(float);
+    }
+    for (const auto& m : store_int16_) {
+      bytes += m.size() * sizeof(int16_t);
+    }
+    return bytes;
+  }
+
+  // raw table of a branch (sites x char_map_size values of value_size bytes)
+  const void * raw_table(const size_t branch_id) const
+  {
+    switch (precision_) {
+      case lookup_precision::FLOAT:
+        return table_(store_float_, branch_id);
+      case lookup_precision::INT16:
+        return table_(store_int16_, branch_id);
+      default:
+        return table_(store_, branch_id);
+    }
+  }
+
+  // fixed-point offset and scale of a branch (INT16 only)
+  std::pair<double, double> quantization(const size_t branch_id) const
+  {
+    if (branch_id >= quantization_.size()) {
+      return {0.0, 1.0};
+    }
+    return {quantization_[branch_id].offset, quantization_[branch_id].scale};
+  }
+
+  /**
+   * Uses tables that live in externally owned memory (such as a mapped cache file)
+   * instead of building them. The tables of all branches are stored back to back.
+   * The store is complete afterwards.
+   */
+  void attach(std::shared_ptr<const void> owner,
+              const char * tables,
+              const size_t sites,
+              const std::vector<std::pair<double, double>>& quantization)
+  {
+    mapped_ = owner;
+    mapped_tables_ = tables;
+    mapped_sites_ = sites;
+    for (size_t i = 0; i < quantization.size() and i < quantization_.size(); ++i) {
+      quantization_[i].offset = quantization[i].first;
+      quantization_[i].scale = quantization[i].second;
+    }
+    if (ranged_) {
+      for (size_t i = 0; i < branch_.size(); ++i) {
+        init_gap_prefix_(i);
+      }
+    }
+    complete_ = true;
+  }
+
+  /**
+   * Ranged mode: queries may be scored over their non-gap range only (see
+   * Encoded_MSA::compute_ranges). The contribution of the gap sites outside of
+   * the range is taken from per-branch prefix sums over the gap column, which are
+   * kept alongside the tables. Must be set before any table is built or attached.
+   */
+  void ranged(const bool ranged)
+  {
+    ranged_ = ranged;
+    gap_prefix_.resize(ranged ? branch_.size() : 0);
+  }
+
+  bool ranged() const
+  {
+    return ranged_;
+  }
+
+  /**
+   * Memory budget for the tables, in bytes (0: unbounded). With a budget, callers pin
+   * the tables they use (see pin), and the least recently used unpinned tables are
+   * evicted whenever the resident tables exceed the budget. Evicted tables are rebuilt
+   * on demand, like missing ones. Pinned tables are never evicted, so the budget is
+   * exceeded if the pinned tables alone do not fit.
+   */
+  void memory_budget(const size_t bytes)
+  {
+    budget_ = bytes;
   }
 
+  size_t memory_budget() const
+  {
+    return budget_;
+  }
+
+  using pin_type = std::shared_ptr<void>;
+
+  /**
+   * Marks the (built) table of a branch as in use until the returned handle is
+   * released. Must be called while holding the branch's mutex, right after has_branch
+   * / init_branch, such that the table cannot be evicted in between.
+   * Returns an empty handle if there is no budget.
+   */
+  pin_type pin(const size_t branch_id)
+  {
+    if (not budget_) {
+      return nullptr;
+    }
+
+    const std::lock_guard<std::mutex> lock(lru_mutex_);
+
+    if (resident_[branch_id]) {
+      ++hits_;
+      lru_.splice(lru_.begin(), lru_, lru_pos_[branch_id]);
+    } else {
+      ++misses_;
+      lru_.push_front(branch_id);
+      lru_pos_[branch_id] = lru_.begin();
+      resident_[branch_id] = true;
+      resident_bytes_ += table_bytes_(branch_id);
+    }
+    ++pins_[branch_id];
+
+    evict_();
+
+    return pin_type(static_cast<void *>(this), [this, branch_id](void *){
+      const std::lock_guard<std::mutex> lock(lru_mutex_);
+      --pins_[branch_id];
+    });
+  }
+
+  // statistics of the budgeted mode: tables found resident, (re)built, and evicted
+  size_t hits() const
+  {
+    const std::lock_guard<std::mutex> lock(lru_mutex_);
+    return hits_;
+  }
+
+  size_t misses() const
+  {
+    const std::lock_guard<std::mutex> lock(lru_mutex_);
+    return misses_;
+  }
+
+  size_t evictions() const
+  {
+    const std::lock_guard<std::mutex> lock(lru_mutex_);
+    return evictions_;
+  }
+
+  // access to the double precision tables
   lookup_type& operator[](const size_t branch_id)
   {
     return store_[branch_id];
   }
 
-  unsigned char char_map(const size_t i)
+  unsigned char char_map(const size_t i) const
   {
     if (i >= char_map_size_) {
       throw std::runtime_error{
@@ -73,14 +340,14 @@ public:
     return char_map_[i];
   }
 
-  size_t char_map_size()
+  size_t char_map_size() const
   {
     return char_map_size_;
   }
 
   size_t char_position(unsigned char c) const
   {
-    auto pos = char_to_posish_[c];
+    auto pos = (c < char_to_posish_.size()) ? char_to_posish_[c] : INVALID;
 
     if (pos == INVALID) {
       throw std::runtime_error{std::string("char is invalid! char = ") + std::to_string(c)};
@@ -89,42 +356,355 @@ public:
     return pos;
   }
 
+  // translates a sequence into its state indices, i.e. the columns of the lookup table
+  void encode(const std::string& seq, unsigned char * states) const
+  {
+    for (size_t i = 0; i < seq.length(); ++i) {
+      states[i] = static_cast<unsigned char>(char_position(seq[i]));
+    }
+  }
+
+  double sum_precomputed_sitelk(const size_t branch_id, const unsigned char * states) const
+  {
+    return sum_single_(branch_id, states, nullptr);
+  }
+
+  // ranged variant of a single sequence, see the block version
+  double sum_precomputed_sitelk(const size_t branch_id,
+                                const unsigned char * states,
+                                const std::pair<size_t, size_t>& range) const
+  {
+    if (not ranged_) {
+      throw std::runtime_error{"Ranged scoring requires a Lookup_Store in ranged mode!"};
+    }
+    return sum_single_(branch_id, states, &range);
+  }
+
   double sum_precomputed_sitelk(const size_t branch_id, const std::string& seq) const
   {
-    assert(seq.length() == store_[branch_id].rows());
-    
-    double sum = 0;
-    const auto& lookup_matrix = store_[branch_id];
-    const auto& lookup = lookup_matrix.get_array();
+    assert(seq.length() == sites(branch_id));
+
+    std::vector<unsigned char> states(seq.length());
+    encode(seq, states.data());
 
-    // unrolled loop
-    size_t site = 0;
-    const size_t stride = 4;
-    for (; site + stride-1u < seq.length(); site+=stride) {
-      double sum_one =
-      lookup[lookup_matrix.coord(site, char_to_posish_[seq[site]])]
-      + lookup[lookup_matrix.coord(site+1u, char_to_posish_[seq[site+1u]])];
-      
-      double sum_two =
-      lookup[lookup_matrix.coord(site+2u, char_to_posish_[seq[site+2u]])]
-      + lookup[lookup_matrix.coord(site+3u, char_to_posish_[seq[site+3u]])];
+    return sum_precomputed_sitelk(branch_id, states.data());
+  }
 
-      sum_one += sum_two;
+  /**
+   * Scores a block of encoded sequences (all of the same length as the reference)
+   * against one branch. The sites are processed in tiles of LOOKUP_TILE_BYTES worth of
+   * lookup table, which all sequences of the block consume before moving on to the
+   * next tile. Results are bit-identical to scoring the sequences one by one.
+   */
+  void sum_precomputed_sitelk(const size_t branch_id,
+                              const std::vector<const unsigned char *>& seqs,
+                              std::vector<double>& result) const
+  {
+    sum_precomputed_sitelk(branch_id, seqs, {}, result);
+  }
 
-      sum += sum_one;
+  /**
+   * Ranged variant: only the sites within each sequence's range are looked up, the
+   * sites outside of it are assumed to be gaps. Without ranges, all sites are scored.
+   */
+  void sum_precomputed_sitelk(const size_t branch_id,
+                              const std::vector<const unsigned char *>& seqs,
+                              const std::vector<std::pair<size_t, size_t>>& ranges,
+                              std::vector<double>& result) const
+  {
+    if (not ranges.empty() and not ranged_) {
+      throw std::runtime_error{"Ranged scoring requires a Lookup_Store in ranged mode!"};
     }
+    const double * gap_prefix = ranges.empty() ? nullptr : gap_prefix_[branch_id].data();
 
-    // rest of the horizontal add
-    while (site < seq.length()) {
-      sum += lookup[lookup_matrix.coord(site, char_to_posish_[seq[site]])];
-      ++site;
+    switch (precision_) {
+      case lookup_precision::DOUBLE:
+        sum_block_(table_(store_, branch_id), sites(branch_id), lookup_kernel(),
+                   seqs, ranges, gap_prefix, result, [](const double sum){ return sum; });
+        break;
+      case lookup_precision::FLOAT:
+        sum_block_(table_(store_float_, branch_id), sites(branch_id), lookup_kernel_float(),
+                   seqs, ranges, gap_prefix, result, [](const double sum){ return sum; });
+        break;
+      case lookup_precision::INT16: {
+        // the integer sum is exact, the only error is the quantization itself
+        const auto& quant = quantization_[branch_id];
+        const auto offset = quant.offset * sites(branch_id);
+        sum_block_(table_(store_int16_, branch_id), sites(branch_id), lookup_kernel_int16_scalar,
+                   seqs, ranges, gap_prefix, result,
+                   [&quant, offset](const int64_t sum){ return offset + quant.scale * sum; });
+        break;
+      }
     }
-    return sum;
   }
 
 private:
+  // fixed-point representation: value = offset + scale * stored
+  struct Quantization
+  {
+    double offset = 0.0;
+    double scale = 1.0;
+  };
+
+  template <class T, class Convert>
+  Matrix<T> convert_matrix_(const Matrix<double>& table, Convert convert) const
+  {
+    Matrix<T> result(table.rows(), table.cols());
+
+    auto out = result.begin();
+    for (const auto v : table) {
+      *out++ = convert(v);
+    }
+    return result;
+  }
+
+  void init_branch_int16_(const size_t branch_id, const Matrix<double>& table)
+  {
+    auto min = std::numeric_limits<double>::max();
+    auto max = std::numeric_limits<double>::lowest();
+    for (const auto v : table) {
+      if (not std::isfinite(v)) {
+        throw std::runtime_error{"Cannot quantize non-finite per-site log-likelihood!"};
+      }
+      min = std::min(min, v);
+      max = std::max(max, v);
+    }
+
+    // map the value range of the branch symmetrically onto the int16 range
+    constexpr double int16_max = std::numeric_limits<int16_t>::max();
+    auto& quant = quantization_[branch_id];
+    quant.offset = (max + min) / 2.0;
+    quant.scale = (max > min) ? (max - min) / (2.0 * int16_max) : 1.0;
+
+    store_int16_[branch_id] = convert_matrix_<int16_t>(table, [&quant, int16_max](const double v){
+      const auto q = std::round((v - quant.offset) / quant.scale);
+      return static_cast<int16_t>(std::max(-int16_max, std::min(int16_max, q)));
+    });
+  }
+
+  size_t table_bytes_(const size_t branch_id) const
+  {
+    const auto prefix = ranged_ ? (sites(branch_id) + 1) * sizeof(double) : 0;
+    return sites(branch_id) * char_map_size_ * value_size() + prefix;
+  }
+
+  // expects lru_mutex_ to be held
+  void evict_()
+  {
+    auto it = lru_.end();
+    while (resident_bytes_ > budget_ and it != lru_.begin()) {
+      --it;
+      const auto branch_id = *it;
+      if (pins_[branch_id]) {
+        continue;
+      }
+      // a thread holding the branch mutex is about to use the table: skip it. Waiting
+      // here instead could deadlock, as that thread may be waiting for lru_mutex_
+      std::unique_lock<std::mutex> branch_lock(branch_[branch_id], std::try_to_lock);
+      if (not branch_lock.owns_lock()) {
+        continue;
+      }
+
+      resident_bytes_ -= table_bytes_(branch_id);
+      switch (precision_) {
+        case lookup_precision::DOUBLE:
+          store_[branch_id] = Matrix<double>();
+          break;
+        case lookup_precision::FLOAT:
+          store_float_[branch_id] = Matrix<float>();
+          break;
+        case lookup_precision::INT16:
+          store_int16_[branch_id] = Matrix<int16_t>();
+          break;
+      }
+      if (ranged_) {
+        gap_prefix_[branch_id] = std::vector<double>();
+      }
+      resident_[branch_id] = false;
+      it = lru_.erase(it);
+      ++evictions_;
+    }
+  }
+
+  template <class T>
+  const T * table_(const std::vector<Matrix<T>>& store, const size_t branch_id) const
+  {
+    if (mapped_) {
+      return reinterpret_cast<const T *>(mapped_tables_)
+           + branch_id * mapped_sites_ * char_map_size_;
+    }
+    return store[branch_id].get_array().data();
+  }
+
+  // one sequence needs no tiling: a single kernel call over its sites, without any
+  // allocation. Bit-identical to the block version, as the lanes see the same order
+  double sum_single_( const size_t branch_id,
+                      const unsigned char * states,
+                      const std::pair<size_t, size_t> * range) const
+  {
+    const double * gap_prefix = range ? gap_prefix_[branch_id].data() : nullptr;
+
+    switch (precision_) {
+      case lookup_precision::FLOAT:
+        return sum_one_(table_(store_float_, branch_id), sites(branch_id), lookup_kernel_float(),
+                        states, range, gap_prefix, [](const double sum){ return sum; });
+      case lookup_precision::INT16: {
+        const auto& quant = quantization_[branch_id];
+        const auto offset = quant.offset * sites(branch_id);
+        return sum_one_(table_(store_int16_, branch_id), sites(branch_id),
+                        lookup_kernel_int16_scalar, states, range, gap_prefix,
+                        [&quant, offset](const int64_t sum){ return offset + quant.scale * sum; });
+      }
+      default:
+        return sum_one_(table_(store_, branch_id), sites(branch_id), lookup_kernel(),
+                        states, range, gap_prefix, [](const double sum){ return sum; });
+    }
+  }
+
+  template <class T, class Kernel, class Finalize>
+  double sum_one_(const T * lookup,
+                  const size_t sites,
+                  Kernel kernel,
+                  const unsigned char * seq,
+                  const std::pair<size_t, size_t> * range,
+                  const double * gap_prefix,
+                  Finalize finalize) const
+  {
+    using acc_type = typename std::conditional<std::is_integral<T>::value,
+                                               int64_t, double>::type;
+
+    acc_type lanes[LOOKUP_LANES] = {};
+    const auto clamped = range ? clamp_range_(*range, sites)
+                               : std::pair<size_t, size_t>(0, sites);
+    if (clamped.first < clamped.second) {
+      kernel(lookup, char_map_size_, seq, clamped.first, clamped.second, lanes);
+    }
+
+    auto sum = reduce_lanes(lanes);
+    if (range) {
+      sum += static_cast<acc_type>(gap_prefix[clamped.first]
+                                   + (gap_prefix[sites] - gap_prefix[clamped.second]));
+    }
+    return finalize(sum);
+  }
+
+  // <range> within the sites of a table, empty if it starts beyond them. Kernel and gap
+  // prefix sums have to see the same range
+  static std::pair<size_t, size_t> clamp_range_(const std::pair<size_t, size_t>& range,
+                                                const size_t sites)
+  {
+    const auto first = std::min(range.first, sites);
+    return {first, std::max(first, std::min(range.second, sites))};
+  }
+
+  template <class T, class Kernel, class Finalize>
+  void sum_block_(const T * lookup,
+                  const size_t sites,
+                  Kernel kernel,
+                  const std::vector<const unsigned char *>& seqs,
+                  const std::vector<std::pair<size_t, size_t>>& ranges,
+                  const double * gap_prefix,
+                  std::vector<double>& result,
+                  Finalize finalize) const
+  {
+    using acc_type = typename std::conditional<std::is_integral<T>::value,
+                                               int64_t, double>::type;
+
+    const auto cols = char_map_size_;
+    const auto tile = lookup_tile_sites(cols, sizeof(T));
+
+    std::vector<acc_type> lanes(seqs.size() * LOOKUP_LANES, 0);
+
+    for (size_t begin = 0; begin < sites; begin += tile) {
+      const auto end = std::min(begin + tile, sites);
+      for (size_t i = 0; i < seqs.size(); ++i) {
+        auto first = begin;
+        auto last = end;
+        if (gap_prefix) {
+          const auto range = clamp_range_(ranges[i], sites);
+          first = std::max(first, range.first);
+          last = std::min(last, range.second);
+          if (first >= last) {
+            continue;
+          }
+        }
+        kernel( lookup,
+                cols,
+                seqs[i],
+                first,
+                last,
+                &lanes[i * LOOKUP_LANES]);
+      }
+    }
+
+    result.resize(seqs.size());
+    for (size_t i = 0; i < seqs.size(); ++i) {
+      auto sum = reduce_lanes(&lanes[i * LOOKUP_LANES]);
+      if (gap_prefix) {
+        // gap sites before and after the range. For fixed-point tables, the prefix sums
+        // hold integers and the conversion is exact
+        const auto range = clamp_range_(ranges[i], sites);
+        sum += static_cast<acc_type>(gap_prefix[range.first]
+                                     + (gap_prefix[sites] - gap_prefix[range.second]));
+      }
+      result[i] = finalize(sum);
+    }
+  }
+
+  template <class T>
+  void gap_prefix_sums_(const T * table, const size_t sites, std::vector<double>& prefix) const
+  {
+    const auto gap = char_position('-');
+    prefix.resize(sites + 1);
+    prefix[0] = 0.0;
+    for (size_t i = 0; i < sites; ++i) {
+      prefix[i + 1] = prefix[i] + table[i * char_map_size_ + gap];
+    }
+  }
+
+  void init_gap_prefix_(const size_t branch_id)
+  {
+    auto& prefix = gap_prefix_[branch_id];
+    switch (precision_) {
+      case lookup_precision::DOUBLE:
+        gap_prefix_sums_(table_(store_, branch_id), sites(branch_id), prefix);
+        break;
+      case lookup_precision::FLOAT:
+        gap_prefix_sums_(table_(store_float_, branch_id), sites(branch_id), prefix);
+        break;
+      case lookup_precision::INT16:
+        gap_prefix_sums_(table_(store_int16_, branch_id), sites(branch_id), prefix);
+        break;
+    }
+  }
+
   std::vector<std::mutex> branch_;
+  const lookup_precision precision_;
   std::vector<lookup_type> store_;
+  std::vector<Matrix<float>> store_float_;
+  std::vector<Matrix<int16_t>> store_int16_;
+  std::vector<Quantization> quantization_;
+  bool complete_ = false;
+  mutable std::once_flag builder_checked_;
+  mutable bool builder_valid_ = false;
+  // externally owned tables, see attach
+  std::shared_ptr<const void> mapped_;
+  const char * mapped_tables_ = nullptr;
+  size_t mapped_sites_ = 0;
+  // ranged mode: per branch prefix sums of the gap column
+  bool ranged_ = false;
+  std::vector<std::vector<double>> gap_prefix_;
+  // memory budget, see pin
+  size_t budget_ = 0;
+  size_t resident_bytes_ = 0;
+  mutable std::mutex lru_mutex_;
+  std::list<size_t> lru_;
+  std::vector<size_t> pins_;
+  std::vector<std::list<size_t>::iterator> lru_pos_;
+  std::vector<bool> resident_;
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+  size_t evictions_ = 0;
   const size_t char_map_size_;
   const unsigned char * char_map_;
   std::array<size_t, 128> char_to_posish_;
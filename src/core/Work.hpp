@@ -1,8 +1,11 @@
 #pragma once
 
-#include <numeric>
-#include <map>
-#include <cereal/types/map.hpp>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
 #include <cereal/types/vector.hpp>
 #include <cereal/types/base_class.hpp>
 
@@ -13,21 +16,27 @@
 class WorkIterator;
 
 /**
- * Container to hold sequence id's and their corresponding branches:
- * work[branch_id] = {seq_id_1. seq_id_2, ...}
+ * Container to hold (branch, sequence) pairs, grouped by branch: iterating yields the
+ * Work_Pairs of the first branch, then those of the next, and so on.
  *
  * Meant as a structure that can be used by nodes to figure out what to compute.
+ *
+ * The (branch, sequence) pairs are stored in compressed sparse row form: one row of
+ * sequence ids per branch, all rows in one contiguous array. Work covering every
+ * sequence of a range for every branch of a range (all-vs-all) is stored implicitly,
+ * as just the two ranges.
+ *
+ * The pairs are immutable and numbered in iteration order (branch major). A Work object
+ * is a view onto the range [first, last) of them, such that slicing it shares the
+ * underlying storage instead of copying it.
  */
 class Work : public Token
 {
 public:
   using key_type              = size_t;
   using value_type            = size_t;
-  using container_value_type  = std::vector<value_type>;
-  using container_type        = std::map<key_type, container_value_type>;
   using const_iterator        = WorkIterator;
-  // typedef typename container_type::iterator         iterator;
-  
+
   struct Work_Pair
   {
       key_type    branch_id;
@@ -40,15 +49,16 @@ public:
   template<class T>
   Work(Sample<T>& sample)
   {
+    std::vector<Work_Pair> pairs;
     for (auto& pq : sample)
     {
       const auto seq_id = pq.sequence_id();
       for (auto& placement : pq)
       {
-        const auto branch_id = placement.branch_id();
-        work_set_[branch_id].push_back(seq_id);
+        pairs.push_back({placement.branch_id(), seq_id});
       }
     }
+    build_(pairs);
   }
 
   /**
@@ -56,12 +66,20 @@ public:
    * for every branch ID in [branch_range.first, branch_range.second).
    */
   Work(std::pair<key_type, key_type>&& branch_range, std::pair<value_type, value_type>&& seq_range)
+    : branch_begin_(branch_range.first)
+    , branch_end_(std::max(branch_range.first, branch_range.second))
+    , seq_begin_(seq_range.first)
+    , seq_end_(std::max(seq_range.first, seq_range.second))
+    , last_((branch_end_ - branch_begin_) * (seq_end_ - seq_begin_))
+  { }
+
+  /**
+   * Create a work object from arbitrary pairs. Pairs of the same branch keep their
+   * relative order.
+   */
+  Work(const std::vector<Work_Pair>& pairs)
   {
-    for (key_type branch_id = branch_range.first; branch_id < branch_range.second; ++branch_id) {
-      for (value_type seq_id = seq_range.first; seq_id < seq_range.second; ++seq_id) {
-        work_set_[branch_id].push_back(seq_id);      
-      }
-    }
+    build_(pairs);
   }
 
   Work(Work const& other) = default;
@@ -70,49 +88,163 @@ public:
   Work& operator=(Work const&) = default;
   Work& operator=(Work &&) = default;
 
-  Work() = default;       
+  Work() = default;
   ~Work() = default;
 
   // methods
-  void clear() {work_set_.clear();}
-
-  size_t size() const 
+  void clear()
   {
-    return std::accumulate(work_set_.begin(), work_set_.end(), 0,
-      [](size_t a, std::pair<key_type, container_value_type> b){return a + b.second.size();}
-      );
+    csr_.reset();
+    branch_begin_ = branch_end_ = seq_begin_ = seq_end_ = 0;
+    first_ = last_ = 0;
   }
 
-  inline void add(key_type branch_id, value_type seq_id)
-  {
-    work_set_[branch_id].emplace_back(seq_id);
-  }
+  size_t size() const { return last_ - first_; }
 
-  inline void add(Work_Pair& it);
+  bool empty() const { return first_ == last_; }
 
-  // template< class InputIt >
-  // void insert(InputIt first, InputIt last) {work_set_.insert(first, last);}
+  // true if all-vs-all work that does not enumerate its pairs
+  bool implicit() const { return not csr_; }
+
+  /**
+   * View onto the pairs [first, last) of this one, sharing the storage.
+   */
+  Work slice(const size_t first, const size_t last) const
+  {
+    if (first > last or last > size()) {
+      throw std::out_of_range{"Work slice out of range!"};
+    }
+    Work result(*this);
+    result.first_ = first_ + first;
+    result.last_  = first_ + last;
+    return result;
+  }
 
   // Iterator Compatibility
-  // iterator begin() { return work_set_.begin(); }
-  // iterator end() { return work_set_.end(); }
   const_iterator begin() const;
   const_iterator end() const;
-  // const_iterator cbegin() { return work_set_.cbegin(); }
-  // const_iterator cend() { return work_set_.cend(); }
-
-  // Operator overloads
-  const container_value_type& at (const key_type index) const { return work_set_.at(index); }
-  container_value_type& operator[] (const key_type index) { return work_set_[index]; }
-  
-  // serialization
-  template <class Archive>
-  void serialize(Archive & ar) 
-  { ar( *static_cast<Token*>( this ), work_set_ ); }
 
+  // serialization: only the pairs of the view, as flat arrays
+  template <class Archive>
+  void serialize(Archive & ar)
+  { serialize_(ar, typename Archive::is_loading()); }
 
 private:
-  container_type work_set_;
+  template <class Archive>
+  void serialize_(Archive & ar, std::false_type) const
+  {
+    ar( *static_cast<const Token*>( this ) );
+
+    const bool is_implicit = implicit();
+    ar( is_implicit );
+    if (is_implicit) {
+      ar( branch_begin_, branch_end_, seq_begin_, seq_end_, first_, last_ );
+      return;
+    }
+
+    std::vector<key_type> branch_ids;
+    std::vector<size_t> offsets;
+    std::vector<value_type> seq_ids(csr_->seq_ids.begin() + first_,
+                                    csr_->seq_ids.begin() + last_);
+    if (not empty()) {
+      const auto first_row  = row_of_(first_);
+      const auto last_row   = row_of_(last_ - 1) + 1;
+      branch_ids.assign(csr_->branch_ids.begin() + first_row,
+                        csr_->branch_ids.begin() + last_row);
+      offsets.push_back(0);
+      for (size_t row = first_row + 1; row < last_row; ++row) {
+        offsets.push_back(csr_->offsets[row] - first_);
+      }
+      offsets.push_back(size());
+    }
+    ar( branch_ids, offsets, seq_ids );
+  }
+
+  template <class Archive>
+  void serialize_(Archive & ar, std::true_type)
+  {
+    clear();
+    ar( *static_cast<Token*>( this ) );
+
+    bool is_implicit;
+    ar( is_implicit );
+    if (is_implicit) {
+      ar( branch_begin_, branch_end_, seq_begin_, seq_end_, first_, last_ );
+      return;
+    }
+
+    auto csr = std::make_shared<CSR>();
+    ar( csr->branch_ids, csr->offsets, csr->seq_ids );
+    last_ = csr->seq_ids.size();
+    csr_ = std::move(csr);
+  }
+
+  /**
+   * Row <i> holds the sequence ids of branch branch_ids[i], which are
+   * seq_ids[offsets[i] .. offsets[i+1]). Only non-empty rows are stored.
+   */
+  struct CSR
+  {
+    std::vector<key_type> branch_ids;
+    std::vector<size_t> offsets;
+    std::vector<value_type> seq_ids;
+  };
+
+  void build_(const std::vector<Work_Pair>& pairs)
+  {
+    auto csr = std::make_shared<CSR>();
+    if (not pairs.empty()) {
+      // stable counting sort by branch id
+      key_type max_branch = 0;
+      for (const auto& p : pairs) {
+        max_branch = std::max(max_branch, p.branch_id);
+      }
+      std::vector<size_t> counts(max_branch + 2, 0);
+      for (const auto& p : pairs) {
+        ++counts[p.branch_id + 1];
+      }
+      for (size_t i = 1; i < counts.size(); ++i) {
+        counts[i] += counts[i - 1];
+      }
+
+      csr->seq_ids.resize(pairs.size());
+      csr->offsets.push_back(0);
+      for (key_type branch_id = 0; branch_id <= max_branch; ++branch_id) {
+        if (counts[branch_id + 1] > counts[branch_id]) {
+          csr->branch_ids.push_back(branch_id);
+          csr->offsets.push_back(counts[branch_id + 1]);
+        }
+      }
+      for (const auto& p : pairs) {
+        csr->seq_ids[counts[p.branch_id]++] = p.sequence_id;
+      }
+    }
+    first_ = 0;
+    last_ = csr->seq_ids.size();
+    csr_ = std::move(csr);
+  }
+
+  // the CSR row containing pair <pos>
+  size_t row_of_(const size_t pos) const
+  {
+    const auto& offsets = csr_->offsets;
+    return std::distance(offsets.begin(),
+                         std::upper_bound(offsets.begin(), offsets.end(), pos)) - 1;
+  }
+
+  std::shared_ptr<const CSR> csr_;
+
+  // ranges of the implicit form
+  key_type branch_begin_ = 0;
+  key_type branch_end_ = 0;
+  value_type seq_begin_ = 0;
+  value_type seq_end_ = 0;
+
+  // the view
+  size_t first_ = 0;
+  size_t last_ = 0;
+
+  friend class WorkIterator;
 };
 
 class WorkIterator
@@ -121,9 +253,6 @@ public:
     // -----------------------------------------------------
     //     Typedefs
     // -----------------------------------------------------
-    using WorkType      = Work::container_type;
-    using MapItType     = typename WorkType::const_iterator;
-    using VecItType     = typename WorkType::mapped_type::const_iterator;
     using self_type     = WorkIterator;
     using element_type  = Work::Work_Pair;
     using iterator_tag  = std::forward_iterator_tag;
@@ -134,21 +263,22 @@ public:
 
     WorkIterator() = delete;
 
-    WorkIterator( WorkType const& target, bool is_end )
-        : map_it( std::begin( target ) )
-        , end_it( std::end( target ) )
-        , vec_it()
+    WorkIterator( Work const& target, bool is_end )
+        : work_( &target )
+        , pos_( is_end ? target.last_ : target.first_ )
     {
-        if( is_end ) {
-            map_it = end_it;
+        if( pos_ == target.last_ ) {
+            return;
         }
-        if( map_it != end_it && ! target.empty() ) {
-            while( map_it != end_it && map_it->second.empty() ) {
-                ++map_it;
-            }
-            if( map_it != end_it && ! map_it->second.empty() ) {
-                vec_it = std::begin( map_it->second );
-            }
+        if( target.implicit() ) {
+            const auto num_seqs = target.seq_end_ - target.seq_begin_;
+            branch_id_  = target.branch_begin_ + pos_ / num_seqs;
+            seq_id_     = target.seq_begin_ + pos_ % num_seqs;
+        } else {
+            row_        = target.row_of_( pos_ );
+            row_end_    = target.csr_->offsets[ row_ + 1 ];
+            branch_id_  = target.csr_->branch_ids[ row_ ];
+            seq_id_     = target.csr_->seq_ids[ pos_ ];
         }
     }
 
@@ -165,37 +295,37 @@ public:
 
     element_type operator * ()
     {
-        return { map_it->first, *vec_it };
+        return { branch_id_, seq_id_ };
     }
 
-    // self_type const* operator -> ()
-    // {
-    //     return this;
-    // }
-
     size_t current_branch_id()
     {
-
-      return map_it->first;
+      return branch_id_;
     }
 
     size_t current_sequence_id()
     {
-        return *vec_it;
+        return seq_id_;
     }
 
     self_type operator ++ ()
     {
-        ++vec_it;
-        if( vec_it == map_it->second.end() ) {
-            do {
-                ++map_it;
-                if( map_it == end_it ) {
-                    break;
-                } else {
-                    vec_it = std::begin( map_it->second );
-                }
-            } while( vec_it == std::end( map_it->second ) );
+        if( ++pos_ == work_->last_ ) {
+            return *this;
+        }
+        if( work_->implicit() ) {
+            if( ++seq_id_ == work_->seq_end_ ) {
+                seq_id_ = work_->seq_begin_;
+                ++branch_id_;
+            }
+        } else {
+            const auto& csr = *work_->csr_;
+            if( pos_ == row_end_ ) {
+                ++row_;
+                row_end_    = csr.offsets[ row_ + 1 ];
+                branch_id_  = csr.branch_ids[ row_ ];
+            }
+            seq_id_ = csr.seq_ids[ pos_ ];
         }
         return *this;
     }
@@ -209,8 +339,7 @@ public:
 
     bool operator == (const self_type &other) const
     {
-        return ( other.map_it == map_it && other.end_it == end_it ) &&
-               ( map_it == end_it || other.vec_it == vec_it );
+        return other.work_ == work_ && other.pos_ == pos_;
     }
 
     bool operator != (const self_type &other) const
@@ -224,23 +353,23 @@ public:
 
 private:
 
-    MapItType map_it;
-    MapItType end_it;
+    Work const* work_;
+    size_t pos_;
 
-    VecItType vec_it;
-};
+    // current CSR row and the position it ends at
+    size_t row_ = 0;
+    size_t row_end_ = 0;
 
-inline void Work::add(Work_Pair& it)
-{
-  add(it.branch_id, it.sequence_id);
-}
+    size_t branch_id_ = 0;
+    size_t seq_id_ = 0;
+};
 
 inline Work::const_iterator Work::begin() const
 {
-    return WorkIterator( work_set_, false );
+    return WorkIterator( *this, false );
 }
 
 inline Work::const_iterator Work::end() const
 {
-    return WorkIterator( work_set_, true );
-}
\ No newline at end of file
+    return WorkIterator( *this, true );
+}
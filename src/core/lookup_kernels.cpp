@@ -0,0 +1,325 @@
+#include "core/lookup_kernels.hpp"
+
+#if defined(__SSE3) || defined(__AVX) || defined(__AVX2) || defined(__AVX512)
+#include <immintrin.h>
+#endif
+
+/*
+  The SIMD kernels are compiled for their respective instruction set via the target
+  attribute, independently of the global compiler flags. Which one is used is decided
+  at runtime, based on what the executing CPU supports.
+*/
+#define EPA_TARGET(isa) __attribute__((target(isa)))
+
+template <class T>
+static inline T site_value( const T * lookup,
+                            const size_t cols,
+                            const unsigned char * seq,
+                            const size_t site)
+{
+  return lookup[site * cols + seq[site]];
+}
+
+template <class T, class Acc>
+static inline size_t scalar_range( const T * lookup,
+                                   const size_t cols,
+                                   const unsigned char * seq,
+                                   size_t site,
+                                   const size_t end,
+                                   Acc * lanes)
+{
+  for (; site < end; ++site) {
+    lanes[site % LOOKUP_LANES] += site_value(lookup, cols, seq, site);
+  }
+  return site;
+}
+
+// first site that starts a full block of lanes, capped by end
+static inline size_t aligned_begin(const size_t begin, const size_t end)
+{
+  const size_t rem = begin % LOOKUP_LANES;
+  const size_t aligned = rem ? begin + (LOOKUP_LANES - rem) : begin;
+  return aligned < end ? aligned : end;
+}
+
+void lookup_kernel_scalar(const double * lookup,
+                          const size_t cols,
+                          const unsigned char * seq,
+                          const size_t begin,
+                          const size_t end,
+                          double * lanes)
+{
+  scalar_range(lookup, cols, seq, begin, end, lanes);
+}
+
+void lookup_kernel_float_scalar(const float * lookup,
+                                const size_t cols,
+                                const unsigned char * seq,
+                                const size_t begin,
+                                const size_t end,
+                                double * lanes)
+{
+  scalar_range(lookup, cols, seq, begin, end, lanes);
+}
+
+void lookup_kernel_int16_scalar(const int16_t * lookup,
+                                const size_t cols,
+                                const unsigned char * seq,
+                                const size_t begin,
+                                const size_t end,
+                                int64_t * lanes)
+{
+  scalar_range(lookup, cols, seq, begin, end, lanes);
+}
+
+#if defined(__SSE3) || defined(__AVX)
+EPA_TARGET("sse3")
+static void lookup_kernel_sse3( const double * lookup,
+                                const size_t cols,
+                                const unsigned char * seq,
+                                const size_t begin,
+                                const size_t end,
+                                double * lanes)
+{
+  auto site = scalar_range(lookup, cols, seq,
+                           begin, aligned_begin(begin, end), lanes);
+
+  __m128d acc_0 = _mm_loadu_pd(lanes);
+  __m128d acc_1 = _mm_loadu_pd(lanes + 2);
+  __m128d acc_2 = _mm_loadu_pd(lanes + 4);
+  __m128d acc_3 = _mm_loadu_pd(lanes + 6);
+
+  for (; site + LOOKUP_LANES <= end; site += LOOKUP_LANES) {
+    const double * row = lookup + site * cols;
+    const auto s = seq + site;
+
+    acc_0 = _mm_add_pd(acc_0, _mm_set_pd(row[1*cols + s[1]], row[s[0]]));
+    acc_1 = _mm_add_pd(acc_1, _mm_set_pd(row[3*cols + s[3]], row[2*cols + s[2]]));
+    acc_2 = _mm_add_pd(acc_2, _mm_set_pd(row[5*cols + s[5]], row[4*cols + s[4]]));
+    acc_3 = _mm_add_pd(acc_3, _mm_set_pd(row[7*cols + s[7]], row[6*cols + s[6]]));
+  }
+
+  _mm_storeu_pd(lanes, acc_0);
+  _mm_storeu_pd(lanes + 2, acc_1);
+  _mm_storeu_pd(lanes + 4, acc_2);
+  _mm_storeu_pd(lanes + 6, acc_3);
+
+  scalar_range(lookup, cols, seq, site, end, lanes);
+}
+#endif
+
+#ifdef __AVX
+EPA_TARGET("avx")
+static void lookup_kernel_avx(const double * lookup,
+                              const size_t cols,
+                              const unsigned char * seq,
+                              const size_t begin,
+                              const size_t end,
+                              double * lanes)
+{
+  auto site = scalar_range(lookup, cols, seq,
+                           begin, aligned_begin(begin, end), lanes);
+
+  __m256d acc_lo = _mm256_loadu_pd(lanes);
+  __m256d acc_hi = _mm256_loadu_pd(lanes + 4);
+
+  for (; site + LOOKUP_LANES <= end; site += LOOKUP_LANES) {
+    const double * row = lookup + site * cols;
+    const auto s = seq + site;
+
+    acc_lo = _mm256_add_pd(acc_lo, _mm256_set_pd( row[3*cols + s[3]],
+                                                  row[2*cols + s[2]],
+                                                  row[1*cols + s[1]],
+                                                  row[s[0]]));
+    acc_hi = _mm256_add_pd(acc_hi, _mm256_set_pd( row[7*cols + s[7]],
+                                                  row[6*cols + s[6]],
+                                                  row[5*cols + s[5]],
+                                                  row[4*cols + s[4]]));
+  }
+
+  _mm256_storeu_pd(lanes, acc_lo);
+  _mm256_storeu_pd(lanes + 4, acc_hi);
+
+  scalar_range(lookup, cols, seq, site, end, lanes);
+}
+#endif
+
+#ifdef __AVX2
+EPA_TARGET("avx2")
+static void lookup_kernel_avx2( const double * lookup,
+                                const size_t cols,
+                                const unsigned char * seq,
+                                const size_t begin,
+                                const size_t end,
+                                double * lanes)
+{
+  auto site = scalar_range(lookup, cols, seq,
+                           begin, aligned_begin(begin, end), lanes);
+  const int c = static_cast<int>(cols);
+
+  // offsets of the rows within one block of sites
+  const __m128i row_lo = _mm_setr_epi32(0, c, 2*c, 3*c);
+  const __m128i row_hi = _mm_setr_epi32(4*c, 5*c, 6*c, 7*c);
+
+  // masked gathers: the unmasked ones leave their source operand undefined
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d mask = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+
+  __m256d acc_lo = _mm256_loadu_pd(lanes);
+  __m256d acc_hi = _mm256_loadu_pd(lanes + 4);
+
+  for (; site + LOOKUP_LANES <= end; site += LOOKUP_LANES) {
+    const double * row = lookup + site * cols;
+    const auto s = seq + site;
+
+    // widen the eight state indices of the block to 32 bit
+    const __m128i states = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(s));
+    const __m128i idx_lo = _mm_add_epi32(row_lo, _mm_cvtepu8_epi32(states));
+    const __m128i idx_hi = _mm_add_epi32(row_hi, _mm_cvtepu8_epi32(_mm_srli_si128(states, 4)));
+
+    acc_lo = _mm256_add_pd(acc_lo,
+      _mm256_mask_i32gather_pd(zero, row, idx_lo, mask, sizeof(double)));
+    acc_hi = _mm256_add_pd(acc_hi,
+      _mm256_mask_i32gather_pd(zero, row, idx_hi, mask, sizeof(double)));
+  }
+
+  _mm256_storeu_pd(lanes, acc_lo);
+  _mm256_storeu_pd(lanes + 4, acc_hi);
+
+  scalar_range(lookup, cols, seq, site, end, lanes);
+}
+#endif
+
+#ifdef __AVX2
+EPA_TARGET("avx2")
+static void lookup_kernel_float_avx2( const float * lookup,
+                                      const size_t cols,
+                                      const unsigned char * seq,
+                                      const size_t begin,
+                                      const size_t end,
+                                      double * lanes)
+{
+  auto site = scalar_range(lookup, cols, seq,
+                           begin, aligned_begin(begin, end), lanes);
+  const int c = static_cast<int>(cols);
+
+  const __m256i rows = _mm256_setr_epi32(0, c, 2*c, 3*c, 4*c, 5*c, 6*c, 7*c);
+
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+  __m256d acc_lo = _mm256_loadu_pd(lanes);
+  __m256d acc_hi = _mm256_loadu_pd(lanes + 4);
+
+  for (; site + LOOKUP_LANES <= end; site += LOOKUP_LANES) {
+    const float * row = lookup + site * cols;
+    const auto s = seq + site;
+
+    const __m128i states = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(s));
+    const __m256i idx = _mm256_add_epi32(rows, _mm256_cvtepu8_epi32(states));
+
+    // one gather for all eight sites, widened to double before accumulating
+    const __m256 values = _mm256_mask_i32gather_ps(zero, row, idx, mask, sizeof(float));
+
+    acc_lo = _mm256_add_pd(acc_lo, _mm256_cvtps_pd(_mm256_castps256_ps128(values)));
+    acc_hi = _mm256_add_pd(acc_hi, _mm256_cvtps_pd(_mm256_extractf128_ps(values, 1)));
+  }
+
+  _mm256_storeu_pd(lanes, acc_lo);
+  _mm256_storeu_pd(lanes + 4, acc_hi);
+
+  scalar_range(lookup, cols, seq, site, end, lanes);
+}
+#endif
+
+#ifdef __AVX512
+EPA_TARGET("avx512f,avx2")
+static void lookup_kernel_avx512( const double * lookup,
+                                  const size_t cols,
+                                  const unsigned char * seq,
+                                  const size_t begin,
+                                  const size_t end,
+                                  double * lanes)
+{
+  auto site = scalar_range(lookup, cols, seq,
+                           begin, aligned_begin(begin, end), lanes);
+  const int c = static_cast<int>(cols);
+
+  const __m256i rows = _mm256_setr_epi32(0, c, 2*c, 3*c, 4*c, 5*c, 6*c, 7*c);
+
+  const __m512d zero = _mm512_setzero_pd();
+
+  __m512d acc = _mm512_loadu_pd(lanes);
+
+  for (; site + LOOKUP_LANES <= end; site += LOOKUP_LANES) {
+    const double * row = lookup + site * cols;
+    const auto s = seq + site;
+
+    const __m128i states = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(s));
+    const __m256i idx = _mm256_add_epi32(rows, _mm256_cvtepu8_epi32(states));
+
+    acc = _mm512_add_pd(acc,
+      _mm512_mask_i32gather_pd(zero, 0xFF, idx, row, sizeof(double)));
+  }
+
+  _mm512_storeu_pd(lanes, acc);
+
+  scalar_range(lookup, cols, seq, site, end, lanes);
+}
+#endif
+
+struct Kernel_Choice
+{
+  lookup_kernel_type kernel;
+  lookup_kernel_float_type kernel_float;
+  const char * name;
+};
+
+static Kernel_Choice select_kernel()
+{
+#if defined(__SSE3) || defined(__AVX) || defined(__AVX2) || defined(__AVX512)
+  __builtin_cpu_init();
+#endif
+#ifdef __AVX512
+  if (__builtin_cpu_supports("avx512f") and __builtin_cpu_supports("avx2")) {
+    return {lookup_kernel_avx512, lookup_kernel_float_avx2, "AVX-512"};
+  }
+#endif
+#ifdef __AVX2
+  if (__builtin_cpu_supports("avx2")) {
+    return {lookup_kernel_avx2, lookup_kernel_float_avx2, "AVX2"};
+  }
+#endif
+#ifdef __AVX
+  if (__builtin_cpu_supports("avx")) {
+    return {lookup_kernel_avx, lookup_kernel_float_scalar, "AVX"};
+  }
+#endif
+#if defined(__SSE3) || defined(__AVX)
+  if (__builtin_cpu_supports("sse3")) {
+    return {lookup_kernel_sse3, lookup_kernel_float_scalar, "SSE3"};
+  }
+#endif
+  return {lookup_kernel_scalar, lookup_kernel_float_scalar, "scalar"};
+}
+
+static const Kernel_Choice& kernel_choice()
+{
+  static const Kernel_Choice choice = select_kernel();
+  return choice;
+}
+
+lookup_kernel_type lookup_kernel()
+{
+  return kernel_choice().kernel;
+}
+
+lookup_kernel_float_type lookup_kernel_float()
+{
+  return kernel_choice().kernel_float;
+}
+
+const char * lookup_kernel_name()
+{
+  return kernel_choice().name;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Kernels summing up precomputed per-site log-likelihoods of a query, as used by
+ * the Lookup_Store during preplacement. The query is given as one state index
+ * (column of the lookup table) per site, see Encoded_MSA.
+ *
+ * Every kernel adds the value of site <s> to lane (s % LOOKUP_LANES), in increasing
+ * order of s. As long as that holds, all kernels (scalar and SIMD) produce
+ * bit-identical results after the final reduction via reduce_lanes.
+ */
+constexpr size_t LOOKUP_LANES = 8;
+
+template <class T, class Acc>
+using lookup_kernel_t = void(*)(const T * lookup,
+                                const size_t cols,
+                                const unsigned char * seq,
+                                const size_t begin,
+                                const size_t end,
+                                Acc * lanes);
+
+using lookup_kernel_type        = lookup_kernel_t<double, double>;
+// single precision tables, accumulated in double precision
+using lookup_kernel_float_type  = lookup_kernel_t<float, double>;
+// fixed-point tables, accumulated exactly
+using lookup_kernel_int16_type  = lookup_kernel_t<int16_t, int64_t>;
+
+// amount of lookup table kept in cache while a block of queries is scored
+constexpr size_t LOOKUP_TILE_BYTES = 32 * 1024;
+
+// number of sites per tile, a multiple of the lane count
+inline size_t lookup_tile_sites(const size_t cols, const size_t value_size=sizeof(double))
+{
+  const auto rows = LOOKUP_TILE_BYTES / (cols * value_size);
+  return rows < LOOKUP_LANES ? LOOKUP_LANES : rows - (rows % LOOKUP_LANES);
+}
+
+// reference implementation, always available
+void lookup_kernel_scalar(const double * lookup,
+                          const size_t cols,
+                          const unsigned char * seq,
+                          const size_t begin,
+                          const size_t end,
+                          double * lanes);
+
+void lookup_kernel_float_scalar(const float * lookup,
+                                const size_t cols,
+                                const unsigned char * seq,
+                                const size_t begin,
+                                const size_t end,
+                                double * lanes);
+
+void lookup_kernel_int16_scalar(const int16_t * lookup,
+                                const size_t cols,
+                                const unsigned char * seq,
+                                const size_t begin,
+                                const size_t end,
+                                int64_t * lanes);
+
+// returns the best kernel supported by the executing CPU (determined once)
+lookup_kernel_type lookup_kernel();
+lookup_kernel_float_type lookup_kernel_float();
+const char * lookup_kernel_name();
+
+inline double reduce_lanes(const double * lanes)
+{
+  return ((lanes[0] + lanes[4]) + (lanes[2] + lanes[6]))
+       + ((lanes[1] + lanes[5]) + (lanes[3] + lanes[7]));
+}
+
+inline int64_t reduce_lanes(const int64_t * lanes)
+{
+  int64_t sum = 0;
+  for (size_t i = 0; i < LOOKUP_LANES; ++i) {
+    sum += lanes[i];
+  }
+  return sum;
+}
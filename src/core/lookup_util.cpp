@@ -0,0 +1,379 @@
+#include "core/lookup_util.hpp"
+
+#ifdef __OMP
+#include <omp.h>
+#endif
+
+#include <atomic>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+#include <unistd.h>
+
+#include "tree/Tiny_Tree.hpp"
+#include "io/Memory_Map.hpp"
+#include "core/lookup_kernels.hpp"
+#include "core/pll/pll_util.hpp"
+#include "util/Timer.hpp"
+#include "util/logging.hpp"
+
+constexpr char LOOKUP_CACHE_MAGIC[8] = "EPALUT";
+constexpr uint64_t LOOKUP_CACHE_VERSION = 1;
+// tables start at a page boundary
+constexpr uint64_t LOOKUP_CACHE_ALIGNMENT = 4096;
+
+/*
+  File layout:
+  <header><num_branches * (offset, scale) quantization pairs><padding><tables>
+  where the tables of all branches are stored back to back, each sites x char_map_size
+  values in the storage precision of the store.
+*/
+struct Lookup_Cache_Header
+{
+  char magic[8];
+  uint64_t version;
+  uint64_t key;
+  uint64_t precision;
+  uint64_t num_branches;
+  uint64_t sites;
+  uint64_t char_map_size;
+  uint64_t data_offset;
+};
+
+static uint64_t fnv1a(const void * data,
+                      const size_t size,
+                      uint64_t hash=14695981039346656037ull)
+{
+  const auto bytes = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+template <class T>
+static uint64_t fnv1a_value(const T& value, const uint64_t hash)
+{
+  return fnv1a(&value, sizeof(T), hash);
+}
+
+static uint64_t data_offset(const uint64_t num_branches)
+{
+  const uint64_t end = sizeof(Lookup_Cache_Header) + num_branches * 2 * sizeof(double);
+  return ((end + LOOKUP_CACHE_ALIGNMENT - 1) / LOOKUP_CACHE_ALIGNMENT) * LOOKUP_CACHE_ALIGNMENT;
+}
+
+void warm_up_lookups( std::shared_ptr<Lookup_Store>& lookups,
+                      Tree& reference_tree,
+                      const std::vector<pll_unode_t *>& branches,
+                      const Options& options)
+{
+  Timer<> timer;
+  timer.start();
+
+#ifdef __OMP
+  const unsigned int num_threads  = options.num_threads
+                                  ? options.num_threads
+                                  : omp_get_max_threads();
+  // branches differ in cost (tip-tip vs. inner), so hand them out dynamically
+  #pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+#endif
+  for (size_t i = 0; i < branches.size(); ++i) {
+    // constructing the tiny tree without BLO builds the table of the branch
+    Tiny_Tree(branches[i], i, reference_tree, false, options, lookups);
+  }
+
+  lookups->mark_complete();
+
+  timer.stop();
+
+  LOG_INFO << "Precomputed lookup tables for " << branches.size() << " branches in "
+           << timer.sum() / 1e6 << "s ("
+           << lookups->size_in_bytes() / (1024.0 * 1024.0) << " MiB)";
+}
+
+/*
+  Hashes the tip data of the reference partition in order of the tip CLV indices: the
+  tipchars in pattern tip mode, otherwise the tip CLVs (without the padding states).
+*/
+static uint64_t hash_tip_data(Tree& reference_tree, uint64_t hash)
+{
+  const auto partition = reference_tree.partition();
+  const auto tree = reference_tree.tree();
+  const bool use_tipchars = partition->attributes & PLL_ATTRIB_PATTERN_TIP;
+
+  std::vector<const pll_unode_t *> tips(partition->tips, nullptr);
+  for (size_t i = 0; i < tree->tip_count; ++i) {
+    tips.at(tree->nodes[i]->clv_index) = tree->nodes[i];
+  }
+
+  const size_t sites = partition->sites;
+  const size_t states = partition->states;
+  const size_t states_padded = partition->states_padded;
+  const size_t rate_cats = partition->rate_cats;
+
+  for (const auto tip : tips) {
+    if (not tip) {
+      throw std::runtime_error{"Reference tree and partition differ in their tips!"};
+    }
+    const auto data = reference_tree.get_clv(tip);
+    if (use_tipchars) {
+      hash = fnv1a(data, sites, hash);
+    } else {
+      const auto clv = static_cast<const double *>(data);
+      for (size_t i = 0; i < sites * rate_cats; ++i) {
+        hash = fnv1a(clv + i * states_padded, states * sizeof(double), hash);
+      }
+    }
+  }
+
+  return hash;
+}
+
+uint64_t lookup_cache_key(Tree& reference_tree, const Options& options)
+{
+  const auto partition = reference_tree.partition();
+
+  // tree topology and branch lengths
+  const auto newick = get_numbered_newick_string(reference_tree.tree());
+  auto hash = fnv1a(newick.data(), newick.size());
+
+  // model parameters
+  const size_t states = partition->states;
+  const size_t rate_cats = partition->rate_cats;
+  hash = fnv1a(partition->frequencies[0], states * sizeof(double), hash);
+  hash = fnv1a(partition->subst_params[0], (states * (states - 1) / 2) * sizeof(double), hash);
+  hash = fnv1a(partition->rates, rate_cats * sizeof(double), hash);
+  hash = fnv1a(partition->rate_weights, rate_cats * sizeof(double), hash);
+  hash = fnv1a_value(partition->prop_invar[0], hash);
+
+  // alignment: the tip data of every tip, and the pattern weights
+  hash = fnv1a_value(partition->sites, hash);
+  hash = hash_tip_data(reference_tree, hash);
+  if (partition->pattern_weights) {
+    hash = fnv1a(partition->pattern_weights, partition->sites * sizeof(unsigned int), hash);
+  }
+
+  // layout of the tables
+  hash = fnv1a_value(options.precision, hash);
+
+  return hash;
+}
+
+void save_lookup_cache( const Lookup_Store& lookups,
+                        const std::string& file_name,
+                        const uint64_t key)
+{
+  if (not lookups.complete()) {
+    throw std::runtime_error{"Cannot save an incomplete lookup store!"};
+  }
+
+  const uint64_t num_branches = lookups.num_branches();
+
+  Lookup_Cache_Header header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, LOOKUP_CACHE_MAGIC, sizeof(header.magic));
+  header.version        = LOOKUP_CACHE_VERSION;
+  header.key            = key;
+  header.precision      = static_cast<uint64_t>(lookups.precision());
+  header.num_branches   = num_branches;
+  header.sites          = num_branches ? lookups.sites(0) : 0;
+  header.char_map_size  = lookups.char_map_size();
+  header.data_offset    = data_offset(num_branches);
+
+  // write to a private file first, such that concurrent writers (and readers) never
+  // see a partial file
+  const auto tmp_name = file_name + ".tmp." + std::to_string(getpid());
+  {
+    std::ofstream out(tmp_name, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    for (size_t i = 0; i < num_branches; ++i) {
+      const auto quant = lookups.quantization(i);
+      out.write(reinterpret_cast<const char *>(&quant.first), sizeof(double));
+      out.write(reinterpret_cast<const char *>(&quant.second), sizeof(double));
+    }
+
+    const std::vector<char> padding(header.data_offset - static_cast<uint64_t>(out.tellp()), 0);
+    out.write(padding.data(), padding.size());
+
+    const auto table_size = header.sites * header.char_map_size * lookups.value_size();
+    for (size_t i = 0; i < num_branches; ++i) {
+      if (lookups.sites(i) != header.sites) {
+        throw std::runtime_error{"Lookup tables differ in size, cannot save them!"};
+      }
+      out.write(static_cast<const char *>(lookups.raw_table(i)), table_size);
+    }
+
+    if (not out) {
+      throw std::runtime_error{std::string("Failed writing lookup cache file: ") + tmp_name};
+    }
+  }
+
+  if (std::rename(tmp_name.c_str(), file_name.c_str())) {
+    std::remove(tmp_name.c_str());
+    throw std::runtime_error{std::string("Could not move lookup cache file into place: ")
+      + file_name};
+  }
+}
+
+bool load_lookup_cache( Lookup_Store& lookups,
+                        const std::string& file_name,
+                        const uint64_t key)
+{
+  if (access(file_name.c_str(), R_OK)) {
+    return false;
+  }
+
+  auto map = std::make_shared<Memory_Map>(file_name);
+
+  if (map->size() < sizeof(Lookup_Cache_Header)) {
+    LOG_INFO << "Lookup cache file is truncated, ignoring it: " << file_name;
+    return false;
+  }
+
+  Lookup_Cache_Header header;
+  std::memcpy(&header, map->data(), sizeof(header));
+
+  const uint64_t num_branches = lookups.num_branches();
+
+  if (std::memcmp(header.magic, LOOKUP_CACHE_MAGIC, sizeof(header.magic))
+    or header.version != LOOKUP_CACHE_VERSION) {
+    LOG_INFO << "Not a lookup cache file (or an outdated one), ignoring it: " << file_name;
+    return false;
+  }
+
+  if (header.key != key
+    or header.precision != static_cast<uint64_t>(lookups.precision())
+    or header.num_branches != num_branches
+    or header.char_map_size != lookups.char_map_size()
+    or header.data_offset != data_offset(num_branches)) {
+    LOG_INFO << "Lookup cache file does not match the reference, ignoring it: " << file_name;
+    return false;
+  }
+
+  const auto tables_size = num_branches * header.sites * header.char_map_size
+                         * lookups.value_size();
+  if (map->size() < header.data_offset + tables_size) {
+    LOG_INFO << "Lookup cache file is truncated, ignoring it: " << file_name;
+    return false;
+  }
+
+  std::vector<std::pair<double, double>> quantization(num_branches);
+  const auto quant_data = map->data() + sizeof(header);
+  for (size_t i = 0; i < num_branches; ++i) {
+    std::memcpy(&quantization[i].first, quant_data + (2 * i) * sizeof(double), sizeof(double));
+    std::memcpy(&quantization[i].second, quant_data + (2 * i + 1) * sizeof(double), sizeof(double));
+  }
+
+  const auto tables = map->data() + header.data_offset;
+  lookups.attach(map, tables, header.sites, quantization);
+
+  return true;
+}
+
+void prepare_lookups( std::shared_ptr<Lookup_Store>& lookups,
+                      Tree& reference_tree,
+                      const std::vector<pll_unode_t *>& branches,
+                      const Options& options)
+{
+  LOG_DBG << "Lookup kernel: " << lookup_kernel_name();
+
+  // the gap prefix sums are built along with the tables
+  lookups->ranged(options.ranged);
+
+  const auto& cache_file = options.lookup_cache_file;
+
+  uint64_t key = 0;
+  if (not cache_file.empty()) {
+    key = lookup_cache_key(reference_tree, options);
+    if (load_lookup_cache(*lookups, cache_file, key)) {
+      LOG_INFO << "Mapped lookup tables from cache file: " << cache_file << " ("
+               << lookups->size_in_bytes() / (1024.0 * 1024.0) << " MiB)";
+      return;
+    }
+  }
+
+  if (options.lookup_memory) {
+    const auto total = branches.size() * reference_tree.partition()->sites
+                     * lookups->char_map_size() * lookups->value_size();
+    if (total > options.lookup_memory) {
+      // tables are built when first needed, and evicted again if over budget
+      lookups->memory_budget(options.lookup_memory);
+      LOG_INFO << "Lookup tables (" << total / (1024.0 * 1024.0)
+               << " MiB) exceed the memory budget, building them on demand";
+      return;
+    }
+  }
+
+  warm_up_lookups(lookups, reference_tree, branches, options);
+
+  if (not cache_file.empty()) {
+    save_lookup_cache(*lookups, cache_file, key);
+    LOG_INFO << "Wrote lookup tables to cache file: " << cache_file;
+  }
+}
+
+std::shared_ptr<Lookup_Store> build_logl_bounds(Tree& reference_tree,
+                                                const std::vector<pll_unode_t *>& branches,
+                                                const Options& options)
+{
+  Timer<> timer;
+  timer.start();
+
+  auto bounds = std::make_shared<Lookup_Store>(branches.size(),
+                                               reference_tree.partition()->states);
+  std::atomic<bool> supported(true);
+
+#ifdef __OMP
+  const unsigned int num_threads  = options.num_threads
+                                  ? options.num_threads
+                                  : omp_get_max_threads();
+  #pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+#endif
+  for (size_t i = 0; i < branches.size(); ++i) {
+    // a tree with BLO leaves the store alone
+    Tiny_Tree tree(branches[i], i, reference_tree, true, options, bounds);
+    Matrix<double> table;
+    if (tree.logl_bounds(*bounds, table)) {
+      bounds->init_branch(i, std::move(table));
+    } else {
+      supported = false;
+    }
+  }
+
+  timer.stop();
+
+  if (not supported) {
+    LOG_INFO << "The model does not allow to bound placement logls, "
+             << "exact BLO pruning skips nothing";
+    return nullptr;
+  }
+
+  bounds->mark_complete();
+
+  LOG_INFO << "Computed placement logl bounds for " << branches.size() << " branches in "
+           << timer.sum() / 1e6 << "s ("
+           << bounds->size_in_bytes() / (1024.0 * 1024.0) << " MiB)";
+
+  return bounds;
+}
+
+void log_lookup_stats(const Lookup_Store& lookups)
+{
+  if (not lookups.memory_budget()) {
+    return;
+  }
+
+  const auto hits = lookups.hits();
+  const auto misses = lookups.misses();
+  const auto total = hits + misses;
+
+  LOG_INFO << "Lookup tables: " << hits << " hits, " << misses << " misses ("
+           << (total ? 100.0 * hits / total : 0.0) << "% hit rate), "
+           << lookups.evictions() << " evictions";
+}
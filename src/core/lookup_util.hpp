@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "core/pll/pllhead.hpp"
+#include "core/Lookup_Store.hpp"
+#include "tree/Tree.hpp"
+#include "util/Options.hpp"
+
+/**
+ * Builds the preplacement lookup tables of all branches up front, in parallel,
+ * instead of lazily during the first chunk. Afterwards the store is marked as
+ * complete, such that Tiny_Tree no longer needs to lock or check it.
+ */
+void warm_up_lookups( std::shared_ptr<Lookup_Store>& lookups,
+                      Tree& reference_tree,
+                      const std::vector<pll_unode_t *>& branches,
+                      const Options& options);
+
+/**
+ * Lookup cache files: the complete tables of a store, valid for exactly one reference
+ * tree (including branch lengths), model, reference alignment and storage precision,
+ * as identified by the key.
+ */
+uint64_t lookup_cache_key(Tree& reference_tree, const Options& options);
+void save_lookup_cache( const Lookup_Store& lookups,
+                        const std::string& file_name,
+                        const uint64_t key);
+// returns false if the file does not exist or does not match the store/key
+bool load_lookup_cache( Lookup_Store& lookups,
+                        const std::string& file_name,
+                        const uint64_t key);
+
+/**
+ * Makes the store complete: either by mapping the cache file given in the options,
+ * or by building the tables (and then writing the cache file, if one is given).
+ */
+void prepare_lookups( std::shared_ptr<Lookup_Store>& lookups,
+                      Tree& reference_tree,
+                      const std::vector<pll_unode_t *>& branches,
+                      const Options& options);
+
+/**
+ * Upper bounds of the placement logl on every branch, for the exact pruning of thorough
+ * candidates (see Blo_Pruner): a store of double precision tables of per-site bounds over
+ * all branch lengths, laid out like the lookup tables (see precompute_bounds). Null if
+ * the model is not supported.
+ */
+std::shared_ptr<Lookup_Store> build_logl_bounds(Tree& reference_tree,
+                                                const std::vector<pll_unode_t *>& branches,
+                                                const Options& options);
+
+// logs the hit/miss counters of a store with a memory budget (no-op otherwise)
+void log_lookup_stats(const Lookup_Store& lookups);
@@ -5,6 +5,11 @@
 #include <memory>
 #include <functional>
 #include <limits>
+#include <map>
+#include <cmath>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
 
 #ifdef __OMP
 #include <omp.h>
@@ -16,93 +21,491 @@
 #include "set_manipulators.hpp"
 #include "util/logging.hpp"
 #include "tree/Tiny_Tree.hpp"
+#include "tree/Tiny_Tree_Cache.hpp"
 #include "net/mpihead.hpp"
 #include "core/pll/pll_util.hpp"
 #include "core/pll/epa_pll_util.hpp"
 #include "util/Timer.hpp"
+#include "util/Thread_Pool.hpp"
 #include "core/Work.hpp"
+#include "core/Cost_Model.hpp"
+#include "core/Blo_Pruner.hpp"
 #include "pipeline/schedule.hpp"
 #include "core/Lookup_Store.hpp"
+#include "core/lookup_util.hpp"
 #include "pipeline/Pipeline.hpp"
 #include "seq/MSA.hpp"
+#include "seq/Encoded_MSA.hpp"
 #include "core/Work.hpp"
 #include "sample/Sample.hpp"
+#include "sample/Candidates.hpp"
+#include "sample/Prescores.hpp"
+#include "sample/Result_Table.hpp"
 #include "io/Binary_Fasta.hpp"
+#include "io/Query_Source.hpp"
 
 #ifdef __MPI
 #include "net/epa_mpi_util.hpp"
 #endif
 
+/**
+ * Merges the per-thread candidates of every query and applies the final selection.
+ */
 template <class T>
-static void place(const Work& to_place,
-                  MSA& msa,
-                  Tree& reference_tree,
-                  const std::vector<pll_unode_t *>& branches,
-                  Sample<T>& sample,
-                  bool do_blo,
-                  const Options& options,
-                  std::shared_ptr<Lookup_Store>& lookup_store,
-                  const size_t seq_id_offset=0)
+static void select_candidates(std::vector<std::vector<Candidates<T>>>& candidate_parts,
+                              const Encoded_MSA& msa,
+                              Sample<T>& sample,
+                              const Candidate_Filter& filter,
+                              const size_t seq_id_offset)
+{
+  const auto num_queries = msa.size();
+  std::vector<std::vector<T>> selected(num_queries);
+
+#ifdef __OMP
+  #pragma omp parallel for schedule(dynamic)
+#endif
+  for (size_t seq_id = 0; seq_id < num_queries; ++seq_id) {
+    auto& candidates = candidate_parts[0][seq_id];
+    for (size_t t = 1; t < candidate_parts.size(); ++t) {
+      candidates.merge(std::move(candidate_parts[t][seq_id]), filter);
+    }
+    selected[seq_id] = candidates.select(filter);
+  }
+
+  size_t num_kept = 0;
+  for (size_t seq_id = 0; seq_id < num_queries; ++seq_id) {
+    sample.emplace_back(seq_id_offset + seq_id);
+    sample.back().data() = std::move(selected[seq_id]);
+    num_kept += sample.back().size();
+  }
+  LOG_DBG << "Candidates kept: " << num_kept << " of " << num_queries * filter.num_placements;
+}
+
+static void log_blo_stats(const std::vector<Blo_Stats>& worker_stats)
+{
+  Blo_Stats stats;
+  for (const auto& s : worker_stats) {
+    stats += s;
+  }
+  if (not stats.optimized and not stats.reused) {
+    return;
+  }
+
+  LOG_DBG << "BLO: " << stats.optimized << " placements optimized, " << stats.reused
+          << " taken over from identical queries, "
+          << (stats.optimized ? static_cast<double>(stats.iterations) / stats.optimized : 0.0)
+          << " iterations per placement (max. " << stats.max_iterations << ")";
+}
+
+static void log_tree_cache_stats(const std::vector<Tiny_Tree_Cache>& tree_caches)
 {
+  size_t hits = 0;
+  size_t misses = 0;
+  for (const auto& cache : tree_caches) {
+    hits += cache.hits();
+    misses += cache.misses();
+  }
+  const auto total = hits + misses;
+
+  LOG_DBG << "Tiny_Tree cache: " << hits << " hits, " << misses << " misses ("
+          << (total ? 100.0 * hits / total : 0.0) << "% hit rate)";
+}
+
+/**
+ * Queries are read as they are, without being aligned against the reference: everything
+ * downstream reads <sites> states per query, so a chunk of a different width is an error.
+ */
+static void check_chunk_width(const Encoded_MSA& chunk,
+                              const size_t sites,
+                              const std::string& query_file)
+{
+  if (chunk.size() and chunk.num_sites() != sites) {
+    throw std::runtime_error{std::string("Query sequences in ") + query_file + " have "
+      + std::to_string(chunk.num_sites()) + " sites, but the reference alignment has "
+      + std::to_string(sites) + ". Are the queries aligned against the reference?"};
+  }
+}
 
+/**
+ * Number of threads to place with: as requested, or as many as OpenMP would use. Also
+ * applies it to the remaining OpenMP regions.
+ */
+static size_t init_threads(const Options& options)
+{
 #ifdef __OMP
-  const unsigned int num_threads  = options.num_threads
-                                  ? options.num_threads
-                                  : omp_get_max_threads();
+  const size_t num_threads  = options.num_threads
+                            ? options.num_threads
+                            : omp_get_max_threads();
   omp_set_num_threads(num_threads);
   LOG_DBG << "Using threads: " << num_threads;
-  LOG_DBG << "Max threads: " << omp_get_max_threads();
-  const unsigned int multiplicity = 8;
+  return num_threads;
 #else
-  const unsigned int num_threads = 1;
-  const unsigned int multiplicity = 1;
+  (void) options;
+  return 1;
 #endif
+}
 
-  // split the sample structure such that the parts are thread-local
-  std::vector<Sample<T>> sample_parts(num_threads);
+/**
+ * A placement whose tasks were queued on the Thread_Pool by launch_place, and whose
+ * results finish_place collects. In between, the caller may queue and wait for other
+ * work on the same pool, which then also runs the tasks of this one.
+ *
+ * Everything passed to launch_place has to outlive the pending placement.
+ */
+template <class T>
+struct Pending_Place
+{
+  explicit Pending_Place(Thread_Pool& pool) : group(pool) { }
+  ~Pending_Place()
+  {
+    // the tasks refer to this, so they must be done even if finish_place never ran
+    try {
+      group.wait();
+    } catch (...) { }
+  }
 
+  const Encoded_MSA * msa = nullptr;
+  const Candidate_Filter * filter = nullptr;
   std::vector<Work> work_parts;
-  split(to_place, work_parts, num_threads
-                              * multiplicity);
+  std::vector<double> predicted;
+  std::vector<double> measured;
+  std::vector<Blo_Stats> blo_stats;
+  // with a filter, only the candidates passing it are kept (per worker and query)
+  std::vector<std::vector<Candidates<T>>> candidate_parts;
+  // without a filter, every pair has its own slot in the results
+  std::unique_ptr<Result_Table<T>> results;
+  Task_Group group;
+};
 
-  // work seperately
-#ifdef __OMP
-  #pragma omp parallel for schedule(dynamic)
-#endif
-  for (size_t i = 0; i < work_parts.size(); ++i) {
-    auto prev_branch_id = std::numeric_limits<size_t>::max();
+template <class T>
+static std::unique_ptr<Pending_Place<T>> launch_place(const Work& to_place,
+                                                      const Encoded_MSA& msa,
+                                                      Tree& reference_tree,
+                                                      const std::vector<pll_unode_t *>& branches,
+                                                      bool do_blo,
+                                                      const Options& options,
+                                                      std::shared_ptr<Lookup_Store>& lookup_store,
+                                                      Thread_Pool& pool,
+                                                      std::vector<Tiny_Tree_Cache>& tree_caches,
+                                                      const Candidate_Filter * filter=nullptr,
+                                                      const Prescores * prior=nullptr)
+{
+  std::unique_ptr<Pending_Place<T>> pending(new Pending_Place<T>(pool));
+  auto& state = *pending;
 
-#ifdef __OMP
-    const auto tid = omp_get_thread_num();
-#else
-    const auto tid = 0;
-#endif
+  const size_t num_workers = pool.size();
+  // parts per worker, to leave something to steal
+  const size_t multiplicity = (num_workers > 1) ? 8 : 1;
+
+  state.msa = &msa;
+  state.filter = filter;
+  if (filter) {
+    state.candidate_parts.assign(num_workers, std::vector<Candidates<T>>(msa.size()));
+  }
+
+  // split into parts of similar predicted cost, keeping the pairs of a branch together
+  const auto partition = reference_tree.partition();
+  std::vector<bool> tip_branch(branches.size());
+  for (size_t i = 0; i < branches.size(); ++i) {
+    tip_branch[i] = not branches[i]->next or not branches[i]->back->next;
+  }
+  double query_sites = partition->sites;
+  if (not do_blo and msa.has_ranges() and lookup_store->ranged() and msa.size()) {
+    query_sites = 0.0;
+    for (size_t i = 0; i < msa.size(); ++i) {
+      query_sites += msa.range(i).second - msa.range(i).first;
+    }
+    query_sites /= msa.size();
+  }
+  const Cost_Model cost_model(std::move(tip_branch),
+                              partition->sites,
+                              query_sites,
+                              partition->states,
+                              partition->rate_cats,
+                              lookup_store->char_map_size(),
+                              do_blo,
+                              lookup_store->complete());
+
+  state.predicted = split(to_place,
+                          state.work_parts,
+                          num_workers * multiplicity,
+                          cost_model);
+  state.measured.assign(state.work_parts.size(), 0.0);
+  state.blo_stats.assign(num_workers, Blo_Stats());
+
+  if (not filter) {
+    state.results.reset(new Result_Table<T>(state.work_parts, msa.size()));
+  }
+
+  auto place_part = [&state, &msa, &reference_tree, &branches, do_blo, &options,
+                     &lookup_store, &tree_caches, filter, prior](const size_t i,
+                                                                 const size_t tid) {
+    Timer<> part_timer;
+    part_timer.start();
+
+    // consecutive parts go to the same worker, whose cache holds the Tiny_Trees of the
+    // branches it worked on last, in this chunk and the previous ones
+    auto& cache = tree_caches[tid];
     std::shared_ptr<Tiny_Tree> branch(nullptr);
+    auto prev_branch_id = std::numeric_limits<size_t>::max();
 
-    for (const auto& it : work_parts[i]) {
+    // all queries of a branch are placed as one block: without BLO, such that the
+    // branch's lookup table stays in cache while they consume it, with BLO, such that
+    // they share the reference partial of the Tiny_Tree
+    std::vector<size_t> block_ids;
+    std::vector<size_t> block_pairs;
+    std::vector<const unsigned char *> block_seqs;
+    std::vector<Encoded_MSA::range_type> block_ranges;
+    std::vector<double> block_gaps;
+
+    auto place_block = [&]() {
+      if (block_ids.empty()) {
+        return;
+      }
+      auto placements = branch->place(block_seqs, block_ranges, block_gaps);
+      if (do_blo) {
+        state.blo_stats[tid] += branch->take_blo_stats();
+      }
+      for (size_t k = 0; k < block_ids.size(); ++k) {
+        if (filter) {
+          state.candidate_parts[tid][block_ids[k]].add(T(placements[k]), *filter);
+        } else {
+          state.results->at(i, block_pairs[k], block_ids[k]) = T(placements[k]);
+        }
+      }
+      block_ids.clear();
+      block_pairs.clear();
+      block_seqs.clear();
+      block_ranges.clear();
+      block_gaps.clear();
+    };
+
+    size_t pair = 0;
+    for (const auto& it : state.work_parts[i]) {
       const auto branch_id = it.branch_id;
       const auto seq_id = it.sequence_id;
-      const auto seq = msa[seq_id];
 
       if ((branch_id != prev_branch_id) or not branch) {
-        branch = std::make_shared<Tiny_Tree>(branches[branch_id],
-                                             branch_id,
-                                             reference_tree,
-                                             do_blo,
-                                             options,
-                                             lookup_store);
+        place_block();
+        branch = cache.get( branches[branch_id],
+                            branch_id,
+                            reference_tree,
+                            do_blo,
+                            options,
+                            lookup_store);
+        prev_branch_id = branch_id;
+      }
+
+      block_ids.push_back(seq_id);
+      block_pairs.push_back(pair++);
+      block_seqs.push_back(msa[seq_id]);
+      if (msa.has_ranges() and (do_blo or lookup_store->ranged())) {
+        block_ranges.push_back(msa.range(seq_id));
       }
+      if (do_blo and prior) {
+        block_gaps.push_back(prior->gap(seq_id, branch_id));
+      }
+    }
+    place_block();
+
+    part_timer.stop();
+    state.measured[i] = part_timer.sum();
+  };
+
+  for (size_t i = 0; i < state.work_parts.size(); ++i) {
+    state.group.run(place_part, i * num_workers / state.work_parts.size());
+  }
+
+  return pending;
+}
+
+// waits for a pending placement and adds its results to <sample>
+template <class T>
+static void finish_place( Pending_Place<T>& pending,
+                          Sample<T>& sample,
+                          const size_t seq_id_offset=0)
+{
+  pending.group.wait();
+  log_prediction(pending.predicted, pending.measured);
+  log_blo_stats(pending.blo_stats);
+
+  if (pending.filter) {
+    select_candidates(pending.candidate_parts, *pending.msa, sample, *pending.filter,
+                      seq_id_offset);
+    return;
+  }
 
-      sample_parts[tid].add_placement(seq_id_offset + seq_id,
-                                      seq.header(),
-                                      branch->place(seq));
+  pending.results->flush(sample, seq_id_offset);
+}
+
+template <class T>
+static void place(const Work& to_place,
+                  const Encoded_MSA& msa,
+                  Tree& reference_tree,
+                  const std::vector<pll_unode_t *>& branches,
+                  Sample<T>& sample,
+                  bool do_blo,
+                  const Options& options,
+                  std::shared_ptr<Lookup_Store>& lookup_store,
+                  Thread_Pool& pool,
+                  std::vector<Tiny_Tree_Cache>& tree_caches,
+                  const size_t seq_id_offset=0,
+                  const Candidate_Filter * filter=nullptr,
+                  const Prescores * prior=nullptr)
+{
+  auto pending = launch_place<T>( to_place,
+                                  msa,
+                                  reference_tree,
+                                  branches,
+                                  do_blo,
+                                  options,
+                                  lookup_store,
+                                  pool,
+                                  tree_caches,
+                                  filter,
+                                  prior);
+  finish_place(*pending, sample, seq_id_offset);
+}
 
-      prev_branch_id = branch_id;
+/**
+ * Repeats the preplacement of a chunk using double precision lookup tables and
+ * reports how far the reduced precision results deviate from it.
+ */
+template <class T>
+static void validate_precision( const Work& to_place,
+                                const Encoded_MSA& msa,
+                                Tree& reference_tree,
+                                const std::vector<pll_unode_t *>& branches,
+                                const Sample<T>& reduced_sample,
+                                const Options& options,
+                                std::shared_ptr<Lookup_Store>& reference_lookups,
+                                Thread_Pool& pool,
+                                std::vector<Tiny_Tree_Cache>& tree_caches)
+{
+  Sample<Placement> reference;
+  place(to_place,
+        msa,
+        reference_tree,
+        branches,
+        reference,
+        false,
+        options,
+        reference_lookups,
+        pool,
+        tree_caches);
+
+  Sample<Placement> reduced(reduced_sample);
+  compute_and_set_lwr(reference);
+  compute_and_set_lwr(reduced);
+
+  std::map<std::pair<size_t, unsigned int>, const Placement *> by_key;
+  for (const auto& pq : reference) {
+    for (const auto& p : pq) {
+      by_key[std::make_pair(pq.sequence_id(), p.branch_id())] = &p;
+    }
+  }
+
+  double max_lwr_diff = 0.0;
+  double max_logl_diff = 0.0;
+  for (const auto& pq : reduced) {
+    for (const auto& p : pq) {
+      const auto ref = by_key.find(std::make_pair(pq.sequence_id(), p.branch_id()));
+      if (ref == by_key.end()) {
+        throw std::runtime_error{"Placement missing from double precision reference!"};
+      }
+      max_lwr_diff = std::max(max_lwr_diff, std::abs(ref->second->lwr() - p.lwr()));
+      max_logl_diff = std::max(max_logl_diff,
+                               std::abs(ref->second->likelihood() - p.likelihood()));
     }
   }
-  // merge samples back
-  merge(sample, std::move(sample_parts));
-  collapse(sample);
+
+  LOG_INFO << "Lookup precision validation: max. LWR deviation: " << max_lwr_diff
+           << ", max. logl deviation: " << max_logl_diff;
+}
+
+/**
+ * Finishes the thorough placement of <pending>, launched by launch_place with BLO for
+ * the candidates left by <pruner>, if any. Those it pruned that could change the output
+ * (exact mode) are then placed after all, and it calibrates on the result.
+ */
+static void finish_thorough(Pending_Place<Placement>& pending,
+                            const Encoded_MSA& msa,
+                            Tree& reference_tree,
+                            const std::vector<pll_unode_t *>& branches,
+                            Sample<Placement>& sample,
+                            const Options& options,
+                            std::shared_ptr<Lookup_Store>& lookup_store,
+                            Thread_Pool& pool,
+                            std::vector<Tiny_Tree_Cache>& tree_caches,
+                            const size_t seq_id_offset,
+                            const Prescores * prior,
+                            Blo_Pruner * pruner)
+{
+  finish_place(pending, sample, seq_id_offset);
+
+  if (not prior or not pruner) {
+    return;
+  }
+
+  const auto recover = pruner->verify(sample, seq_id_offset);
+  if (not recover.empty()) {
+    LOG_DBG << "Optimizing " << recover.size() << " pruned candidates after all.";
+    // their placements join the PQuerys of <sample>
+    place(recover,
+          msa,
+          reference_tree,
+          branches,
+          sample,
+          true,
+          options,
+          lookup_store,
+          pool,
+          tree_caches,
+          seq_id_offset,
+          nullptr,
+          prior);
+  }
+
+  pruner->calibrate(sample, *prior, seq_id_offset);
+}
+
+// thorough placement of <to_place> in one go, see finish_thorough
+static void place_thorough( const Work& to_place,
+                            const Encoded_MSA& msa,
+                            Tree& reference_tree,
+                            const std::vector<pll_unode_t *>& branches,
+                            Sample<Placement>& sample,
+                            const Options& options,
+                            std::shared_ptr<Lookup_Store>& lookup_store,
+                            Thread_Pool& pool,
+                            std::vector<Tiny_Tree_Cache>& tree_caches,
+                            const size_t seq_id_offset,
+                            const Prescores * prior,
+                            Blo_Pruner * pruner)
+{
+  auto pending = launch_place<Placement>( to_place,
+                                          msa,
+                                          reference_tree,
+                                          branches,
+                                          true,
+                                          options,
+                                          lookup_store,
+                                          pool,
+                                          tree_caches,
+                                          nullptr,
+                                          prior);
+  finish_thorough(*pending,
+                  msa,
+                  reference_tree,
+                  branches,
+                  sample,
+                  options,
+                  lookup_store,
+                  pool,
+                  tree_caches,
+                  seq_id_offset,
+                  prior,
+                  pruner);
 }
 
 void pipeline_place(Tree& reference_tree,
@@ -136,12 +539,47 @@ void pipeline_place(Tree& reference_tree,
   unsigned int chunk_num = 0;
   
   auto lookups = 
-    std::make_shared<Lookup_Store>(num_branches, reference_tree.partition()->states);
+    std::make_shared<Lookup_Store>(num_branches,
+                                   reference_tree.partition()->states,
+                                   options.precision);
+
+  // double precision tables to compare against, if requested
+  auto reference_lookups = (options.validate_precision
+                            and options.precision != lookup_precision::DOUBLE)
+    ? std::make_shared<Lookup_Store>(num_branches, reference_tree.partition()->states)
+    : std::shared_ptr<Lookup_Store>(nullptr);
+
+  if (options.prescoring) {
+    prepare_lookups(lookups, reference_tree, branches, options);
+  }
+
+  // workers for the whole run, each with its own cache of Tiny_Trees
+  Thread_Pool pool(init_threads(options));
+  std::vector<Tiny_Tree_Cache> tree_caches;
+  for (size_t i = 0; i < pool.size(); ++i) {
+    tree_caches.emplace_back(options.tree_cache_size);
+  }
 
   Work all_work(std::make_pair(0, num_branches), std::make_pair(0, chunk_size));
+
+  // the candidates can only be selected during the preplacement if it sees all branches
+  // of a query, i.e. the preplacement stage is not split across ranks
+  int num_ranks = 1;
+  MPI_COMM_SIZE(MPI_COMM_WORLD, &num_ranks);
+  const bool select_during_preplacement = (num_ranks == 1) and not reference_lookups;
+  const Candidate_Filter candidate_filter(options, num_branches);
+  // handed from the candidate selection to the thorough placement of the same chunk,
+  // which only happen on the same rank without MPI
+  Prescores prescores;
+  const bool use_prescores = (num_ranks == 1) and options.prescoring;
+  Blo_Pruner pruner(options);
+  if (use_prescores and options.pruning == blo_pruning::EXACT) {
+    pruner.logl_bounds(build_logl_bounds(reference_tree, branches, options));
+  }
   
-  MSA chunk;
-  Binary_Fasta_Reader reader(query_file);
+  Encoded_MSA chunk;
+  auto reader = make_query_source(query_file);
+  reader->prefetch(options.prefetch_depth, chunk_size);
 
   size_t num_sequences = 0;
 
@@ -162,7 +600,12 @@ void pipeline_place(Tree& reference_tree,
 
   auto perloop_prehook = [&]() -> void {
     LOG_DBG << "INGESTING - READING" << std::endl;
-    num_sequences = reader.read_next(chunk, chunk_size);
+    num_sequences = reader->read_next(chunk, chunk_size);
+    check_chunk_width(chunk, reference_tree.partition()->sites, query_file);
+    LOG_DBG << "Waited for the chunk: " << reader->last_wait() << "s";
+    if (options.ranged) {
+      chunk.compute_ranges(lookups->char_position('-'));
+    }
     ++chunk_num;
   };
 
@@ -191,7 +634,16 @@ void pipeline_place(Tree& reference_tree,
           result,
           false,
           options,
-          lookups);
+          lookups,
+          pool,
+          tree_caches,
+          0,
+          select_during_preplacement ? &candidate_filter : nullptr);
+
+    if (reference_lookups) {
+      validate_precision(work, chunk, reference_tree, branches, result, options,
+                         reference_lookups, pool, tree_caches);
+    }
 
     return result;
   };
@@ -227,7 +679,13 @@ void pipeline_place(Tree& reference_tree,
   auto candidate_selection = [&](Slim_Sample& slim) -> Work {
     LOG_DBG << "SELECTING CANDIDATES" << std::endl;
 
+    if (select_during_preplacement) {
+      prescores = Prescores(slim);
+      return use_prescores ? pruner.prune(Work(slim), prescores, &chunk) : Work(slim);
+    }
+
     Sample sample(slim);
+    prescores = Prescores(sample);
 
     compute_and_set_lwr(sample);
 
@@ -241,23 +699,29 @@ void pipeline_place(Tree& reference_tree,
                                       options.filter_max);
     }
 
-    return Work(sample);
+    return use_prescores ? pruner.prune(Work(sample), prescores, &chunk) : Work(sample);
   };
 
 
+  // unlike simple_mpi, this does not overlap with the next preplacement: the Pipeline
+  // runs the stages of one token after the other, and with MPI they may not even share
+  // a rank, so a stage has to be done before it hands its result on
   auto thorough_placement = [&](Work& work) -> Sample {
     LOG_DBG << "BLO PLACEMENT" << std::endl;
 
     Sample result;
-    place(work,
-          chunk,
-          reference_tree,
-          branches,
-          result,
-          true,
-          options,
-          lookups
-    );
+    place_thorough( work,
+                    chunk,
+                    reference_tree,
+                    branches,
+                    result,
+                    options,
+                    lookups,
+                    pool,
+                    tree_caches,
+                    0,
+                    use_prescores ? &prescores : nullptr,
+                    &pruner);
     return result;
   };
 
@@ -285,7 +749,8 @@ void pipeline_place(Tree& reference_tree,
       if (chunk_num > 1) {
         outfile << ",";
       }
-      outfile << sample_to_jplace_string(sample);
+      // ids are local to the chunk, which every rank reads
+      outfile << sample_to_jplace_string(sample, chunk.labels());
       // std::string part_file_name(outdir + "epa." + std::to_string(local_rank)
       //   + "." + std::to_string(chunk_num) + ".part");
       // std::ofstream part_file(part_file_name);
@@ -306,12 +771,15 @@ void pipeline_place(Tree& reference_tree,
     }
 
     LOG_INFO << chunk_num * chunk_size  << " Sequences done!"; 
+    log_lookup_stats(*lookups);
+    log_tree_cache_stats(tree_caches);
 
     return VoidToken();
   };
 
   // only on one rank, only once at the end of the pipeline
   auto finalize_pipe_func = [&]() -> void {
+    pruner.log_stats();
     LOG_INFO << "Output file: " << outdir + "epa_result.jplace";
     outfile << finalize_jplace_string(invocation);
     outfile.close();
@@ -361,7 +829,26 @@ void simple_mpi(Tree& reference_tree,
   }
 
   auto lookups = 
-    std::make_shared<Lookup_Store>(num_branches, reference_tree.partition()->states);
+    std::make_shared<Lookup_Store>(num_branches,
+                                   reference_tree.partition()->states,
+                                   options.precision);
+
+  // double precision tables to compare against, if requested
+  auto reference_lookups = (options.validate_precision
+                            and options.precision != lookup_precision::DOUBLE)
+    ? std::make_shared<Lookup_Store>(num_branches, reference_tree.partition()->states)
+    : std::shared_ptr<Lookup_Store>(nullptr);
+
+  if (options.prescoring) {
+    prepare_lookups(lookups, reference_tree, branches, options);
+  }
+
+  // workers for the whole run, each with its own cache of Tiny_Trees
+  Thread_Pool pool(init_threads(options));
+  std::vector<Tiny_Tree_Cache> tree_caches;
+  for (size_t i = 0; i < pool.size(); ++i) {
+    tree_caches.emplace_back(options.tree_cache_size);
+  }
 
   // some MPI prep
   int local_rank = 0;
@@ -377,88 +864,81 @@ void simple_mpi(Tree& reference_tree,
     all_ranks[i] = i;
   }
 
-  Binary_Fasta_Reader reader(query_file);
+  std::unique_ptr<Query_Source> reader;
+  size_t local_rank_seq_offset = 0;
+  if (num_ranks > 1) {
+    // splitting the queries across ranks needs the random access of a bfast file
+    std::unique_ptr<Binary_Fasta_Reader> bfast_reader(new Binary_Fasta_Reader(query_file));
+
+    // how many should each rank read?
+    const size_t part_size = ceil(bfast_reader->num_sequences() / static_cast<double>(num_ranks));
+    LOG_INFO << "Number of sequences per rank: " << part_size;
 
-  // how many should each rank read?
-  const size_t part_size = ceil(reader.num_sequences() / static_cast<double>(num_ranks));
-  LOG_INFO << "Number of sequences per rank: " << part_size;
+    // read only the locally relevant part of the queries
+    // ... by skipping the appropriate amount
+    local_rank_seq_offset = part_size * local_rank;
+    bfast_reader->skip_to_sequence( local_rank_seq_offset );
+    // and limiting the reading to the given window
+    bfast_reader->constrain(part_size);
 
-  // read only the locally relevant part of the queries
-  // ... by skipping the appropriate amount
-  const size_t local_rank_seq_offset = part_size * local_rank;
-  reader.skip_to_sequence( local_rank_seq_offset );
-  // and limiting the reading to the given window
-  reader.constrain(part_size);
+    reader = std::move(bfast_reader);
+  } else {
+    reader = make_query_source(query_file);
+  }
+  // then reading ahead in the background
+  reader->prefetch(options.prefetch_depth, options.chunk_size);
 
   size_t num_sequences = options.chunk_size;
   Work all_work(std::make_pair(0, num_branches), std::make_pair(0, num_sequences));
   Work blo_work;
+  const Candidate_Filter candidate_filter(options, num_branches);
+  Prescores prescores;
+  Blo_Pruner pruner(options);
+  if (options.prescoring and options.pruning == blo_pruning::EXACT) {
+    pruner.logl_bounds(build_logl_bounds(reference_tree, branches, options));
+  }
 
   size_t chunk_num = 1;
 
   using Sample = Sample<Placement>;
   Sample result;
-  MSA chunk;
-  size_t sequences_done = 0; // not just for info output!
-  while ( (num_sequences = reader.read_next(chunk, options.chunk_size) ) ) {
-
-    assert(chunk.size() == num_sequences);
-
-    LOG_DBG << "num_sequences: " << num_sequences << std::endl;
-
-    const size_t seq_id_offset = sequences_done + local_rank_seq_offset;
-
-    if (num_sequences < options.chunk_size) {
-      all_work = Work(std::make_pair(0, num_branches), std::make_pair(0, num_sequences));
-    }
-
-    if (options.prescoring) {
-
-      Sample preplace;
-
-      LOG_DBG << "Preplacement." << std::endl;
-      place(all_work,
-            chunk,
-            reference_tree,
-            branches,
-            preplace,
-            false,
-            options,
-            lookups);
-
-      // Candidate Selection
-      LOG_DBG << "Selecting candidates." << std::endl;
-      compute_and_set_lwr(preplace);
-
-      if (options.prescoring_by_percentage) {
-        discard_bottom_x_percent(preplace, 
-                                (1.0 - options.prescoring_threshold));
-      } else {
-        discard_by_accumulated_threshold( preplace, 
-                                          options.prescoring_threshold,
-                                          options.filter_min,
-                                          options.filter_max);
-      }
-
-      blo_work = Work(preplace);
-
-    } else {
-      blo_work = all_work;
+  // labels of the local queries, by global sequence id
+  Label_Store labels;
+  Encoded_MSA chunk;
+  size_t sequences_read = 0;
+  size_t sequences_done = 0;
+
+  /*
+    The thorough placement of a chunk is launched on the pool and left running while the
+    next chunk is read and preplaced, such that workers done with their BLO tasks move on
+    to the preplacement instead of idling at the end of the stage. It is finished (pruned
+    candidates recovered, pruner calibrated, results filtered) before the candidates of
+    the next chunk are selected, so the pruning sees the same state as when the chunks
+    are placed one after the other.
+  */
+  Encoded_MSA blo_chunk;
+  size_t blo_seq_id_offset = 0;
+  std::unique_ptr<Pending_Place<Placement>> pending_blo;
+
+  auto finish_blo = [&]() {
+    if (not pending_blo) {
+      return;
     }
 
     Sample blo_sample;
-
-    // BLO placement
-    LOG_DBG << "BLO Placement." << std::endl;
-    place(blo_work,
-          chunk,
-          reference_tree,
-          branches,
-          blo_sample,
-          true,
-          options,
-          lookups,
-          seq_id_offset);
+    finish_thorough(*pending_blo,
+                    blo_chunk,
+                    reference_tree,
+                    branches,
+                    blo_sample,
+                    options,
+                    lookups,
+                    pool,
+                    tree_caches,
+                    blo_seq_id_offset,
+                    options.prescoring ? &prescores : nullptr,
+                    &pruner);
+    pending_blo.reset();
 
     // Output
     compute_and_set_lwr(blo_sample);
@@ -478,16 +958,120 @@ void simple_mpi(Tree& reference_tree,
 
     merge(result, std::move(blo_sample));
 
-    sequences_done += num_sequences;
+    sequences_done += blo_chunk.size();
     LOG_INFO << sequences_done  << " Sequences done!";
+    log_lookup_stats(*lookups);
+    log_tree_cache_stats(tree_caches);
     ++chunk_num;
+  };
+
+  while ( (num_sequences = reader->read_next(chunk, options.chunk_size) ) ) {
+
+    assert(chunk.size() == num_sequences);
+    check_chunk_width(chunk, reference_tree.partition()->sites, query_file);
+    LOG_DBG << "Waited for the chunk: " << reader->last_wait() << "s";
+
+    if (options.ranged) {
+      chunk.compute_ranges(lookups->char_position('-'));
+    }
+
+    LOG_DBG << "num_sequences: " << num_sequences << std::endl;
+
+    const size_t seq_id_offset = sequences_read + local_rank_seq_offset;
+    sequences_read += num_sequences;
+    labels.append(chunk.labels(), seq_id_offset);
+
+    if (num_sequences < options.chunk_size) {
+      all_work = Work(std::make_pair(0, num_branches), std::make_pair(0, num_sequences));
+    }
+
+    Sample preplace;
+    if (options.prescoring) {
+
+      if (not reference_lookups) {
+        // candidate selection during the preplacement, keeping only what may pass
+        LOG_DBG << "Preplacement and candidate selection." << std::endl;
+        place(all_work,
+              chunk,
+              reference_tree,
+              branches,
+              preplace,
+              false,
+              options,
+              lookups,
+              pool,
+              tree_caches,
+              0,
+              &candidate_filter);
+      } else {
+        LOG_DBG << "Preplacement." << std::endl;
+        place(all_work,
+              chunk,
+              reference_tree,
+              branches,
+              preplace,
+              false,
+              options,
+              lookups,
+              pool,
+              tree_caches);
+
+        validate_precision(all_work, chunk, reference_tree, branches, preplace, options,
+                           reference_lookups, pool, tree_caches);
+
+        // Candidate Selection
+        LOG_DBG << "Selecting candidates." << std::endl;
+        compute_and_set_lwr(preplace);
+
+        if (options.prescoring_by_percentage) {
+          discard_bottom_x_percent(preplace, 
+                                  (1.0 - options.prescoring_threshold));
+        } else {
+          discard_by_accumulated_threshold( preplace, 
+                                            options.prescoring_threshold,
+                                            options.filter_min,
+                                            options.filter_max);
+        }
+      }
+    }
+
+    // the previous chunk has to be done before its prescores and the pruner move on
+    finish_blo();
+
+    if (options.prescoring) {
+      prescores = Prescores(preplace);
+      blo_work = pruner.prune(Work(preplace), prescores, &chunk);
+    } else {
+      blo_work = all_work;
+    }
+
+    // BLO placement, running on while the next chunk is preplaced. The buffer of the
+    // finished chunk is handed back to the reader by the next read
+    LOG_DBG << "BLO Placement." << std::endl;
+    std::swap(chunk, blo_chunk);
+    blo_seq_id_offset = seq_id_offset;
+    pending_blo = launch_place<Placement>(blo_work,
+                                          blo_chunk,
+                                          reference_tree,
+                                          branches,
+                                          true,
+                                          options,
+                                          lookups,
+                                          pool,
+                                          tree_caches,
+                                          nullptr,
+                                          options.prescoring ? &prescores : nullptr);
   }
+  finish_blo();
+  pruner.log_stats();
+  LOG_DBG << "Waited for input: " << reader->total_wait() << "s";
 
 #ifdef __MPI
   // send to output: on rank <designated_writer> 
   LOG_DBG << "Gathering results on Rank " << 0;
   Timer<> dummy;
   epa_mpi_gather(result, 0, all_ranks, local_rank, dummy);
+  epa_mpi_gather(labels, 0, all_ranks, local_rank, dummy);
 #endif //__MPI
 
   if (local_rank == 0) {
@@ -497,7 +1081,7 @@ void simple_mpi(Tree& reference_tree,
     outfile.open(outdir + "epa_result.jplace");
     outfile << init_jplace_string(
       get_numbered_newick_string(reference_tree.tree()));
-    outfile << sample_to_jplace_string(result);
+    outfile << sample_to_jplace_string(result, labels);
     outfile << finalize_jplace_string(invocation);
     outfile.close();
   }
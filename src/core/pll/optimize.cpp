@@ -78,12 +78,14 @@ static void utree_derivative_func ( void * parameters,
  * @param  partition  the partition
  * @param  tree       the tree structure
  * @param  smoothings maximum number of iterations
+ * @param  workspace  provides the sumtable
  * @return            negative log likelihood after optimization
  */
 static double opt_branch_lengths_pplacer( pll_partition_t * partition, 
                                           pll_unode_t * inner, 
                                           unsigned int smoothings, 
-                                          const double tolerance)
+                                          const double tolerance,
+                                          Blo_Workspace& workspace)
 {
   double loglikelihood = 0.0, new_loglikelihood;
   double xmin,    /* min branch length */
@@ -91,7 +93,7 @@ static double opt_branch_lengths_pplacer( pll_partition_t * partition,
          xmax,    /* max branch length */
          xtol,    /* tolerance */
          xres;    /* optimal found branch length */
-  std::vector<unsigned int> param_indices(partition->rate_cats, 0);
+  const auto param_indices = workspace.param_indices();
 
   const auto score_node   = inner;
   const auto blo_node     = inner->next->back;
@@ -139,7 +141,7 @@ static double opt_branch_lengths_pplacer( pll_partition_t * partition,
   // nr_params.branch_length_min = PLLMOD_OPT_MIN_BRANCH_LEN;
   // nr_params.branch_length_max = PLLMOD_OPT_MAX_BRANCH_LEN;
   // nr_params.tolerance         = tolerance;
-  nr_params.sumtable          = nullptr;
+  nr_params.sumtable          = workspace.sumtable();
 
   /* get the initial likelihood score */
   loglikelihood = -pll_compute_edge_loglikelihood (partition,
@@ -151,23 +153,9 @@ static double opt_branch_lengths_pplacer( pll_partition_t * partition,
                                                   &param_indices[0],
                                                   nullptr);
 
-  /* allocate the sumtable */
-  auto sites_alloc = partition->sites;
-  if (partition->attributes & PLL_ATTRIB_AB_FLAG) {
-    sites_alloc += partition->states;
-  }
-
-  if ((nr_params.sumtable = static_cast<double *> (
-      pll_aligned_alloc(sites_alloc 
-                        * partition->rate_cats
-                        * partition->states_padded 
-                        * sizeof(double), 
-                        partition->alignment))) 
-        == nullptr) {
-    throw std::runtime_error{"Cannot allocate memory for bl opt variables"};
-  }
-
+  size_t iterations = 0;
   while (smoothings) {
+    ++iterations;
     auto old_blonode_length = blo_node->length;
     auto old_pendant_length = score_node->length;
 
@@ -289,50 +277,81 @@ static double opt_branch_lengths_pplacer( pll_partition_t * partition,
 
   }
 
-  /* deallocate sumtable */
-  pll_aligned_free(nr_params.sumtable);
-
+  workspace.iterations(iterations);
   return loglikelihood;
 }
 
+Blo_Workspace::Blo_Workspace(pll_partition_t const * const partition)
+  : sumtable_(nullptr, pll_aligned_free)
+  , param_indices_(partition->rate_cats, 0)
+{
+  auto sites_alloc = partition->sites;
+  if (partition->attributes & PLL_ATTRIB_AB_FLAG) {
+    sites_alloc += partition->states;
+  }
+
+  sumtable_.reset(static_cast<double *>(pll_aligned_alloc(sites_alloc
+                                                          * partition->rate_cats
+                                                          * partition->states_padded
+                                                          * sizeof(double),
+                                                          partition->alignment)));
+  if (not sumtable_) {
+    throw std::runtime_error{"Cannot allocate memory for bl opt variables"};
+  }
+}
+
 double optimize_branch_triplet( pll_partition_t * partition, 
                                 pll_unode_t * root, 
-                                const bool sliding)
+                                const bool sliding,
+                                Blo_Workspace * workspace,
+                                const bool partials_ready,
+                                const double tolerance)
 {
   if (!root->next) {
     root = root->back;
   }
 
-  std::vector<pll_unode_t*> travbuffer(4);
-  std::vector<double> branch_lengths(3);
-  std::vector<unsigned int> matrix_indices(3);
-  std::vector<pll_operation_t> operations(4);
-
-  traverse_update_partials( root, 
-                            partition, 
-                            &travbuffer[0], 
-                            &branch_lengths[0], 
-                            &matrix_indices[0], 
-                            &operations[0]);
+  if (workspace) {
+    workspace->iterations(0);
+  }
 
-  std::vector<unsigned int> param_indices(partition->rate_cats, 0);
+  if (not partials_ready) {
+    std::vector<pll_unode_t*> travbuffer(4);
+    std::vector<double> branch_lengths(3);
+    std::vector<unsigned int> matrix_indices(3);
+    std::vector<pll_operation_t> operations(4);
+
+    traverse_update_partials( root, 
+                              partition, 
+                              &travbuffer[0], 
+                              &branch_lengths[0], 
+                              &matrix_indices[0], 
+                              &operations[0]);
+  }
 
   auto cur_logl = -std::numeric_limits<double>::infinity();
   const int smoothings = 32;
 
   if (sliding) {
+    std::unique_ptr<Blo_Workspace> own_workspace;
+    if (not workspace) {
+      own_workspace.reset(new Blo_Workspace(partition));
+      workspace = own_workspace.get();
+    }
     cur_logl = -opt_branch_lengths_pplacer( partition, 
                                             root, 
                                             smoothings, 
-                                            OPT_BRANCH_EPSILON);
+                                            tolerance,
+                                            *workspace);
   } else {
+    std::vector<unsigned int> param_indices(partition->rate_cats, 0);
     cur_logl = -pllmod_opt_optimize_branch_lengths_local(
                                                 partition,
                                                 root,
                                                 &param_indices[0],
                                                 PLLMOD_OPT_MIN_BRANCH_LEN,
                                                 PLLMOD_OPT_MAX_BRANCH_LEN,
-                                                OPT_BRANCH_EPSILON,
+                                                tolerance,
                                                 smoothings,
                                                 1, // radius
                                                 1); // keep update
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <memory>
+#include <vector>
+
 #include "core/pll/pllhead.hpp"
 #include "core/raxml/Model.hpp"
 #include "tree/Tree_Numbers.hpp"
@@ -7,6 +10,8 @@
 constexpr double OPT_EPSILON        = 1.0;
 constexpr double OPT_PARAM_EPSILON  = 1e-4;
 constexpr double OPT_BRANCH_EPSILON = 1e-1;
+// loosest tolerance of a placement BLO, for placements of negligible weight
+constexpr double OPT_BRANCH_EPSILON_MAX = 10.0;
 constexpr double OPT_FACTR          = 1e7;
 constexpr double OPT_BRLEN_MIN      = PLLMOD_OPT_MIN_BRANCH_LEN;
 constexpr double OPT_BRLEN_MAX      = PLLMOD_OPT_MAX_BRANCH_LEN;
@@ -22,6 +27,43 @@ void optimize(raxml::Model& model,
               const bool opt_model);
 void compute_and_set_empirical_frequencies( pll_partition_t * partition, 
                                             raxml::Model& model);
+
+/**
+ * Buffers of optimize_branch_triplet that can be reused across calls on the same
+ * partition, such as when optimizing a block of queries on the same branch.
+ */
+class Blo_Workspace
+{
+public:
+  explicit Blo_Workspace(pll_partition_t const * const partition);
+  Blo_Workspace() = delete;
+  ~Blo_Workspace() = default;
+
+  Blo_Workspace(Blo_Workspace const&) = delete;
+  Blo_Workspace& operator=(Blo_Workspace const&) = delete;
+
+  double * sumtable() { return sumtable_.get(); }
+  unsigned int * param_indices() { return &param_indices_[0]; }
+
+  // smoothing iterations of the last sliding BLO run with this workspace
+  size_t iterations() const { return iterations_; }
+  void iterations(const size_t count) { iterations_ = count; }
+
+private:
+  std::unique_ptr<double, void(*)(void*)> sumtable_;
+  std::vector<unsigned int> param_indices_;
+  size_t iterations_ = 0;
+};
+
+/**
+ * Optimizes the branch lengths around <inner>, starting from their current values, until
+ * the logl improves by less than <tolerance>. With <partials_ready>, the partial of
+ * <inner> is known to be up to date with the current branch lengths and is not
+ * recomputed first (as is the case for a Tiny_Tree in its original state).
+ */
 double optimize_branch_triplet( pll_partition_t * partition, 
                                 pll_unode_t * inner, 
-                                const bool sliding);
+                                const bool sliding,
+                                Blo_Workspace * workspace=nullptr,
+                                const bool partials_ready=false,
+                                const double tolerance=OPT_BRANCH_EPSILON);
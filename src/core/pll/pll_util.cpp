@@ -297,7 +297,10 @@ void reset_triplet_lengths( pll_unode_t * toward_pendant,
   }
 }
 
-// TODO adjust when using pattern compression
+/* Restricts the partition to the sites [offset, offset + span) of its current focus
+  by moving its per-site pointers. A negative offset (and the original span) undoes
+  the shift. Not applicable with site repeats, as their per-node site ids are not
+  shifted. */
 void shift_partition_focus( pll_partition_t * partition, 
                             const int offset, 
                             const unsigned int span)
@@ -305,16 +308,17 @@ void shift_partition_focus( pll_partition_t * partition,
   const auto clv_size = static_cast<int>(partition->rate_cats * partition->states_padded);
   const auto num_tips = partition->tips;
   const auto max_index = num_tips + partition->clv_buffers;
+  const bool pattern_tip = partition->attributes & PLL_ATTRIB_PATTERN_TIP;
 
   // shift the tip chars
-  if (partition->attributes & PLL_ATTRIB_PATTERN_TIP) {
+  if (pattern_tip) {
     for (size_t i = 0; i < num_tips; i++) {
       partition->tipchars[i] += offset;
     }
   }
 
-  // shift the clvs
-  for (size_t i = 0; i < max_index; i++) {
+  // shift the clvs (in pattern tip mode, the tips have none)
+  for (size_t i = pattern_tip ? num_tips : 0; i < max_index; i++) {
     partition->clv[i] += offset * clv_size;
   }
 
@@ -48,5 +48,5 @@ pll_unode_t* get_root(pll_utree_t const * const tree);
 
 pll_utree_t* make_utree_struct(pll_unode_t * root, const unsigned int num_nodes);
 
-// deprecated
+// restricts the partition to a range of sites (see Options::ranged)
 void shift_partition_focus(pll_partition_t * partition, const int offset, const unsigned int span);
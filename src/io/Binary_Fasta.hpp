@@ -2,15 +2,23 @@
 
 #include <string>
 #include <limits>
+#include <algorithm>
 #include <memory>
+#include <iostream>
+#include <fstream>
+#include <cstring>
 
 #include "seq/MSA.hpp"
+#include "seq/Encoded_MSA.hpp"
 #include "io/encoding.hpp"
+#include "io/Binary_Fasta_Map.hpp"
+#include "io/fasta_conversion.hpp"
+#include "io/Query_Source.hpp"
 #include "util/template_magic.hpp"
 #include "util/stringify.hpp"
+#include "util/logging.hpp"
 
 #include "genesis/utils/io/serializer.hpp"
-#include "genesis/sequence/formats/fasta_input_iterator.hpp"
 
 constexpr char MAGIC[] = "BFAST\0";
 constexpr size_t MAGIC_SIZE = array_size(MAGIC);
@@ -205,59 +213,74 @@ public:
     return read_sequences(des, number);
   }
 
+  // whether the file starts like a Binary_Fasta file
+  static bool is_bfast(const std::string& file_name)
+  {
+    std::ifstream file(file_name, std::ios::binary);
+    if (not file) {
+      throw std::runtime_error{std::string("Cannot open file: ") + file_name};
+    }
+    char magic[MAGIC_SIZE];
+    file.read(magic, MAGIC_SIZE);
+    return file.gcount() == static_cast<std::streamsize>(MAGIC_SIZE)
+      and std::equal(magic, magic + MAGIC_SIZE, MAGIC);
+  }
+
+  /**
+   * Converts the fasta file to <out_dir>/<file name>.bin, using <num_threads> threads
+   * (0: all). A file name of "-" reads from stdin instead, to <out_dir>/stdin.bin.
+   */
   static std::string fasta_to_bfast( const std::string& fasta_file,
-                              std::string out_dir)
+                              std::string out_dir,
+                              const size_t num_threads = 0)
   {
+    if (fasta_file == "-") {
+      out_dir += "stdin.bin";
+      convert_fasta_stream(std::cin, out_dir);
+      return out_dir;
+    }
+
     auto parts = split_by_delimiter(fasta_file, "/");
 
     out_dir += parts.back() + ".bin";
 
-    // detect number of sequences in fasta file
-    utils::InputStream instr( std::make_unique< utils::FileInputSource >( fasta_file ));
-    auto it = sequence::FastaInputIterator( instr );
-
-    std::vector<size_t> entry_sizes;
-    while ( it ) {
-      entry_sizes.push_back(
-        it->label().size() +
-        code_().packed_size(it->sites().size())
-        );
-      ++it;
-    }
+    convert_fasta_file(fasta_file, out_dir, num_threads);
 
-    // write the header
-    utils::Serializer ser(out_dir);
-    write_header(ser, entry_sizes);
-
-    // write the data
-    utils::InputStream instr_again( std::make_unique< utils::FileInputSource >( fasta_file ));
-    auto it_again = sequence::FastaInputIterator( instr_again );
-    while ( it_again ) {
-      ser.put_string(it_again->label());
-      put_encoded(ser, it_again->sites());
-      ++it_again;
-    }
     return out_dir;
   }
 
 };
 
-class Binary_Fasta_Reader
+/**
+ * Sequential reader of a Binary_Fasta file, by chunks. The file is memory mapped (see
+ * Binary_Fasta_Map), such that labels and sequences are decoded straight from the
+ * mapping into the chunk, and skipping ahead is a matter of moving the cursor.
+ *
+ * Encoded_MSA chunks may be prefetched (see Query_Source).
+ */
+class Binary_Fasta_Reader : public Query_Source
 {
 public:
   Binary_Fasta_Reader(const std::string& file_name,
                       const size_t max_read=std::numeric_limits<size_t>::max())
-    : des_(file_name)
+    : map_(file_name)
     , cursor_(0)
     , num_read_(0)
     , max_read_(max_read)
   {
-    seq_offsets_ = read_header(des_);
+    LOG_DBG << "Four-bit decoding kernels: " << code_().kernels_name();
+  }
+
+  ~Binary_Fasta_Reader()
+  {
+    stop_prefetching_();
   }
-  ~Binary_Fasta_Reader() = default;
 
   void constrain(const size_t max_read)
   {
+    if (prefetching_()) {
+      throw std::runtime_error{"Cannot constrain the reader while prefetching."};
+    }
     max_read_ = max_read;
   }
 
@@ -266,40 +289,89 @@ public:
     if (n == 0) {
       return;
     }
-    assert(cursor_ <= n);
-
+    if (prefetching_()) {
+      throw std::runtime_error{"Cannot skip while prefetching."};
+    }
     if ( n < cursor_ ) {
       throw std::runtime_error{"Cannot skip into the past."};
     }
+    if (n > num_sequences()) {
+      throw std::runtime_error{
+        std::string("Tried to skip past the end: ")
+        + std::to_string(num_sequences())
+        + " vs. "
+        + std::to_string(n)
+      };
+    }
 
-    const size_t skip = n - cursor_;
-
-    skip_sequences(des_, seq_offsets_, skip, cursor_);
-    cursor_ += skip;
+    cursor_ = n;
   }
 
+  // reads straight into state indices, without going through the character representation
+  using Query_Source::read_next;
+
   size_t read_next(MSA& result, const size_t number)
   {
-    const auto to_read =
-      std::min(number, max_read_ - num_read_);
+    if (prefetching_()) {
+      throw std::runtime_error{"Only Encoded_MSA chunks are prefetched."};
+    }
+
+    const auto to_read = to_read_(number);
 
-    result = read_sequences(des_, to_read);
+    result.clear();
+    for (size_t i = 0; i < to_read; ++i) {
+      const auto entry = map_.entry(cursor_ + i);
+      states_.resize(entry.num_sites);
+      code_().to_states(entry.packed, entry.num_sites, states_.data());
 
-    num_read_ += result.size();
-    cursor_ += result.size();
+      std::string sequence(entry.num_sites, '-');
+      for (size_t site = 0; site < entry.num_sites; ++site) {
+        sequence[site] = NT_MAP[states_[site]];
+      }
+      result.append(std::string(entry.label, entry.label_size), sequence);
+    }
+
+    num_read_ += to_read;
+    cursor_ += to_read;
 
-    return result.size();
+    return to_read;
   }
 
   size_t num_sequences() const
   {
-    return seq_offsets_.size();
+    return map_.size();
+  }
+
+protected:
+  size_t read_chunk_(Encoded_MSA& result, const size_t number) override
+  {
+    const auto to_read = to_read_(number);
+
+    result.clear();
+    result.reserve(to_read);
+    for (size_t i = 0; i < to_read; ++i) {
+      const auto entry = map_.entry(cursor_ + i);
+      code_().to_states(entry.packed,
+                        entry.num_sites,
+                        result.append(entry.label, entry.label_size, entry.num_sites));
+    }
+
+    num_read_ += to_read;
+    cursor_ += to_read;
+
+    return to_read;
   }
 
 private:
-  utils::Deserializer des_;
-  std::vector<uint64_t> seq_offsets_;
+  // number of sequences the next read of <number> gets
+  size_t to_read_(const size_t number) const
+  {
+    return std::min({number, max_read_ - num_read_, num_sequences() - cursor_});
+  }
+
+  Binary_Fasta_Map map_;
   size_t cursor_ = 0;
   size_t num_read_ = 0;
   size_t max_read_ = std::numeric_limits<size_t>::max();
+  std::vector<unsigned char> states_;
 };
@@ -0,0 +1,75 @@
+#include "io/Binary_Fasta_Map.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "io/Binary_Fasta.hpp"
+
+Binary_Fasta_Map::Binary_Fasta_Map(const std::string& file_name)
+  : file_name_(file_name)
+  , map_(file_name)
+{
+  if ( map_.size() < MAGIC_SIZE + sizeof(uint64_t)
+    or std::memcmp(map_.data(), MAGIC, MAGIC_SIZE)) {
+    throw std::runtime_error{std::string("File is not an epa::Binary_Fasta file: ")
+      + file_name};
+  }
+
+  const auto num_sequences = get_int_(MAGIC_SIZE);
+  if (data_section_offset(num_sequences) > map_.size()) {
+    throw std::runtime_error{std::string("Binary_Fasta file is truncated: ") + file_name};
+  }
+
+  // the random access table: <<seqID><seqOffset>><...>
+  offsets_.resize(num_sequences);
+  size_t pos = MAGIC_SIZE + sizeof(uint64_t);
+  for (size_t i = 0; i < num_sequences; ++i) {
+    const auto idx = get_int_(pos);
+    if (idx >= num_sequences) {
+      throw std::runtime_error{std::string("Invalid sequence id in Binary_Fasta file: ")
+        + file_name};
+    }
+    offsets_[idx] = get_int_(pos + sizeof(uint64_t));
+    pos += 2 * sizeof(uint64_t);
+  }
+}
+
+uint64_t Binary_Fasta_Map::get_int_(const size_t pos) const
+{
+  if (pos + sizeof(uint64_t) > map_.size()) {
+    throw std::runtime_error{std::string("Binary_Fasta file is truncated: ") + file_name_};
+  }
+  // entries are not aligned
+  uint64_t value;
+  std::memcpy(&value, map_.data() + pos, sizeof(value));
+  return value;
+}
+
+Binary_Fasta_Map::Entry Binary_Fasta_Map::entry(const size_t i) const
+{
+  if (i >= size()) {
+    throw std::runtime_error{std::string("No sequence ") + std::to_string(i)
+      + " in Binary_Fasta file: " + file_name_};
+  }
+
+  // <header_length><header string><sequence_length><encoded sequence padded to next byte>
+  Entry entry;
+  size_t pos = offsets_[i];
+  entry.label_size = get_int_(pos);
+  pos += sizeof(uint64_t);
+  if (entry.label_size > map_.size() - pos) {
+    throw std::runtime_error{std::string("Binary_Fasta file is truncated: ") + file_name_};
+  }
+  entry.label = map_.data() + pos;
+
+  pos += entry.label_size;
+  entry.num_sites = get_int_(pos);
+  pos += sizeof(uint64_t);
+  entry.packed = map_.data() + pos;
+
+  if ((entry.num_sites + 1) / 2 > map_.size() - pos) {
+    throw std::runtime_error{std::string("Binary_Fasta file is truncated: ") + file_name_};
+  }
+
+  return entry;
+}
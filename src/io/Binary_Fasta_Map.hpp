@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "io/Memory_Map.hpp"
+
+/**
+ * Random access to the entries of a Binary_Fasta file through a memory mapping, by
+ * means of the offset table in its header.
+ *
+ * Labels and packed sequences are handed out as pointers into the mapping: nothing is
+ * copied until the caller decodes it into its own buffers.
+ */
+class Binary_Fasta_Map
+{
+public:
+  struct Entry
+  {
+    const char * label;
+    size_t label_size;
+    // <num_sites> characters, packed two per byte
+    const char * packed;
+    size_t num_sites;
+  };
+
+  explicit Binary_Fasta_Map(const std::string& file_name);
+  Binary_Fasta_Map() = delete;
+  ~Binary_Fasta_Map() = default;
+
+  Binary_Fasta_Map(Binary_Fasta_Map const& other) = delete;
+  Binary_Fasta_Map& operator= (Binary_Fasta_Map const& other) = delete;
+
+  size_t size() const { return offsets_.size(); }
+
+  // entry of sequence <i>
+  Entry entry(const size_t i) const;
+
+private:
+  uint64_t get_int_(const size_t pos) const;
+
+  std::string file_name_;
+  Memory_Map map_;
+  std::vector<uint64_t> offsets_;
+};
@@ -0,0 +1,80 @@
+#include "io/Fasta_Reader.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+#include "io/fasta_conversion.hpp"
+#include "util/maps.hpp"
+
+static constexpr unsigned char INVALID_STATE = 0xFF;
+
+Fasta_Reader::Fasta_Reader(const std::string& file_name)
+  : file_name_(file_name)
+  , map_(file_name)
+{
+  states_of_.fill(INVALID_STATE);
+  for (unsigned char i = 0; i < NT_MAP_SIZE; ++i) {
+    states_of_[NT_MAP[i]] = i;
+    states_of_[std::tolower(NT_MAP[i])] = i;
+  }
+
+  // anything before the first record must be whitespace
+  cursor_ = next_fasta_record(map_.data(), 0, map_.size());
+  if (std::any_of(map_.data(), map_.data() + cursor_,
+                  [](const char c){ return not is_fasta_space(c); })) {
+    throw std::runtime_error{std::string("Not a FASTA file: ") + file_name};
+  }
+}
+
+Fasta_Reader::~Fasta_Reader()
+{
+  stop_prefetching_();
+}
+
+size_t Fasta_Reader::read_chunk_(Encoded_MSA& result, const size_t number)
+{
+  const auto data = map_.data();
+  const auto size = map_.size();
+
+  result.clear();
+
+  size_t count = 0;
+  for (; count < number and cursor_ < size; ++count) {
+    // <cursor_> is at the '>' of the record
+    const auto label = data + cursor_ + 1;
+    const auto line_end = static_cast<const char *>(
+      std::memchr(label, '\n', size - (cursor_ + 1)));
+    auto label_end = line_end ? line_end : data + size;
+    while (label_end > label and is_fasta_space(*(label_end - 1))) {
+      --label_end;
+    }
+
+    const size_t sites_begin = line_end ? (line_end - data) + 1 : size;
+    const size_t sites_end = next_fasta_record(data, sites_begin, size);
+
+    states_.clear();
+    for (size_t i = sites_begin; i < sites_end; ++i) {
+      const auto c = data[i];
+      if (is_fasta_space(c)) {
+        continue;
+      }
+      const auto state = states_of_[static_cast<unsigned char>(c)];
+      if (state == INVALID_STATE) {
+        throw std::runtime_error{std::string("Invalid character '") + c
+          + "' in sequence " + std::string(label, label_end) + " of " + file_name_};
+      }
+      states_.push_back(state);
+    }
+
+    const auto states = result.append(label, label_end - label, states_.size());
+    std::copy(states_.begin(), states_.end(), states);
+
+    cursor_ = sites_end;
+  }
+
+  num_read_ += count;
+
+  return count;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "io/Memory_Map.hpp"
+#include "io/Query_Source.hpp"
+
+/**
+ * Sequential reader of a FASTA file of aligned queries, by chunks, decoding straight
+ * from a memory mapping of the file to state indices. Used instead of converting the
+ * file to Binary_Fasta when no random access is needed.
+ *
+ * Labels are the whole line after the '>', without trailing whitespace. Sequence lines
+ * are concatenated, dropping any whitespace; case does not matter.
+ */
+class Fasta_Reader : public Query_Source
+{
+public:
+  explicit Fasta_Reader(const std::string& file_name);
+  ~Fasta_Reader();
+
+  Fasta_Reader() = delete;
+
+  // the number of sequences read so far
+  size_t num_read() const { return num_read_; }
+
+protected:
+  size_t read_chunk_(Encoded_MSA& result, const size_t number) override;
+
+private:
+  std::string file_name_;
+  Memory_Map map_;
+  size_t cursor_ = 0;
+  size_t num_read_ = 0;
+  // state index of every character, INVALID_STATE for those not in NT_MAP
+  std::array<unsigned char, 256> states_of_;
+  std::vector<unsigned char> states_;
+};
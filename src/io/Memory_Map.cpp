@@ -0,0 +1,47 @@
+#include "io/Memory_Map.hpp"
+
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+Memory_Map::Memory_Map(const std::string& file_name)
+{
+  const int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error{std::string("Could not open file for mapping: ") + file_name
+      + " (" + std::strerror(errno) + ")"};
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) < 0) {
+    close(fd);
+    throw std::runtime_error{std::string("Could not stat file: ") + file_name};
+  }
+  size_ = static_cast<size_t>(info.st_size);
+
+  // mapping an empty file is an error, but an empty map is not
+  if (size_) {
+    auto addr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error{std::string("Could not map file: ") + file_name
+        + " (" + std::strerror(errno) + ")"};
+    }
+    data_ = static_cast<const char *>(addr);
+  }
+
+  // the mapping stays valid after closing the descriptor
+  close(fd);
+}
+
+Memory_Map::~Memory_Map()
+{
+  if (data_) {
+    munmap(const_cast<char *>(data_), size_);
+  }
+}
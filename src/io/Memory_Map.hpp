@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+/**
+ * Read-only, shared memory mapping of a whole file. Unmapped on destruction.
+ * Mapping the same file from several processes shares the page cache.
+ */
+class Memory_Map
+{
+public:
+  Memory_Map(const std::string& file_name);
+  Memory_Map()  = delete;
+  ~Memory_Map();
+
+  Memory_Map(Memory_Map const& other) = delete;
+  Memory_Map(Memory_Map&& other)      = delete;
+
+  Memory_Map& operator= (Memory_Map const& other) = delete;
+  Memory_Map& operator= (Memory_Map && other)     = delete;
+
+  const char * data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  const char * data_ = nullptr;
+  size_t size_ = 0;
+};
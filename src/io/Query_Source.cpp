@@ -0,0 +1,130 @@
+#include "io/Query_Source.hpp"
+
+#include <chrono>
+#include <stdexcept>
+
+#include "io/Binary_Fasta.hpp"
+#include "io/Fasta_Reader.hpp"
+
+Query_Source::~Query_Source()
+{
+  // implementations should have stopped already
+  stop_prefetching_();
+}
+
+void Query_Source::stop_prefetching_()
+{
+  if (prefetcher_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    space_cv_.notify_all();
+    prefetcher_.join();
+  }
+}
+
+void Query_Source::prefetch(const size_t depth, const size_t chunk_size)
+{
+  if (depth == 0) {
+    return;
+  }
+  if (prefetching_()) {
+    throw std::runtime_error{"Reader is already prefetching."};
+  }
+  depth_ = depth;
+  chunk_size_ = chunk_size;
+  prefetcher_ = std::thread(&Query_Source::prefetch_loop_, this);
+}
+
+size_t Query_Source::read_next(Encoded_MSA& result, const size_t number)
+{
+  const auto wait_start = std::chrono::steady_clock::now();
+  auto stop_wait = [&]() {
+    last_wait_ = std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                               - wait_start).count();
+    total_wait_ += last_wait_;
+  };
+
+  if (not prefetching_()) {
+    const auto num_read = read_chunk_(result, number);
+    stop_wait();
+    return num_read;
+  }
+  if (number != chunk_size_) {
+    throw std::runtime_error{std::string("Prefetching reader asked for a chunk of ")
+      + std::to_string(number) + " instead of " + std::to_string(chunk_size_)};
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  ready_cv_.wait(lock, [this]() { return not ready_.empty() or done_; });
+  stop_wait();
+
+  if (ready_.empty()) {
+    if (error_) {
+      auto error = error_;
+      error_ = nullptr;
+      std::rethrow_exception(error);
+    }
+    result.clear();
+    return 0;
+  }
+
+  // the buffer of the previous chunk is refilled next
+  spare_.push_back(std::move(result));
+  result = std::move(ready_.front());
+  ready_.pop_front();
+  lock.unlock();
+  space_cv_.notify_one();
+
+  return result.size();
+}
+
+void Query_Source::prefetch_loop_()
+{
+  while (true) {
+    Encoded_MSA chunk;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      space_cv_.wait(lock, [this]() { return stop_ or ready_.size() < depth_; });
+      if (stop_) {
+        return;
+      }
+      if (not spare_.empty()) {
+        chunk = std::move(spare_.back());
+        spare_.pop_back();
+      }
+    }
+
+    size_t num_read = 0;
+    std::exception_ptr error;
+    try {
+      num_read = read_chunk_(chunk, chunk_size_);
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (error or num_read == 0) {
+        error_ = error;
+        done_ = true;
+      } else {
+        ready_.push_back(std::move(chunk));
+      }
+    }
+    ready_cv_.notify_one();
+
+    if (error or num_read == 0) {
+      return;
+    }
+  }
+}
+
+std::unique_ptr<Query_Source> make_query_source(const std::string& file_name)
+{
+  if (Binary_Fasta::is_bfast(file_name)) {
+    return std::unique_ptr<Query_Source>(new Binary_Fasta_Reader(file_name));
+  }
+  return std::unique_ptr<Query_Source>(new Fasta_Reader(file_name));
+}
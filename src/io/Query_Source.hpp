@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <exception>
+#include <condition_variable>
+
+#include "seq/Encoded_MSA.hpp"
+
+/**
+ * Sequential source of query chunks, decoded to state indices, that the placement
+ * consumes regardless of the input format (see make_query_source).
+ *
+ * With prefetch(), chunks are read and decoded on a background thread, up to <depth>
+ * chunks ahead of the one handed out by read_next, such that the placement of a chunk
+ * overlaps with the I/O and parsing of the next ones.
+ *
+ * Implementations provide read_chunk_, and have to call stop_prefetching_ in their
+ * destructor, before the state it reads from goes away.
+ */
+class Query_Source
+{
+public:
+  Query_Source() = default;
+  virtual ~Query_Source();
+
+  Query_Source(Query_Source const&) = delete;
+  Query_Source& operator=(Query_Source const&) = delete;
+
+  /**
+   * Starts reading chunks of <chunk_size> sequences ahead, at most <depth> of them.
+   * Every following read_next has to ask for that chunk size. A depth of 0 keeps reading
+   * synchronously.
+   */
+  void prefetch(const size_t depth, const size_t chunk_size);
+
+  // reads up to <number> sequences into <result>. Returns how many, 0 at the end
+  size_t read_next(Encoded_MSA& result, const size_t number);
+
+  // seconds the last read_next took (the time spent waiting for the chunk), and all of
+  // them together
+  double last_wait() const { return last_wait_; }
+  double total_wait() const { return total_wait_; }
+
+protected:
+  // reads up to <number> sequences into <result>, on whichever thread. Returns how many
+  virtual size_t read_chunk_(Encoded_MSA& result, const size_t number) = 0;
+
+  bool prefetching_() const { return depth_ > 0; }
+  void stop_prefetching_();
+
+private:
+  void prefetch_loop_();
+
+  // prefetching: decoded chunks in order, and buffers handed back for reuse
+  size_t depth_ = 0;
+  size_t chunk_size_ = 0;
+  std::thread prefetcher_;
+  std::mutex mutex_;
+  std::condition_variable ready_cv_;
+  std::condition_variable space_cv_;
+  std::deque<Encoded_MSA> ready_;
+  std::vector<Encoded_MSA> spare_;
+  bool done_ = false;
+  bool stop_ = false;
+  std::exception_ptr error_;
+  double last_wait_ = 0.0;
+  double total_wait_ = 0.0;
+};
+
+// the bfast reader for Binary_Fasta files, the FASTA reader otherwise
+std::unique_ptr<Query_Source> make_query_source(const std::string& file_name);
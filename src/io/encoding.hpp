@@ -1,11 +1,14 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <string>
 #include <cassert>
 #include <cmath>
 
 #include "util/Matrix.hpp"
 #include "util/maps.hpp"
+#include "io/fourbit_kernels.hpp"
 
 
 
@@ -30,8 +33,10 @@ private:
   }
 
 public:
-  FourBit()
+  // vectorized: use the fastest kernels of the CPU for whole blocks, where available
+  explicit FourBit(const bool vectorized = true)
     : to_fourbit_(128, 128, 16)
+    , kernels_(vectorized ? fourbit_kernels() : fourbit_kernels_scalar())
   {
     static_assert(NT_MAP_SIZE == 16, "Weird NT map size, go adjust encoder code!");
 
@@ -90,46 +95,54 @@ public:
   // conversion functions
   inline std::basic_string<char> to_fourbit(const std::string& s)
   {
-    const size_t p_size = packed_size(s.size());
-    std::basic_string<char> res;
-    res.reserve(p_size);
+    std::basic_string<char> res(packed_size(s.size()), '\0');
+    to_fourbit(s.data(), s.size(), &res[0]);
+    return res;
+  }
+
+  // packs <n> characters into packed_size(n) bytes
+  void to_fourbit(const char * s, const size_t n, char * packed)
+  {
+    const size_t even = n - (n % 2);
 
     size_t i = 0;
-    for (; i + 1 < s.size(); i += 2) {
-      res.push_back(to_fourbit_.at(s[i], s[i+1u]));
+    while (i < even) {
+      i += kernels_.pack(s + i, even - i, packed + i / 2);
+
+      // the rest, or the block the kernel stopped at (characters not in NT_MAP)
+      const auto stop = std::min(even, i + FOURBIT_MAX_BLOCK);
+      for (; i < stop; i += 2) {
+        packed[i/2] = to_fourbit_.at(s[i], s[i+1u]);
+      }
     }
 
     // original string size not divisible by 2: trailing padding
-    if (i < s.size()) {
-      res.push_back(to_fourbit_.at(s[i], NONE_CHAR));
+    if (i < n) {
+      packed[i/2] = to_fourbit_.at(s[i], NONE_CHAR);
     }
-
-    return res;
   }
 
   std::string from_fourbit(const std::basic_string<char>& s, const size_t n)
   {
+    assert(packed_size(n) <= s.size());
+
     // prepare the result string
     std::string res;
     res.resize(n);
 
-    // determine wether the packed string has padding
-    const bool padded = (s.size() * 2 < n);
+    const auto bytes = reinterpret_cast<const uchar *>(s.data());
+    const size_t full = n / 2;
 
     // unpack
-    size_t i = 0;
-    for (; i < s.size() - 1u; ++i) {
-      reinterpret_cast<char16_t*>(&res[0])[i] 
-        = from_fourbit_[static_cast<uchar>(s[i])];
+    size_t i = kernels_.to_chars(s.data(), full, reinterpret_cast<uchar*>(&res[0]));
+    for (; i < full; ++i) {
+      reinterpret_cast<char16_t*>(&res[0])[i] = from_fourbit_[bytes[i]];
     }
 
-    // last element is special
-    auto char_pair = unpack_(static_cast<uchar>(s[i]));
-    res[i*2] = NT_MAP[char_pair.first];
-
-    if (not padded) {
-      res[i*2+1] = NT_MAP[char_pair.second];
-    } else {
+    // original size not divisible by 2: the last element is padded
+    if (n % 2) {
+      auto char_pair = unpack_(bytes[i]);
+      res[i*2] = NT_MAP[char_pair.first];
       assert(NT_MAP[char_pair.second] == NONE_CHAR);
     }
 
@@ -137,8 +150,30 @@ public:
 
     return res;
   }
+
+  // unpacks directly to state indices, which for 4bit are the positions in NT_MAP
+  void to_states(const char * packed, const size_t n, unsigned char * states)
+  {
+    const auto bytes = reinterpret_cast<const uchar *>(packed);
+    const size_t full = n / 2;
+
+    size_t i = kernels_.to_states(packed, full, states);
+    for (; i < full; ++i) {
+      const auto pair = unpack_(bytes[i]);
+      states[2*i]     = pair.first;
+      states[2*i+1u]  = pair.second;
+    }
+
+    // odd length: the last byte only holds one character
+    if (n % 2) {
+      states[2*i] = unpack_(bytes[i]).first;
+    }
+  }
+
+  const char * kernels_name() const { return kernels_.name; }
   
 private:
   Matrix<char> to_fourbit_;
   std::array<char16_t, 256> from_fourbit_;
+  const Fourbit_Kernels& kernels_;
 };
@@ -0,0 +1,301 @@
+#include "io/fasta_conversion.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "io/Binary_Fasta.hpp"
+#include "io/Memory_Map.hpp"
+#include "io/encoding.hpp"
+#include "util/Thread_Pool.hpp"
+
+template <class T>
+static inline void append_int(std::string& buffer, const T value)
+{
+  buffer.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+// <header_length><header string><sequence_length><encoded sequence padded to next byte>
+static void append_entry( std::string& buffer,
+                          FourBit& code,
+                          const char * label,
+                          const size_t label_size,
+                          const char * sites,
+                          const size_t num_sites)
+{
+  append_int<size_t>(buffer, label_size);
+  buffer.append(label, label_size);
+  append_int<uint64_t>(buffer, num_sites);
+
+  const auto pos = buffer.size();
+  buffer.resize(pos + code.packed_size(num_sites));
+  code.to_fourbit(sites, num_sites, &buffer[pos]);
+}
+
+static size_t trimmed_size(const char * begin, const char * end)
+{
+  while (end > begin and is_fasta_space(*(end - 1))) {
+    --end;
+  }
+  return end - begin;
+}
+
+size_t next_fasta_record(const char * data, size_t pos, const size_t end)
+{
+  while (pos < end) {
+    const auto found = static_cast<const char *>(std::memchr(data + pos, '>', end - pos));
+    if (not found) {
+      return end;
+    }
+    pos = found - data;
+    if (pos == 0 or data[pos - 1] == '\n') {
+      return pos;
+    }
+    ++pos;
+  }
+  return end;
+}
+
+static size_t count_records(const char * data, const size_t begin, const size_t end)
+{
+  size_t count = 0;
+  auto pos = next_fasta_record(data, begin, end);
+  while (pos < end) {
+    ++count;
+    pos = next_fasta_record(data, pos + 1, end);
+  }
+  return count;
+}
+
+/*
+  Encodes the records of [begin, end), which starts at a record, into <buffer>. The
+  sizes of the entries go to <entry_sizes>.
+*/
+static void encode_segment( const char * data,
+                            const size_t begin,
+                            const size_t end,
+                            std::string& buffer,
+                            std::vector<uint64_t>& entry_sizes)
+{
+  FourBit code;
+  std::string sites;
+
+  buffer.clear();
+  entry_sizes.clear();
+
+  size_t pos = begin;
+  while (pos < end) {
+    assert(data[pos] == '>');
+    const auto label = data + pos + 1;
+    const auto line_end = static_cast<const char *>(
+      std::memchr(label, '\n', end - (pos + 1)));
+    const auto label_end = line_end ? line_end : data + end;
+
+    const size_t sites_begin = line_end ? (line_end - data) + 1 : end;
+    const size_t sites_end = next_fasta_record(data, sites_begin, end);
+
+    sites.resize(sites_end - sites_begin);
+    const auto sites_last = std::remove_copy_if(data + sites_begin, data + sites_end,
+                                                &sites[0], is_fasta_space);
+    const size_t num_sites = sites_last - sites.data();
+
+    const auto before = buffer.size();
+    append_entry(buffer, code, label, trimmed_size(label, label_end), sites.data(), num_sites);
+    entry_sizes.push_back(buffer.size() - before);
+
+    pos = sites_end;
+  }
+}
+
+// writes the <id><offset> pairs of the offset table for the given entries
+static void write_table(std::ostream& out,
+                        const size_t first_id,
+                        uint64_t offset,
+                        const std::vector<uint64_t>& entry_sizes)
+{
+  std::string table;
+  table.reserve(entry_sizes.size() * 2 * sizeof(uint64_t));
+  for (size_t i = 0; i < entry_sizes.size(); ++i) {
+    append_int<uint64_t>(table, first_id + i);
+    append_int<uint64_t>(table, offset);
+    offset += entry_sizes[i];
+  }
+  out.seekp(MAGIC_SIZE + sizeof(uint64_t) + first_id * 2 * sizeof(uint64_t));
+  out.write(table.data(), table.size());
+}
+
+static void write_magic(std::ostream& out, const uint64_t num_sequences)
+{
+  out.seekp(0);
+  out.write(MAGIC, MAGIC_SIZE);
+  out.write(reinterpret_cast<const char *>(&num_sequences), sizeof(num_sequences));
+}
+
+static void check_written(const std::ostream& out, const std::string& file_name)
+{
+  if (not out) {
+    throw std::runtime_error{std::string("Could not write bfast file: ") + file_name};
+  }
+}
+
+size_t convert_fasta_file(const std::string& fasta_file,
+                          const std::string& bfast_file,
+                          const size_t num_threads,
+                          const size_t segment_size)
+{
+  Memory_Map map(fasta_file);
+  const auto data = map.data();
+  const auto size = map.size();
+
+  // anything before the first record must be whitespace
+  const auto first = next_fasta_record(data, 0, size);
+  if (std::any_of(data, data + first, [](const char c){ return not is_fasta_space(c); })) {
+    throw std::runtime_error{std::string("Not a FASTA file: ") + fasta_file};
+  }
+
+  // split into segments at record boundaries
+  std::vector<size_t> bounds{first};
+  while (bounds.back() < size) {
+    const auto nominal = bounds.back() + std::max<size_t>(segment_size, 1);
+    bounds.push_back(next_fasta_record(data, nominal, size));
+  }
+  const size_t num_segments = bounds.size() - 1;
+
+  const size_t num_workers = num_threads ? num_threads
+                                         : std::max(1u, std::thread::hardware_concurrency());
+  Thread_Pool pool(std::min(num_workers, std::max<size_t>(num_segments, 1)));
+
+  // the number of records per segment determines the size of the header, and the
+  // sequence id each segment starts at
+  std::vector<size_t> first_id(num_segments + 1, 0);
+  {
+    Task_Group group(pool);
+    for (size_t s = 0; s < num_segments; ++s) {
+      group.run([&, s](const size_t) {
+        first_id[s + 1] = count_records(data, bounds[s], bounds[s + 1]);
+      }, s % pool.size());
+    }
+    group.wait();
+  }
+  for (size_t s = 0; s < num_segments; ++s) {
+    first_id[s + 1] += first_id[s];
+  }
+  const size_t num_sequences = first_id.back();
+
+  std::ofstream out(bfast_file, std::ios::binary | std::ios::trunc);
+  if (not out) {
+    throw std::runtime_error{std::string("Could not open bfast file for writing: ")
+      + bfast_file};
+  }
+
+  // encode a batch of segments at a time, then write them in order
+  const size_t batch_size = 2 * pool.size();
+  std::vector<std::string> buffers(batch_size);
+  std::vector<std::vector<uint64_t>> entry_sizes(batch_size);
+
+  uint64_t offset = data_section_offset(num_sequences);
+  for (size_t batch = 0; batch < num_segments; batch += batch_size) {
+    const size_t batch_end = std::min(num_segments, batch + batch_size);
+
+    Task_Group group(pool);
+    for (size_t s = batch; s < batch_end; ++s) {
+      group.run([&, s, batch](const size_t) {
+        encode_segment(data, bounds[s], bounds[s + 1],
+                       buffers[s - batch], entry_sizes[s - batch]);
+      }, (s - batch) % pool.size());
+    }
+    group.wait();
+
+    for (size_t s = batch; s < batch_end; ++s) {
+      const auto& buffer = buffers[s - batch];
+      assert(entry_sizes[s - batch].size() == first_id[s + 1] - first_id[s]);
+
+      out.seekp(offset);
+      out.write(buffer.data(), buffer.size());
+      write_table(out, first_id[s], offset, entry_sizes[s - batch]);
+      offset += buffer.size();
+    }
+    check_written(out, bfast_file);
+  }
+
+  write_magic(out, num_sequences);
+  out.close();
+  check_written(out, bfast_file);
+
+  return num_sequences;
+}
+
+size_t convert_fasta_stream(std::istream& fasta,
+                            const std::string& bfast_file)
+{
+  const auto spool_file = bfast_file + ".data";
+  std::vector<uint64_t> entry_sizes;
+
+  {
+    std::ofstream spool(spool_file, std::ios::binary | std::ios::trunc);
+    if (not spool) {
+      throw std::runtime_error{std::string("Could not open file for writing: ") + spool_file};
+    }
+
+    FourBit code;
+    std::string line;
+    std::string label;
+    std::string sites;
+    std::string entry;
+    bool in_record = false;
+
+    auto flush = [&]() {
+      entry.clear();
+      append_entry(entry, code, label.data(), label.size(), sites.data(), sites.size());
+      spool.write(entry.data(), entry.size());
+      entry_sizes.push_back(entry.size());
+    };
+
+    while (std::getline(fasta, line)) {
+      if (not line.empty() and line[0] == '>') {
+        if (in_record) {
+          flush();
+        }
+        in_record = true;
+        label.assign(line, 1, trimmed_size(line.data() + 1, line.data() + line.size()));
+        sites.clear();
+      } else if (in_record) {
+        std::remove_copy_if(line.begin(), line.end(), std::back_inserter(sites), is_fasta_space);
+      } else if (std::any_of(line.begin(), line.end(), [](const char c){ return not is_fasta_space(c); })) {
+        std::remove(spool_file.c_str());
+        throw std::runtime_error{"Input is not in FASTA format."};
+      }
+    }
+    if (in_record) {
+      flush();
+    }
+
+    spool.close();
+    check_written(spool, spool_file);
+  }
+
+  std::ofstream out(bfast_file, std::ios::binary | std::ios::trunc);
+  if (not out) {
+    throw std::runtime_error{std::string("Could not open bfast file for writing: ")
+      + bfast_file};
+  }
+  write_magic(out, entry_sizes.size());
+  write_table(out, 0, data_section_offset(entry_sizes.size()), entry_sizes);
+
+  if (not entry_sizes.empty()) {
+    std::ifstream spool(spool_file, std::ios::binary);
+    out << spool.rdbuf();
+  }
+  std::remove(spool_file.c_str());
+
+  out.close();
+  check_written(out, bfast_file);
+
+  return entry_sizes.size();
+}
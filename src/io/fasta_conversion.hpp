@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <istream>
+#include <cstddef>
+
+/**
+ * Conversion of FASTA input to the Binary_Fasta (bfast) format in a single pass.
+ *
+ * Labels are the whole line after the '>', without trailing whitespace. Sequence lines
+ * are concatenated, dropping any whitespace.
+ */
+
+// whitespace within FASTA records, which is dropped from the sequences
+inline bool is_fasta_space(const char c)
+{
+  return c == ' ' or c == '\n' or c == '\r' or c == '\t' or c == '\v' or c == '\f';
+}
+
+// position of the first '>' in [pos, end) of <data> that starts a line, or end
+size_t next_fasta_record(const char * data, size_t pos, const size_t end);
+
+/**
+ * Converts a FASTA file through a memory mapping. The file is split at record
+ * boundaries into segments, which are encoded in parallel on <num_threads> threads
+ * (0: all hardware threads) and written in order. The offset table of the header is
+ * back-patched as the segments are written. <segment_size> is the nominal size of a
+ * segment in bytes.
+ *
+ * Returns the number of sequences.
+ */
+size_t convert_fasta_file(const std::string& fasta_file,
+                          const std::string& bfast_file,
+                          const size_t num_threads = 0,
+                          const size_t segment_size = 8ul * 1024ul * 1024ul);
+
+/**
+ * Converts FASTA input from a stream that can only be read once, such as stdin. The
+ * data section is spooled to <bfast_file>.data, and appended to the header once the
+ * number of sequences is known.
+ *
+ * Returns the number of sequences.
+ */
+size_t convert_fasta_stream(std::istream& fasta,
+                            const std::string& bfast_file);
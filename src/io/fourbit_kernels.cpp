@@ -0,0 +1,292 @@
+#include "io/fourbit_kernels.hpp"
+
+#include <array>
+
+#include "util/maps.hpp"
+
+#if defined(__SSE3) || defined(__AVX) || defined(__AVX2)
+#include <immintrin.h>
+#endif
+
+// see lookup_kernels.cpp: compiled for the instruction set via the target attribute,
+// selected at runtime
+#define EPA_TARGET(isa) __attribute__((target(isa)))
+
+static size_t pack_scalar(const char *, const size_t, char *)
+{
+  return 0;
+}
+
+static size_t unpack_scalar(const char *, const size_t, unsigned char *)
+{
+  return 0;
+}
+
+#if defined(__SSE3) || defined(__AVX) || defined(__AVX2)
+static constexpr unsigned char INVALID_CODE = 0xFF;
+
+/*
+  Codes of the characters 0x40 to 0x5F (uppercase letters), INVALID_CODE for those
+  not in NT_MAP. Lowercase letters map onto them by clearing bit 5; '-' is handled
+  separately.
+*/
+struct Letter_Codes
+{
+  alignas(32) std::array<unsigned char, 16> high_4;
+  alignas(32) std::array<unsigned char, 16> high_5;
+  alignas(32) std::array<unsigned char, 16> nt_map;
+};
+
+static Letter_Codes make_letter_codes()
+{
+  Letter_Codes codes;
+  codes.high_4.fill(INVALID_CODE);
+  codes.high_5.fill(INVALID_CODE);
+  for (unsigned char i = 0; i < NT_MAP_SIZE; ++i) {
+    codes.nt_map[i] = NT_MAP[i];
+    const auto c = NT_MAP[i];
+    if (c >= 0x40 and c < 0x50) {
+      codes.high_4[c - 0x40] = i;
+    } else if (c >= 0x50 and c < 0x60) {
+      codes.high_5[c - 0x50] = i;
+    }
+  }
+  return codes;
+}
+
+static const Letter_Codes& letter_codes()
+{
+  static const Letter_Codes codes = make_letter_codes();
+  return codes;
+}
+#endif
+
+#if defined(__SSE3) || defined(__AVX)
+EPA_TARGET("ssse3")
+static inline __m128i codes_ssse3(const __m128i chars,
+                                  const __m128i high_4,
+                                  const __m128i high_5,
+                                  __m128i& invalid)
+{
+  const auto nibble = _mm_set1_epi8(0x0F);
+  const auto upper = _mm_and_si128(chars, _mm_set1_epi8(static_cast<char>(0xDF)));
+  const auto lo = _mm_and_si128(upper, nibble);
+  const auto hi = _mm_and_si128(_mm_srli_epi16(upper, 4), nibble);
+
+  const auto in_4 = _mm_cmpeq_epi8(hi, _mm_set1_epi8(4));
+  const auto in_5 = _mm_cmpeq_epi8(hi, _mm_set1_epi8(5));
+  const auto gap = _mm_cmpeq_epi8(chars, _mm_set1_epi8('-'));
+
+  auto codes = _mm_or_si128(_mm_and_si128(in_4, _mm_shuffle_epi8(high_4, lo)),
+                            _mm_and_si128(in_5, _mm_shuffle_epi8(high_5, lo)));
+  // neither of the two letter ranges
+  codes = _mm_or_si128(codes, _mm_andnot_si128(_mm_or_si128(in_4, in_5),
+                                               _mm_set1_epi8(static_cast<char>(INVALID_CODE))));
+  // the gap is code 0
+  codes = _mm_andnot_si128(gap, codes);
+
+  invalid = _mm_or_si128(invalid,
+                         _mm_cmpeq_epi8(codes, _mm_set1_epi8(static_cast<char>(INVALID_CODE))));
+  return codes;
+}
+
+EPA_TARGET("ssse3")
+static size_t pack_ssse3(const char * chars, const size_t n, char * packed)
+{
+  const auto& tables = letter_codes();
+  const auto high_4 = _mm_load_si128(reinterpret_cast<const __m128i *>(tables.high_4.data()));
+  const auto high_5 = _mm_load_si128(reinterpret_cast<const __m128i *>(tables.high_5.data()));
+  // first character of a pair times 16, plus the second
+  const auto weights = _mm_set1_epi16(0x0110);
+
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    auto invalid = _mm_setzero_si128();
+    const auto codes_0 = codes_ssse3(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(chars + i)), high_4, high_5, invalid);
+    const auto codes_1 = codes_ssse3(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(chars + i + 16)), high_4, high_5, invalid);
+    if (_mm_movemask_epi8(invalid)) {
+      break;
+    }
+
+    const auto bytes = _mm_packus_epi16(_mm_maddubs_epi16(codes_0, weights),
+                                        _mm_maddubs_epi16(codes_1, weights));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(packed + i / 2), bytes);
+  }
+  return i;
+}
+
+EPA_TARGET("ssse3")
+static inline size_t unpack_ssse3(const char * packed,
+                                  const size_t num_bytes,
+                                  unsigned char * out,
+                                  const bool to_chars)
+{
+  const auto nibble = _mm_set1_epi8(0x0F);
+  const auto map = _mm_load_si128(
+    reinterpret_cast<const __m128i *>(letter_codes().nt_map.data()));
+
+  size_t i = 0;
+  for (; i + 16 <= num_bytes; i += 16) {
+    const auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(packed + i));
+    auto hi = _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble);
+    auto lo = _mm_and_si128(bytes, nibble);
+    if (to_chars) {
+      hi = _mm_shuffle_epi8(map, hi);
+      lo = _mm_shuffle_epi8(map, lo);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+  }
+  return i;
+}
+
+EPA_TARGET("ssse3")
+static size_t to_chars_ssse3(const char * packed, const size_t num_bytes, unsigned char * out)
+{
+  return unpack_ssse3(packed, num_bytes, out, true);
+}
+
+EPA_TARGET("ssse3")
+static size_t to_states_ssse3(const char * packed, const size_t num_bytes, unsigned char * out)
+{
+  return unpack_ssse3(packed, num_bytes, out, false);
+}
+#endif
+
+#ifdef __AVX2
+EPA_TARGET("avx2")
+static inline __m256i codes_avx2( const __m256i chars,
+                                  const __m256i high_4,
+                                  const __m256i high_5,
+                                  __m256i& invalid)
+{
+  const auto nibble = _mm256_set1_epi8(0x0F);
+  const auto upper = _mm256_and_si256(chars, _mm256_set1_epi8(static_cast<char>(0xDF)));
+  const auto lo = _mm256_and_si256(upper, nibble);
+  const auto hi = _mm256_and_si256(_mm256_srli_epi16(upper, 4), nibble);
+
+  const auto in_4 = _mm256_cmpeq_epi8(hi, _mm256_set1_epi8(4));
+  const auto in_5 = _mm256_cmpeq_epi8(hi, _mm256_set1_epi8(5));
+  const auto gap = _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('-'));
+
+  auto codes = _mm256_or_si256(_mm256_and_si256(in_4, _mm256_shuffle_epi8(high_4, lo)),
+                               _mm256_and_si256(in_5, _mm256_shuffle_epi8(high_5, lo)));
+  codes = _mm256_or_si256(codes,
+    _mm256_andnot_si256(_mm256_or_si256(in_4, in_5),
+                        _mm256_set1_epi8(static_cast<char>(INVALID_CODE))));
+  codes = _mm256_andnot_si256(gap, codes);
+
+  invalid = _mm256_or_si256(invalid,
+    _mm256_cmpeq_epi8(codes, _mm256_set1_epi8(static_cast<char>(INVALID_CODE))));
+  return codes;
+}
+
+EPA_TARGET("avx2")
+static inline __m256i broadcast_table(const std::array<unsigned char, 16>& table)
+{
+  return _mm256_broadcastsi128_si256(
+    _mm_load_si128(reinterpret_cast<const __m128i *>(table.data())));
+}
+
+EPA_TARGET("avx2")
+static size_t pack_avx2(const char * chars, const size_t n, char * packed)
+{
+  const auto& tables = letter_codes();
+  // the shuffles work within 128 bit lanes: both lanes hold the table
+  const auto high_4 = broadcast_table(tables.high_4);
+  const auto high_5 = broadcast_table(tables.high_5);
+  const auto weights = _mm256_set1_epi16(0x0110);
+
+  size_t i = 0;
+  for (; i + 64 <= n; i += 64) {
+    auto invalid = _mm256_setzero_si256();
+    const auto codes_0 = codes_avx2(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(chars + i)), high_4, high_5, invalid);
+    const auto codes_1 = codes_avx2(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(chars + i + 32)), high_4, high_5, invalid);
+    if (_mm256_movemask_epi8(invalid)) {
+      break;
+    }
+
+    // packing works within lanes as well: restore the order of the 64 bit quarters
+    const auto bytes = _mm256_packus_epi16(_mm256_maddubs_epi16(codes_0, weights),
+                                           _mm256_maddubs_epi16(codes_1, weights));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(packed + i / 2),
+                        _mm256_permute4x64_epi64(bytes, _MM_SHUFFLE(3, 1, 2, 0)));
+  }
+  return i;
+}
+
+EPA_TARGET("avx2")
+static inline size_t unpack_avx2( const char * packed,
+                                  const size_t num_bytes,
+                                  unsigned char * out,
+                                  const bool to_chars)
+{
+  const auto nibble = _mm256_set1_epi8(0x0F);
+  const auto map = broadcast_table(letter_codes().nt_map);
+
+  size_t i = 0;
+  for (; i + 32 <= num_bytes; i += 32) {
+    const auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(packed + i));
+    auto hi = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble);
+    auto lo = _mm256_and_si256(bytes, nibble);
+    if (to_chars) {
+      hi = _mm256_shuffle_epi8(map, hi);
+      lo = _mm256_shuffle_epi8(map, lo);
+    }
+    // interleaving works within lanes: bytes 0-7 and 16-23, then 8-15 and 24-31
+    const auto first = _mm256_unpacklo_epi8(hi, lo);
+    const auto second = _mm256_unpackhi_epi8(hi, lo);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 2 * i),
+                        _mm256_permute2x128_si256(first, second, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 2 * i + 32),
+                        _mm256_permute2x128_si256(first, second, 0x31));
+  }
+  return i;
+}
+
+EPA_TARGET("avx2")
+static size_t to_chars_avx2(const char * packed, const size_t num_bytes, unsigned char * out)
+{
+  return unpack_avx2(packed, num_bytes, out, true);
+}
+
+EPA_TARGET("avx2")
+static size_t to_states_avx2(const char * packed, const size_t num_bytes, unsigned char * out)
+{
+  return unpack_avx2(packed, num_bytes, out, false);
+}
+#endif
+
+static Fourbit_Kernels select_fourbit_kernels()
+{
+#if defined(__SSE3) || defined(__AVX) || defined(__AVX2)
+  __builtin_cpu_init();
+#endif
+#ifdef __AVX2
+  if (__builtin_cpu_supports("avx2")) {
+    return {pack_avx2, to_chars_avx2, to_states_avx2, "AVX2"};
+  }
+#endif
+#if defined(__SSE3) || defined(__AVX)
+  if (__builtin_cpu_supports("ssse3")) {
+    return {pack_ssse3, to_chars_ssse3, to_states_ssse3, "SSSE3"};
+  }
+#endif
+  return {pack_scalar, unpack_scalar, unpack_scalar, "scalar"};
+}
+
+const Fourbit_Kernels& fourbit_kernels()
+{
+  static const Fourbit_Kernels kernels = select_fourbit_kernels();
+  return kernels;
+}
+
+const Fourbit_Kernels& fourbit_kernels_scalar()
+{
+  static const Fourbit_Kernels kernels = {pack_scalar, unpack_scalar, unpack_scalar, "scalar"};
+  return kernels;
+}
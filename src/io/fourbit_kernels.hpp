@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * Vectorized packing and unpacking of 4-bit encoded nucleotide sequences (see FourBit),
+ * doing the 16-entry table lookups of NT_MAP with byte shuffles.
+ *
+ * The kernels only process whole blocks (of up to FOURBIT_MAX_BLOCK characters) and
+ * return how far they got. FourBit does the rest, and the blocks a pack kernel stops at:
+ * those containing characters outside of NT_MAP. The results are thus identical to the
+ * scalar FourBit for any input.
+ */
+constexpr size_t FOURBIT_MAX_BLOCK = 64;
+
+// packs characters [0, n) two per byte. Returns the number of characters packed, an even
+// number that is at most n
+using fourbit_pack_type = size_t(*)(const char * chars, const size_t n, char * packed);
+
+// unpacks <num_bytes> full bytes, to two characters or state indices each. Returns the
+// number of bytes unpacked
+using fourbit_unpack_type = size_t(*)(const char * packed,
+                                      const size_t num_bytes,
+                                      unsigned char * out);
+
+struct Fourbit_Kernels
+{
+  fourbit_pack_type pack;
+  fourbit_unpack_type to_chars;
+  fourbit_unpack_type to_states;
+  const char * name;
+};
+
+// the best kernels supported by the executing CPU (determined once)
+const Fourbit_Kernels& fourbit_kernels();
+
+// kernels leaving everything to FourBit, to compare against
+const Fourbit_Kernels& fourbit_kernels_scalar();
@@ -31,7 +31,7 @@ std::string placement_to_jplace_string(const Placement& p)
   return output.str();
 }
 
-std::string pquery_to_jplace_string(const PQuery<Placement>& pquery)
+std::string pquery_to_jplace_string(const PQuery<Placement>& pquery, const Label_Store& labels)
 {
   std::ostringstream output;
 
@@ -58,8 +58,7 @@ std::string pquery_to_jplace_string(const PQuery<Placement>& pquery)
   output <<"    \"n\": [";
   
   // sequence header
-  const auto header = pquery.header();
-  output << "\"" << header.c_str() << "\"";
+  output << "\"" << labels[pquery.sequence_id()] << "\"";
  
 
   output << "]" << NEWL; // close name bracket
@@ -101,13 +100,13 @@ std::string finalize_jplace_string(const std::string& invocation)
   return output.str();
 }
 
-std::string sample_to_jplace_string(const Sample<Placement>& sample)
+std::string sample_to_jplace_string(const Sample<Placement>& sample, const Label_Store& labels)
 {
   std::ostringstream output;
 
   size_t i = 0;
   for (const auto& p : sample) {
-    output << pquery_to_jplace_string(p); 
+    output << pquery_to_jplace_string(p, labels);
     if (++i < sample.size()) {
       output << ",";
     }
@@ -117,6 +116,7 @@ std::string sample_to_jplace_string(const Sample<Placement>& sample)
 }
 
 std::string full_jplace_string( const Sample<Placement>& sample,
+                                const Label_Store& labels,
                                 const std::string& invocation)
 {
   std::ostringstream output;
@@ -125,7 +125,7 @@ std::string full_jplace_string( const Sample<Placement>& sample,
   output << init_jplace_string(sample.newick());
 
   // actual placements
-  output << sample_to_jplace_string(sample);
+  output << sample_to_jplace_string(sample, labels);
 
   // metadata std::string
   output << finalize_jplace_string(invocation);
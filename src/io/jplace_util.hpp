@@ -8,12 +8,15 @@
 #include "sample/Sample.hpp"
 #include "sample/Placement.hpp"
 #include "seq/MSA.hpp"
+#include "seq/Label_Store.hpp"
 
+// the name of a PQuery is looked up in <labels> by its sequence id
 std::string placement_to_jplace_string(const Placement& p);
-std::string pquery_to_jplace_string(const PQuery<Placement>& p);
-std::string full_jplace_string( const Sample<Placement>& sample, 
+std::string pquery_to_jplace_string(const PQuery<Placement>& p, const Label_Store& labels);
+std::string full_jplace_string( const Sample<Placement>& sample,
+                                const Label_Store& labels,
                                 const std::string& invocation);
 std::string init_jplace_string(const std::string& numbered_newick);
 std::string finalize_jplace_string(const std::string& invocation);
-std::string sample_to_jplace_string(const Sample<Placement>& sample);
+std::string sample_to_jplace_string(const Sample<Placement>& sample, const Label_Store& labels);
 void merge_into(std::ofstream& dest, const std::vector<std::string>& sources);
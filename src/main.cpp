@@ -88,7 +88,8 @@ int main(int argc, char** argv)
     ("B,dump-binary",
       "Binary Dump mode: write ref. tree in binary format then exit.")
     ("c,bfast",
-      "Convert the given fasta file to bfast format needed for running EPA-ng with MPI",
+      "Convert the given fasta file to bfast format needed for running EPA-ng with MPI. "
+      "Use - to read from stdin.",
       cxxopts::value<std::string>())
     ("filter-acc-lwr",
       "Accumulated likelihood weight after which further placements are discarded.",
@@ -108,6 +109,22 @@ int main(int argc, char** argv)
     ("raxml-blo",
       "Employ old style of branch length optimization during thorough insertion as opposed to sliding approach. "
       "WARNING: may significantly slow down computation.")
+    ("blo-priors",
+      "Start the branch length optimization of a placement from an estimated pendant length "
+      "instead of the default one, and let it converge more loosely for placements the "
+      "preplacement found unlikely. Faster, at a small cost in accuracy: the logl of a "
+      "placement may differ by up to the optimization tolerance, scaled by how unlikely "
+      "the placement is.")
+    ("blo-pruning",
+      "Skip the branch length optimization of candidates whose placement is too unlikely "
+      "to pass the final filter: exact or fast. Exact mode skips a candidate only if a "
+      "provable bound on its logl leaves it too little weight to change the output, and "
+      "optimizes it after all if the output could differ otherwise. As the bound is loose, "
+      "it skips few candidates. Fast mode skips the candidates whose preplacement logl is "
+      "too far below the best one of the query, by a distance calibrated on the placements "
+      "optimized so far. This is a heuristic: a skipped candidate may have passed the "
+      "filter, and the LWRs of the kept placements are normalized without the skipped ones.",
+      cxxopts::value<std::string>())
     ("no-repeats",
       "Do NOT employ site repeats optimization. (not recommended, will increase memory footprint without improving runtime or quality) ")
     ("g,dyn-heur",
@@ -135,6 +152,31 @@ int main(int argc, char** argv)
       "Alpha parameter to be used. Overwritten by -O. "
       "Example: --alpha 0.634016",
       cxxopts::value<double>())
+    ("precision",
+      "Storage precision of the precomputed preplacement tables: double, float or int16. "
+      "Lower precision reduces memory footprint at the cost of accuracy during preplacement.",
+      cxxopts::value<std::string>()->default_value("double"))
+    ("lookup-cache",
+      "Cache file for the precomputed preplacement tables. If it matches the reference tree, "
+      "model and precision, it is memory mapped instead of recomputing the tables. Otherwise "
+      "it is (re)written once the tables are built.",
+      cxxopts::value<std::string>())
+    ("validate-precision",
+      "Additionally run the preplacement with double precision tables and report the "
+      "maximum LWR deviation of the reduced precision. Only useful with --precision.")
+    ("ranged",
+      "Only consider the non-gap range of each query (first to last non-gap site) during "
+      "placement, treating the sites outside of it as gaps. Speeds up the placement of short "
+      "(e.g. amplicon) sequences. The branch length optimization of the thorough placement "
+      "only does so with --no-repeats, and not with --raxml-blo.")
+    ("lookup-memory",
+      "Memory budget for the precomputed preplacement tables, in MiB. If the tables exceed "
+      "it, they are built on demand and the least recently used ones are evicted.",
+      cxxopts::value<unsigned int>())
+    ("tree-cache",
+      "Number of constructed branch trees each thread keeps for reuse in later chunks. "
+      "0 disables the cache.",
+      cxxopts::value<unsigned int>()->default_value("32"))
     ;
   cli.add_options("Pipeline")
     ("pipeline",
@@ -143,6 +185,10 @@ int main(int argc, char** argv)
     ("chunk-size",
       "Number of query sequences to be read in at a time. May influence performance.",
       cxxopts::value<unsigned int>()->default_value("5000"))
+    ("prefetch",
+      "Number of chunks of queries to read and decode in the background, ahead of the one "
+      "being placed. 0 reads them in between.",
+      cxxopts::value<unsigned int>()->default_value("2"))
     #ifdef __OMP
     ("T,threads",
       "Number of threads to use. If 0 is passed as argument, program will run with the maximum number "
@@ -170,11 +216,14 @@ int main(int argc, char** argv)
 
   ensure_dir_has_slash(work_dir);
 
+  // conversion happens before the rest of the options are read
+  const size_t conversion_threads = cli.count("threads") ? cli["threads"].as<unsigned int>() : 0;
+
   if (cli.count("bfast")) {
     LOG_INFO << "Converting given FASTA file to BFAST format.";
     auto fasta = cli["bfast"].as<std::string>();
     LOG_INFO << "Started " << genesis::utils::current_time();
-    auto resultfile = Binary_Fasta::fasta_to_bfast(fasta, work_dir);
+    auto resultfile = Binary_Fasta::fasta_to_bfast(fasta, work_dir, conversion_threads);
     LOG_INFO << "Finished " << genesis::utils::current_time();
     LOG_INFO << "Resulting bfast file was written to: " << resultfile;
     exit_epa();
@@ -192,11 +241,6 @@ int main(int argc, char** argv)
   if (cli.count("query")) {
     query_file = cli["query"].as<std::string>();
     LOG_INFO << "Selected: Query file: " << query_file;
-    if (split_by_delimiter(query_file, ".").back() != "bin") {
-      LOG_INFO << "This appears to be a non-binary fasta file. Converting!";
-      query_file = Binary_Fasta::fasta_to_bfast(query_file, work_dir);
-      LOG_INFO << "Updated Query file: " << query_file;
-    }
   }
 
   if (cli.count("tree")) {
@@ -279,11 +323,76 @@ int main(int argc, char** argv)
     LOG_INFO << "Selected: On query insertion, optimize branch lengths the way RAxML-EPA did it";
   }
 
+  if (cli.count("blo-priors")) {
+    options.blo_priors = true;
+    LOG_INFO << "Selected: Optimizing branch lengths of placements from estimated priors";
+  }
+
+  if (cli.count("blo-pruning")) {
+    const auto pruning = cli["blo-pruning"].as<std::string>();
+    if (pruning == "exact") {
+      options.pruning = blo_pruning::EXACT;
+    } else if (pruning == "fast") {
+      options.pruning = blo_pruning::FAST;
+    } else {
+      throw std::runtime_error{"Unknown BLO pruning mode: " + pruning};
+    }
+    LOG_INFO << "Selected: Pruning of unlikely thorough placement candidates: " << pruning;
+  }
+
   if (cli.count("no-repeats")) {
     options.repeats = false;
     LOG_INFO << "Selected: Using the non-repeats version of libpll/modules";
   }
 
+  if (cli.count("precision")) {
+    const auto precision = cli["precision"].as<std::string>();
+    if (precision == "double") {
+      options.precision = lookup_precision::DOUBLE;
+    } else if (precision == "float") {
+      options.precision = lookup_precision::FLOAT;
+    } else if (precision == "int16") {
+      options.precision = lookup_precision::INT16;
+    } else {
+      throw std::runtime_error{"Unknown precision: " + precision};
+    }
+    LOG_INFO << "Selected: Precomputed preplacement tables stored as: " << precision;
+  }
+
+  if (cli.count("lookup-cache")) {
+    options.lookup_cache_file = cli["lookup-cache"].as<std::string>();
+    LOG_INFO << "Selected: Preplacement lookup cache file: " << options.lookup_cache_file;
+  }
+
+  if (cli.count("ranged")) {
+    options.ranged = true;
+    LOG_INFO << "Selected: Ranged placement (non-gap range of the queries only)";
+    if (options.repeats) {
+      LOG_INFO << "\tWARNING: the branch length optimization uses the full range with site "
+               << "repeats, see --no-repeats";
+    }
+    if (not options.sliding_blo) {
+      LOG_INFO << "\tWARNING: the branch length optimization uses the full range with "
+               << "--raxml-blo";
+    }
+  }
+
+  if (cli.count("lookup-memory")) {
+    options.lookup_memory = static_cast<size_t>(cli["lookup-memory"].as<unsigned int>())
+                          * 1024 * 1024;
+    LOG_INFO << "Selected: Preplacement lookup table memory budget (MiB): "
+             << cli["lookup-memory"].as<unsigned int>();
+  }
+
+  if (cli.count("tree-cache")) {
+    options.tree_cache_size = cli["tree-cache"].as<unsigned int>();
+  }
+
+  if (cli.count("validate-precision")) {
+    options.validate_precision = true;
+    LOG_INFO << "Selected: Validating the preplacement precision against double precision";
+  }
+
   if (cli.count("pipeline")) {
     pipeline = true;
     LOG_INFO << "Selected: Using the pipeline distributed parallel scheme.";
@@ -336,6 +445,10 @@ int main(int argc, char** argv)
     LOG_INFO << "Selected: Reading queries in chunks of: " << options.chunk_size;
   }
 
+  if (cli.count("prefetch")) {
+    options.prefetch_depth = cli["prefetch"].as<unsigned int>();
+  }
+
   if (cli.count("threads")) {
     options.num_threads = cli["threads"].as<unsigned int>();
     LOG_INFO << "Selected: Using threads: " << options.num_threads;
@@ -393,6 +506,23 @@ int main(int argc, char** argv)
     exit_epa();
   }
 
+  // splitting the queries across ranks needs random access, the rest streams them
+  int num_ranks = 1;
+  int rank = 0;
+  MPI_COMM_SIZE(MPI_COMM_WORLD, &num_ranks);
+  MPI_COMM_RANK(MPI_COMM_WORLD, &rank);
+  if (num_ranks > 1 and not pipeline and not Binary_Fasta::is_bfast(query_file)) {
+    LOG_INFO << "This appears to be a non-binary fasta file. Converting!";
+    // once, for all ranks
+    const auto fasta_file = query_file;
+    query_file = work_dir + split_by_delimiter(fasta_file, "/").back() + ".bin";
+    if (rank == 0) {
+      Binary_Fasta::fasta_to_bfast(fasta_file, work_dir, options.num_threads);
+    }
+    MPI_BARRIER(MPI_COMM_WORLD);
+    LOG_INFO << "Updated Query file: " << query_file;
+  }
+
   // start the placement process and write to file
   auto start = std::chrono::high_resolution_clock::now();
   if (pipeline) {
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+#include "util/Options.hpp"
+
+/**
+ * Parameters of the candidate selection following the preplacement, as applied by
+ * discard_by_accumulated_threshold / discard_bottom_x_percent.
+ */
+struct Candidate_Filter
+{
+  Candidate_Filter(const Options& options, const size_t num_placements)
+    : by_percentage(options.prescoring_by_percentage)
+    , threshold(options.prescoring_threshold)
+    , min(options.filter_min)
+    , max(options.filter_max)
+    , num_placements(num_placements)
+  { }
+
+  bool by_percentage;
+  // accumulated LWR, or fraction of placements to keep
+  double threshold;
+  size_t min;
+  size_t max;
+  // placements per query, i.e. the number of branches every query is scored on
+  size_t num_placements;
+};
+
+/**
+ * Bounded candidate set of one query during preplacement. Instead of keeping every
+ * placement until the candidate selection, it keeps a running log-sum-exp over all
+ * placements seen, and only those placements that may still pass the filter.
+ *
+ * A placement is dropped once it provably cannot be selected, no matter what the
+ * placements not seen yet look like: every one of them is either better (which only
+ * pushes it further down), or at most as likely as the placement itself. Thus,
+ * select() gives the same candidates as filtering the complete set.
+ *
+ * Sets built from disjoint parts of the placements of a query (e.g. per thread) can
+ * be merged.
+ */
+template <class T>
+class Candidates
+{
+public:
+  Candidates() = default;
+  ~Candidates() = default;
+
+  void add(const T& placement, const Candidate_Filter& filter)
+  {
+    add_mass_(placement.likelihood(), 1.0);
+    ++seen_;
+    candidates_.push_back(placement);
+
+    if (candidates_.size() >= prune_at_) {
+      prune_(filter);
+    }
+  }
+
+  void merge(Candidates&& other, const Candidate_Filter& filter)
+  {
+    if (other.seen_ == 0) {
+      return;
+    }
+    add_mass_(other.max_logl_, other.scaled_sum_);
+    seen_ += other.seen_;
+    candidates_.insert(candidates_.end(), other.candidates_.begin(), other.candidates_.end());
+    other.candidates_.clear();
+
+    prune_(filter);
+  }
+
+  // the candidates that pass the filter, best first. Requires all placements to be added
+  std::vector<T> select(const Candidate_Filter& filter)
+  {
+    if (seen_ != filter.num_placements) {
+      throw std::runtime_error{"Bounded candidate selection requires every query to be "
+        "scored against every branch!"};
+    }
+
+    sort_();
+
+    size_t num_keep = 0;
+    if (filter.by_percentage) {
+      num_keep = keep_by_percentage_(filter);
+    } else {
+      // as in discard_by_accumulated_threshold
+      double sum = 0.0;
+      while (num_keep < candidates_.size() and num_keep < filter.max and sum < filter.threshold) {
+        sum += std::exp(candidates_[num_keep].likelihood() - max_logl_) / scaled_sum_;
+        ++num_keep;
+      }
+      // (which pads up to min - 1 placements)
+      const size_t pad = filter.min ? filter.min - 1 : 0;
+      num_keep = std::max(num_keep, std::min(pad, candidates_.size()));
+    }
+
+    candidates_.resize(std::min(num_keep, candidates_.size()));
+    return std::move(candidates_);
+  }
+
+  size_t size() const { return candidates_.size(); }
+  size_t seen() const { return seen_; }
+
+private:
+  // adds mass * exp(logl) to the running sum, which is kept relative to the max. logl
+  void add_mass_(const double logl, const double mass)
+  {
+    if (logl > max_logl_) {
+      scaled_sum_ = scaled_sum_ * std::exp(max_logl_ - logl) + mass;
+      max_logl_ = logl;
+    } else {
+      scaled_sum_ += mass * std::exp(logl - max_logl_);
+    }
+  }
+
+  void sort_()
+  {
+    std::sort(candidates_.begin(), candidates_.end(),
+      [](const T& lhs, const T& rhs) {
+        return lhs.likelihood() > rhs.likelihood()
+          or (lhs.likelihood() == rhs.likelihood() and lhs.branch_id() < rhs.branch_id());
+      });
+  }
+
+  size_t keep_by_percentage_(const Candidate_Filter& filter) const
+  {
+    // as in discard_bottom_x_percent
+    const double x = 1.0 - filter.threshold;
+    return static_cast<size_t>(std::ceil((1.0 - x) * static_cast<double>(filter.num_placements)));
+  }
+
+  void prune_(const Candidate_Filter& filter)
+  {
+    sort_();
+
+    const double remaining = (filter.num_placements > seen_)
+                           ? static_cast<double>(filter.num_placements - seen_)
+                           : 0.0;
+
+    size_t cut = candidates_.size();
+    if (filter.by_percentage) {
+      cut = std::min(cut, keep_by_percentage_(filter));
+    } else {
+      cut = std::min(cut, filter.max);
+
+      // placement j is dropped if the ones ranked before it already exceed the threshold,
+      // even if all remaining placements were as likely as j itself (relative to max_logl_,
+      // with some slack for rounding)
+      const double thresh = filter.threshold;
+      double better = 0.0;
+      for (size_t j = 0; j < cut; ++j) {
+        const double mass = std::exp(candidates_[j].likelihood() - max_logl_);
+        if (j >= filter.min
+          and better * (1.0 - thresh) > thresh * (scaled_sum_ - better + remaining * mass)
+                                        * (1.0 + 1e-9)) {
+          cut = j;
+          break;
+        }
+        better += mass;
+      }
+    }
+    candidates_.resize(std::max(cut, std::min(filter.min, candidates_.size())));
+
+    prune_at_ = std::max(static_cast<size_t>(min_prune_at_), 2 * candidates_.size());
+  }
+
+  static constexpr size_t min_prune_at_ = 64;
+
+  double max_logl_ = -std::numeric_limits<double>::infinity();
+  double scaled_sum_ = 0.0;
+  size_t seen_ = 0;
+  std::vector<T> candidates_;
+  size_t prune_at_ = min_prune_at_;
+};
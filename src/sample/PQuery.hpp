@@ -5,7 +5,6 @@
 
 #include <cereal/types/vector.hpp>
 
-#include "seq/Sequence.hpp"
 #include "sample/Placement.hpp"
 
 template <class Placement_Type>
@@ -33,11 +32,6 @@ public:
       placements_[i] = Placement(other.at(i));
     }
   }
-  PQuery (const seqid_type seq_id,
-          const std::string& header)
-    : sequence_id_(seq_id)
-    , header_(header)
-  { }
   PQuery (const seqid_type seq_id)
     : sequence_id_(seq_id) 
   { }
@@ -60,7 +54,6 @@ public:
   value_type& back() { return placements_.back(); }
   inline seqid_type sequence_id() const { return sequence_id_; }
   inline void sequence_id(const seqid_type seq_id) { sequence_id_ = seq_id; }
-  std::string header() const { return header_; }
   double entropy() const { return entropy_; }
   void entropy(const double e) { entropy_ = e; }
   unsigned int size() const { return placements_.size(); }
@@ -97,10 +90,9 @@ public:
 
   // serialization
   template<class Archive>
-  void serialize(Archive& ar) { ar( sequence_id_, header_, placements_ ); }
+  void serialize(Archive& ar) { ar( sequence_id_, placements_ ); }
 private:
   seqid_type sequence_id_ = 0;
-  std::string header_;
   std::vector<value_type> placements_;
   double entropy_ = -1.0;
 };
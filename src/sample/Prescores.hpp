@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <limits>
+#include <algorithm>
+
+#include "sample/Sample.hpp"
+
+/**
+ * Preplacement logl of the candidates of every query, relative to the best one of the
+ * query. Serves as the prior of the thorough placement (see Tiny_Tree::place,
+ * Blo_Pruner).
+ */
+class Prescores
+{
+public:
+  // branch id and logl gap
+  using entry_type = std::pair<unsigned int, double>;
+
+  Prescores() = default;
+
+  template <class T>
+  explicit Prescores(const Sample<T>& sample)
+  {
+    for (const auto& pq : sample) {
+      if (pq.sequence_id() >= gaps_.size()) {
+        gaps_.resize(pq.sequence_id() + 1);
+        best_.resize(pq.sequence_id() + 1, -std::numeric_limits<double>::infinity());
+      }
+      auto best = -std::numeric_limits<double>::infinity();
+      for (const auto& p : pq) {
+        best = std::max(best, p.likelihood());
+      }
+      best_[pq.sequence_id()] = best;
+      auto& gaps = gaps_[pq.sequence_id()];
+      for (const auto& p : pq) {
+        gaps.emplace_back(p.branch_id(), best - p.likelihood());
+      }
+      std::sort(gaps.begin(), gaps.end());
+    }
+  }
+
+  // 0 for candidates without a preplacement
+  double gap(const size_t seq_id, const unsigned int branch_id) const
+  {
+    if (seq_id >= gaps_.size()) {
+      return 0.0;
+    }
+    const auto& gaps = gaps_[seq_id];
+    const auto it = std::lower_bound(gaps.begin(), gaps.end(),
+                                     entry_type(branch_id, -std::numeric_limits<double>::infinity()));
+    return (it != gaps.end() and it->first == branch_id) ? it->second : 0.0;
+  }
+
+  // preplacement logl of the best candidate of a query, -inf for queries without any
+  double best(const size_t seq_id) const
+  {
+    return (seq_id < best_.size()) ? best_[seq_id] : -std::numeric_limits<double>::infinity();
+  }
+
+  // all candidates of a query, by branch id
+  const std::vector<entry_type>& candidates(const size_t seq_id) const
+  {
+    static const std::vector<entry_type> none;
+    return (seq_id < gaps_.size()) ? gaps_[seq_id] : none;
+  }
+
+private:
+  // per query, by branch id
+  std::vector<std::vector<entry_type>> gaps_;
+  std::vector<double> best_;
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <iterator>
+#include <algorithm>
+
+#include "core/Work.hpp"
+#include "sample/Sample.hpp"
+
+/**
+ * Results of placing a chunk, indexed directly by the (chunk-local, dense) sequence id.
+ *
+ * Every pair of the work parts gets its own preallocated slot up front, in the order of
+ * the parts, such that the workers placing them can write their results without any
+ * synchronization, and without searching for or merging the PQuerys afterwards.
+ */
+template <class T>
+class Result_Table
+{
+public:
+  Result_Table(const std::vector<Work>& parts, const size_t num_queries)
+    : slots_(num_queries)
+    , positions_(parts.size())
+  {
+    std::vector<size_t> counts(num_queries, 0);
+    for (size_t i = 0; i < parts.size(); ++i) {
+      positions_[i].reserve(parts[i].size());
+      for (const auto& it : parts[i]) {
+        positions_[i].push_back(counts[it.sequence_id]++);
+      }
+    }
+    for (size_t seq_id = 0; seq_id < num_queries; ++seq_id) {
+      slots_[seq_id].resize(counts[seq_id]);
+    }
+  }
+  Result_Table() = delete;
+  ~Result_Table() = default;
+
+  Result_Table(Result_Table const&) = delete;
+  Result_Table& operator=(Result_Table const&) = delete;
+
+  size_t size() const { return slots_.size(); }
+
+  // slot of the <k>-th pair of part <part>, whose sequence id is <seq_id>
+  T& at(const size_t part, const size_t k, const size_t seq_id)
+  {
+    return slots_[seq_id][positions_[part][k]];
+  }
+
+  /**
+   * Moves the results into <sample>, whose sequence ids are offset by <seq_id_offset>
+   * against the ones of the table. Results of queries that already have a PQuery in
+   * <sample> are appended to it, the others get a new one.
+   */
+  void flush(Sample<T>& sample, const size_t seq_id_offset)
+  {
+    const auto none = std::numeric_limits<size_t>::max();
+    std::vector<size_t> existing(slots_.size(), none);
+    for (size_t i = 0; i < sample.size(); ++i) {
+      const auto seq_id = sample[i].sequence_id() - seq_id_offset;
+      if (sample[i].sequence_id() >= seq_id_offset and seq_id < slots_.size()) {
+        existing[seq_id] = i;
+      }
+    }
+
+    for (size_t seq_id = 0; seq_id < slots_.size(); ++seq_id) {
+      auto& slot = slots_[seq_id];
+      if (slot.empty()) {
+        continue;
+      }
+
+      if (existing[seq_id] != none) {
+        auto& placements = sample[existing[seq_id]].data();
+        placements.reserve(placements.size() + slot.size());
+        std::move(slot.begin(), slot.end(), std::back_inserter(placements));
+      } else {
+        sample.emplace_back(seq_id_offset + seq_id);
+        sample.back().data() = std::move(slot);
+      }
+      slot = std::vector<T>();
+    }
+  }
+
+private:
+  // placements of every query
+  std::vector<std::vector<T>> slots_;
+  // position within its query's slot, of every pair of every part
+  std::vector<std::vector<size_t>> positions_;
+};
@@ -2,6 +2,7 @@
 
 #include <string>
 #include <vector>
+#include <unordered_map>
 #include <algorithm>
 #include <type_traits>
 
@@ -47,11 +48,11 @@ public:
   value_type& back() { return pquerys_.back(); }
   unsigned int size() const { return pquerys_.size(); }
   const std::string& newick() const { return newick_; }
-  void clear() { pquerys_.clear(); }
+  void clear() { pquerys_.clear(); reset_index_(); }
   void push_back(value_type&& pq) { pquerys_.push_back(pq); }
   void push_back(value_type& pq) { pquerys_.push_back(pq); }
   void push_back(const value_type& pq) { pquerys_.push_back(pq); }
-  void erase(iterator begin, iterator end) { pquerys_.erase(begin, end); }
+  void erase(iterator begin, iterator end) { pquerys_.erase(begin, end); reset_index_(); }
 
   // needs to be in the header
   template <typename ...Args>
@@ -59,20 +60,18 @@ public:
   template <class InputIt>
   void insert(InputIt first, InputIt last) {pquerys_.insert(pquerys_.end(), first, last);}
 
+  // adds a placement to the pquery of <seq_id>, which is created if there is none yet
   template <typename ...Args>
   void add_placement( const size_t seq_id,
-                      const std::string& label,
                       Args&& ...args)
   {
-    // if seq_id in pquerys_
-    auto iter = std::end(pquerys_);
-    if ((iter = std::find(std::begin(pquerys_), std::end(pquerys_), value_type(seq_id))) 
-      != std::end(pquerys_)) {
-      iter->emplace_back(std::forward<Args>(args)...);
-    } else {
-      pquerys_.emplace_back(seq_id, label);
-      pquerys_.back().emplace_back(std::forward<Args>(args)...);
+    const auto pos = find_(seq_id);
+    if (pos == pquerys_.size()) {
+      pquerys_.emplace_back(seq_id);
+      index_[seq_id] = pos;
+      indexed_ = pquerys_.size();
     }
+    pquerys_[pos].emplace_back(std::forward<Args>(args)...);
   }
 
   // Iterator Compatibility
@@ -90,9 +89,37 @@ public:
   // serialization
   template <class Archive>
   void serialize(Archive & ar) 
-  { ar( *static_cast<Token*>( this ), pquerys_, newick_ ); }
+  { ar( *static_cast<Token*>( this ), pquerys_, newick_ ); reset_index_(); }
 
 private:
+  void reset_index_()
+  {
+    index_.clear();
+    indexed_ = 0;
+  }
+
+  // position of the pquery of <seq_id> (the last one, if there are several), or size()
+  size_t find_(const size_t seq_id)
+  {
+    // pquerys added other than through add_placement
+    for (; indexed_ < pquerys_.size(); ++indexed_) {
+      index_[pquerys_[indexed_].sequence_id()] = indexed_;
+    }
+
+    auto iter = index_.find(seq_id);
+    if (iter != index_.end()
+        and (iter->second >= pquerys_.size()
+          or pquerys_[iter->second].sequence_id() != seq_id)) {
+      // changed through element access: start over
+      reset_index_();
+      return find_(seq_id);
+    }
+    return iter != index_.end() ? iter->second : pquerys_.size();
+  }
+
   std::vector<value_type> pquerys_;
   std::string newick_;
+  // position in pquerys_ by sequence id, covering the first <indexed_> of them
+  std::unordered_map<size_t, size_t> index_;
+  size_t indexed_ = 0;
 };
@@ -0,0 +1,55 @@
+#include "seq/Encoded_MSA.hpp"
+
+#include <stdexcept>
+
+unsigned char * Encoded_MSA::append(const char * header,
+                                    const size_t header_size,
+                                    const size_t num_sites)
+{
+  const auto i = size();
+  if (i == 0) {
+    num_sites_ = num_sites;
+  } else if (num_sites != num_sites_) {
+    throw std::runtime_error{std::string("Tried to insert sequence to MSA of unequal length: ")
+      + std::string(header, header_size)};
+  }
+
+  labels_.append(i, header, header_size);
+  states_.resize((i + 1) * num_sites_);
+
+  return &states_[i * num_sites_];
+}
+
+void Encoded_MSA::reserve(const size_t num_sequences)
+{
+  if (num_sites_) {
+    states_.reserve(num_sequences * num_sites_);
+  }
+}
+
+void Encoded_MSA::clear()
+{
+  labels_.clear();
+  states_.clear();
+  ranges_.clear();
+}
+
+void Encoded_MSA::compute_ranges(const unsigned char gap_state)
+{
+  ranges_.resize(size());
+
+  for (size_t i = 0; i < size(); ++i) {
+    const auto seq = (*this)[i];
+
+    size_t first = 0;
+    while (first < num_sites_ and seq[first] == gap_state) {
+      ++first;
+    }
+    size_t last = num_sites_;
+    while (last > first and seq[last - 1] == gap_state) {
+      --last;
+    }
+
+    ranges_[i] = (first < last) ? range_type(first, last) : range_type(0, 0);
+  }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "seq/Label_Store.hpp"
+
+/**
+ * A chunk of query sequences, stored as one state index (column of the
+ * Lookup_Store tables) per site, all sequences contiguous in one buffer.
+ * Sequences are translated once on ingestion, instead of once per branch they
+ * are scored against. The headers are interned in a Label_Store, by index within the
+ * chunk.
+ */
+class Encoded_MSA
+{
+public:
+  // half-open range of sites [first, second)
+  using range_type = std::pair<size_t, size_t>;
+
+  Encoded_MSA(const size_t num_sites) : num_sites_(num_sites) {};
+  Encoded_MSA() : num_sites_(0) {};
+  ~Encoded_MSA() = default;
+
+  Encoded_MSA(Encoded_MSA const& other) = default;
+  Encoded_MSA(Encoded_MSA&& other) = default;
+  Encoded_MSA& operator= (Encoded_MSA const& other) = default;
+  Encoded_MSA& operator= (Encoded_MSA && other) = default;
+
+  // appends a sequence of the given length and returns its state buffer, to be filled
+  // by the caller. Only valid until the next append
+  unsigned char * append(const char * header, const size_t header_size, const size_t num_sites);
+  unsigned char * append(const std::string& header, const size_t num_sites)
+  {
+    return append(header.data(), header.size(), num_sites);
+  }
+  void reserve(const size_t num_sequences);
+  void clear();
+
+  // determines the non-gap span of every sequence (first to last non-gap site).
+  // Empty for sequences consisting only of gaps
+  void compute_ranges(const unsigned char gap_state);
+
+  // getters
+  size_t size() const {return labels_.size();}
+  size_t num_sites() const {return num_sites_;}
+  const char * header(const size_t i) const {return labels_[i];}
+  const Label_Store& labels() const {return labels_;}
+  const unsigned char * operator[](const size_t i) const {return states_.data() + i * num_sites_;}
+  bool has_ranges() const {return not labels_.empty() and ranges_.size() == labels_.size();}
+  const range_type& range(const size_t i) const {return ranges_[i];}
+
+private:
+  size_t num_sites_;
+  Label_Store labels_;
+  std::vector<unsigned char> states_;
+  std::vector<range_type> ranges_;
+};
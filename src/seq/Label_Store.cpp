@@ -0,0 +1,113 @@
+#include "seq/Label_Store.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+void Label_Store::append(const size_t seq_id, const char * label, const size_t size)
+{
+  if (not blocks_.empty() and blocks_.back().offsets.empty()) {
+    // left by clear()
+    blocks_.back().first = seq_id;
+  } else if (blocks_.empty() or blocks_.back().end() != seq_id) {
+    if (not blocks_.empty() and seq_id < blocks_.back().end()) {
+      throw std::runtime_error{std::string("Labels have to be added in order of sequence id: ")
+        + std::string(label, size)};
+    }
+    blocks_.emplace_back();
+    blocks_.back().first = seq_id;
+  }
+
+  auto& block = blocks_.back();
+  block.offsets.push_back(block.labels.size());
+  block.labels.append(label, size);
+  block.labels.push_back('\0');
+  ++size_;
+}
+
+void Label_Store::append(const Label_Store& other, const size_t seq_id_offset)
+{
+  for (const auto& block : other.blocks_) {
+    if (block.offsets.empty()) {
+      continue;
+    }
+    const auto first = block.first + seq_id_offset;
+    if (not blocks_.empty() and blocks_.back().offsets.empty()) {
+      blocks_.back().first = first;
+    }
+    if (not blocks_.empty() and first < blocks_.back().end()) {
+      throw std::runtime_error{"Labels have to be added in order of sequence id!"};
+    }
+
+    if (not blocks_.empty() and blocks_.back().end() == first) {
+      // continues the last run: join the buffers
+      auto& back = blocks_.back();
+      const auto base = back.labels.size();
+      back.labels.append(block.labels);
+      back.offsets.reserve(back.offsets.size() + block.offsets.size());
+      for (const auto offset : block.offsets) {
+        back.offsets.push_back(base + offset);
+      }
+    } else {
+      blocks_.push_back(block);
+      blocks_.back().first = first;
+    }
+    size_ += block.offsets.size();
+  }
+}
+
+void Label_Store::merge(Label_Store&& other)
+{
+  blocks_.reserve(blocks_.size() + other.blocks_.size());
+  std::move(other.blocks_.begin(), other.blocks_.end(), std::back_inserter(blocks_));
+  size_ += other.size_;
+  other.clear();
+
+  blocks_.erase(std::remove_if(blocks_.begin(), blocks_.end(),
+                               [](const Block& block) { return block.offsets.empty(); }),
+                blocks_.end());
+
+  std::sort(blocks_.begin(), blocks_.end(),
+    [](const Block& lhs, const Block& rhs) { return lhs.first < rhs.first; });
+
+  for (size_t i = 1; i < blocks_.size(); ++i) {
+    if (blocks_[i].first < blocks_[i - 1].end()) {
+      throw std::runtime_error{"Tried to merge labels of overlapping sequence ids!"};
+    }
+  }
+}
+
+void Label_Store::clear()
+{
+  if (blocks_.size() > 1) {
+    blocks_.resize(1);
+  }
+  if (not blocks_.empty()) {
+    blocks_[0].first = 0;
+    blocks_[0].labels.clear();
+    blocks_[0].offsets.clear();
+  }
+  size_ = 0;
+}
+
+const Label_Store::Block * Label_Store::find_(const size_t seq_id) const
+{
+  // last block starting at or before the id
+  auto it = std::upper_bound(blocks_.begin(), blocks_.end(), seq_id,
+    [](const size_t id, const Block& block) { return id < block.first; });
+  if (it == blocks_.begin()) {
+    return nullptr;
+  }
+  --it;
+  return (seq_id < it->end()) ? &(*it) : nullptr;
+}
+
+const char * Label_Store::operator[](const size_t seq_id) const
+{
+  const auto block = find_(seq_id);
+  if (not block) {
+    throw std::runtime_error{std::string("No label for sequence id ")
+      + std::to_string(seq_id)};
+  }
+  return block->labels.data() + block->offsets[seq_id - block->first];
+}
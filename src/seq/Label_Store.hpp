@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <cereal/types/vector.hpp>
+#include <cereal/types/string.hpp>
+
+/**
+ * Labels (FASTA headers) of query sequences by sequence id, interned in one buffer per
+ * run of consecutive ids rather than one string per sequence.
+ *
+ * Placement results only carry sequence ids; the labels are looked up when writing
+ * the output.
+ */
+class Label_Store
+{
+public:
+  Label_Store() = default;
+  ~Label_Store() = default;
+
+  Label_Store(Label_Store const& other) = default;
+  Label_Store(Label_Store&& other) = default;
+  Label_Store& operator= (Label_Store const& other) = default;
+  Label_Store& operator= (Label_Store && other) = default;
+
+  // adds the label of <seq_id>. Ids have to be added in ascending order
+  void append(const size_t seq_id, const char * label, const size_t size);
+  void append(const size_t seq_id, const std::string& label)
+  {
+    append(seq_id, label.data(), label.size());
+  }
+  // adds all labels of <other>, with their sequence ids offset by <seq_id_offset>
+  void append(const Label_Store& other, const size_t seq_id_offset);
+  // takes over the labels of <other>, whose ids must not overlap with the ones here
+  void merge(Label_Store&& other);
+
+  // null-terminated label of <seq_id>
+  const char * operator[](const size_t seq_id) const;
+  bool contains(const size_t seq_id) const { return find_(seq_id) != nullptr; }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  // keeps the buffers of the first run, for the next one
+  void clear();
+
+  // serialization
+  template <class Archive>
+  void serialize(Archive& ar) { ar( blocks_, size_ ); }
+
+private:
+  // labels of the ids [first, first + offsets.size()), separated by '\0'
+  struct Block
+  {
+    size_t first = 0;
+    std::string labels;
+    std::vector<size_t> offsets;
+
+    size_t end() const { return first + offsets.size(); }
+
+    template <class Archive>
+    void serialize(Archive& ar) { ar( first, labels, offsets ); }
+  };
+
+  const Block * find_(const size_t seq_id) const;
+
+  // sorted by first id
+  std::vector<Block> blocks_;
+  size_t size_ = 0;
+};
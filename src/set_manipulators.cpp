@@ -13,34 +13,35 @@ void split( const Work& src,
 {
   parts.clear();
   // ensure that there are actually as many parts as specified. We want empty parts to enable null messages
-  parts.resize(num_parts);
+  parts.reserve(num_parts);
 
   const size_t ext_size = (src.size() - (src.size() % num_parts)) + num_parts;
   const size_t chunk_size = ext_size / num_parts;
 
-  size_t i = 0;
-  size_t bucket = 0;
-  for (auto it : src) {
-    parts[bucket].add(it);
-    if(++i % chunk_size == 0) bucket++;
+  // the parts are views onto consecutive ranges of the source
+  for (size_t i = 0; i < num_parts; ++i) {
+    const auto first = std::min(i * chunk_size, src.size());
+    const auto last = std::min(first + chunk_size, src.size());
+    parts.push_back(src.slice(first, last));
+    parts.back().status(token_status::DATA);
   }
 }
 
 
 void merge(Work& dest, const Work& src)
 {
-  auto prev_branch_id = (*src.begin()).branch_id + 1;
-  for (auto it : src)  {
-    const auto branch_id = it.branch_id;
-    if (prev_branch_id != branch_id) {
-      dest[branch_id];
-      dest[branch_id].insert( dest.at(branch_id).end(),
-                              src.at(branch_id).begin(), 
-                              src.at(branch_id).end()
-                            );
-    }
-    prev_branch_id = branch_id;
+  std::vector<Work::Work_Pair> pairs;
+  pairs.reserve(dest.size() + src.size());
+  for (auto it : dest) {
+    pairs.push_back(it);
   }
+  for (auto it : src) {
+    pairs.push_back(it);
+  }
+
+  const auto status = dest.status();
+  dest = Work(pairs);
+  dest.status(status);
 }
 
 void merge(Timer<>& dest, const Timer<>& src)
@@ -48,6 +49,11 @@ void merge(Timer<>& dest, const Timer<>& src)
   dest.insert(dest.end(), src.begin(), src.end());
 }
 
+void merge(Label_Store& dest, Label_Store&& src)
+{
+  dest.merge(std::move(src));
+}
+
 void compute_and_set_lwr(Sample<Placement>& sample)
 {
   #ifdef __OMP
@@ -76,8 +82,11 @@ void compute_and_set_lwr(Sample<Placement>& sample)
     for (auto &p : pq) {
       double lwr = std::exp(p.likelihood() - max) / total;
       p.lwr(lwr);
-      // compute the shannon entropy of the query (in nats)
-      entropy -= (lwr * std::log(lwr));
+      // compute the shannon entropy of the query (in nats). Placements whose weight
+      // underflows add nothing, instead of turning it into NaN
+      if (lwr > 0.0) {
+        entropy -= (lwr * std::log(lwr));
+      }
     }
 
     pq.entropy(entropy);
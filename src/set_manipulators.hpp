@@ -7,6 +7,7 @@
 #include "sample/Sample.hpp"
 #include "util/Timer.hpp"
 #include "seq/MSA.hpp"
+#include "seq/Label_Store.hpp"
 #include "core/Work.hpp"
 
 /**
@@ -132,7 +133,7 @@ void merge(Sample<T>& dest, const Sample<T>& src)
     auto input_iter = find(dest.begin(), dest.end(), pquery);
     // if not, create a record
     if (input_iter == dest.end()) {
-      dest.emplace_back(pquery.sequence_id(), pquery.header());
+      dest.emplace_back(pquery.sequence_id());
       input_iter = --(dest.end());
     }
     // then concat their vectors
@@ -176,6 +177,7 @@ void merge(std::vector<T>& dest, const std::vector<T>& parts)
 }
 
 void merge(Work& dest, const Work& src);
+void merge(Label_Store& dest, Label_Store&& src);
 void merge(Timer<>& dest, const Timer<>& src);
 
 void compute_and_set_lwr(Sample<Placement>& sample);
@@ -6,6 +6,9 @@
 
 #include <vector>
 #include <numeric>
+#include <algorithm>
+#include <cmath>
+#include <functional>
 
 #include "tree/tiny_util.hpp"
 #include "core/pll/pll_util.hpp"
@@ -15,44 +18,58 @@
 #include "set_manipulators.hpp"
 #include "util/logging.hpp"
 
-static void precompute_sites_static(char nt,
-                                    std::vector<double>& result,
-                                    pll_partition_t * const partition,
-                                    pll_utree_t const * const tree)
+/**
+ * State shared by the BLO of a block of queries on the tree. Every query starts from the
+ * original state of the tree, in which the partial toward the new tip is always the same:
+ * for blocks of several queries, it is saved once and copied back after each query,
+ * instead of being recomputed.
+ */
+struct Tiny_Tree::Blo_Block
 {
-  const size_t sites  = partition->sites;
-  const auto new_tip  = tree->nodes[2];
-  const auto inner    = new_tip->back;
-  result.clear();
-  result.resize(sites);
-  std::string seq(sites, nt);
-
-  std::vector<unsigned int> param_indices(partition->rate_cats, 0);
-
-  auto map = get_char_map(partition);
-
-  auto err_check = pll_set_tip_states(partition, 
-                                      new_tip->clv_index, 
-                                      map,
-                                      seq.c_str());
-
-  if (err_check == PLL_FAILURE) {
-    throw std::runtime_error{
-      std::string("Set tip states during sites precompution failed! pll_errmsg: ")
-      + pll_errmsg
-    };
+  Blo_Block(pll_partition_t const * const partition, const bool keep_partial)
+    : workspace(partition)
+    , keep_partial(keep_partial)
+  { }
+
+  void save(pll_partition_t const * const partition, pll_unode_t const * const inner)
+  {
+    // the CLVs of site repeats vary in size
+    if (not keep_partial or (partition->attributes & PLL_ATTRIB_SITE_REPEATS)) {
+      return;
+    }
+
+    auto sites_alloc = partition->sites;
+    if (partition->attributes & PLL_ATTRIB_AB_FLAG) {
+      sites_alloc += partition->states;
+    }
+
+    const auto clv = partition->clv[inner->clv_index];
+    this->clv.assign(clv, clv + sites_alloc * partition->states_padded * partition->rate_cats);
+
+    if (inner->scaler_index != PLL_SCALE_BUFFER_NONE) {
+      const auto scaler = partition->scale_buffer[inner->scaler_index];
+      const auto scaler_size = (partition->attributes & PLL_ATTRIB_RATE_SCALERS)
+                             ? sites_alloc * partition->rate_cats : sites_alloc;
+      this->scaler.assign(scaler, scaler + scaler_size);
+    }
+    saved = true;
   }
 
-  pll_compute_edge_loglikelihood( partition,
-                                  new_tip->clv_index,
-                                  PLL_SCALE_BUFFER_NONE, 
-                                  inner->clv_index,
-                                  inner->scaler_index,
-                                  inner->pmatrix_index,
-                                  &param_indices[0], 
-                                  &result[0]);
-}
+  void restore(pll_partition_t * const partition, pll_unode_t const * const inner) const
+  {
+    assert(saved);
+    std::copy(clv.begin(), clv.end(), partition->clv[inner->clv_index]);
+    if (inner->scaler_index != PLL_SCALE_BUFFER_NONE) {
+      std::copy(scaler.begin(), scaler.end(), partition->scale_buffer[inner->scaler_index]);
+    }
+  }
 
+  Blo_Workspace workspace;
+  bool keep_partial;
+  bool saved = false;
+  std::vector<double> clv;
+  std::vector<unsigned int> scaler;
+};
 
 Tiny_Tree::Tiny_Tree( pll_unode_t * edge_node, 
                       const unsigned int branch_id, 
@@ -64,6 +81,7 @@ Tiny_Tree::Tiny_Tree( pll_unode_t * edge_node,
   , tree_(nullptr, utree_destroy)
   , opt_branches_(opt_branches)
   , sliding_blo_(options.sliding_blo)
+  , blo_priors_(opt_branches and options.blo_priors)
   , branch_id_(branch_id)
   , lookup_(lookup_store)
 {
@@ -99,58 +117,72 @@ Tiny_Tree::Tiny_Tree( pll_unode_t * edge_node,
                                                     tip_tip_case_),
                                 tiny_partition_destroy);
 
-  // operation for computing the clv toward the new tip (for initialization and logl in non-blo case)
-  auto proximal = tree_->nodes[0];
-  auto distal   = tree_->nodes[1];
-  auto inner    = tree_->nodes[3];
+  // compute the clv toward the new tip (for initialization and logl in non-blo case)
+  init_tiny_partials(partition_.get(), tree_.get());
 
-  pll_operation_t op;
-  op.parent_clv_index = inner->clv_index;
-  op.child1_clv_index = distal->clv_index;
-  op.child1_scaler_index = distal->scaler_index;
-  op.child2_clv_index = proximal->clv_index;
-  op.child2_scaler_index = proximal->scaler_index;
-  op.parent_scaler_index = inner->scaler_index;
-  op.child1_matrix_index = distal->pmatrix_index;
-  op.child2_matrix_index = proximal->pmatrix_index;
-
-  // wether heuristic is used or not, this is the initial branch length configuration
-  double branch_lengths[3] = {proximal->length, distal->length, inner->length};
-  unsigned int matrix_indices[3] = {proximal->pmatrix_index, distal->pmatrix_index, inner->pmatrix_index};
-
-  // use branch lengths to compute the probability matrices
-  std::vector<unsigned int> param_indices(reference_tree.partition()->rate_cats, 0);
-  pll_update_prob_matrices( partition_.get(), 
-                            &param_indices[0], 
-                            matrix_indices, 
-                            branch_lengths, 
-                            3);
-
-  // use update_partials to compute the clv pointing toward the new tip
-  pll_update_partials(partition_.get(), &op, 1);
+  if (blo_priors_) {
+    consensus_ = insertion_consensus(partition_.get(), tree_.get());
+  }
+
+  // ranged BLO shifts the partition to the range of the query, which the per-node
+  // site ids of the repeats do not allow for. The gap sites outside of the range are
+  // added as computed at the original branch lengths, which only holds as long as the
+  // distal and proximal lengths keep their sum, as with the sliding BLO
+  ranged_ = opt_branches and options.ranged and options.sliding_blo
+          and not (partition_->attributes & PLL_ATTRIB_SITE_REPEATS);
+
+  if (ranged_) {
+    // gap sites outside of the range contribute the logl of an all-gap query
+    std::vector<double> gap_sitelk;
+    precompute_sites_static('-', gap_sitelk, partition_.get(), tree_.get());
+    gap_prefix_.resize(gap_sitelk.size() + 1, 0.0);
+    std::partial_sum(gap_sitelk.begin(), gap_sitelk.end(), gap_prefix_.begin() + 1);
+  }
 
-  if (not opt_branches) {
+  if (not opt_branches and not lookup_store->complete()) {
     const std::lock_guard<std::mutex> lock(lookup_store->get_mutex(branch_id));
 
     if (not lookup_store->has_branch(branch_id)) {
-      const auto size = lookup_store->char_map_size();
-
       // precompute all possible site likelihoods
-      std::vector<std::vector<double>> precomputed_sites(size);
-      for (size_t i = 0; i < size; ++i) {
-        precompute_sites_static(lookup_store->char_map(i),
-                                precomputed_sites[i],
-                                partition_.get(),
-                                tree_.get());
-      }
-      lookup_store->init_branch(branch_id, precomputed_sites);
+      lookup_store->init_branch(branch_id, precompute_sites(*lookup_store,
+                                                            partition_.get(),
+                                                            tree_.get()));
     }
+    lookup_pin_ = lookup_store->pin(branch_id);
   }
   
 }
 
 Placement Tiny_Tree::place(const Sequence &s) 
 {
+  assert(tree_);
+
+  if (not opt_branches_) {
+    return Placement( branch_id_,
+                      lookup_->sum_precomputed_sitelk(branch_id_, s.sequence()),
+                      tree_->nodes[3]->length,
+                      tree_->nodes[1]->length);
+  }
+
+  const auto& seq = s.sequence();
+  range_type range(0, seq.size());
+  if (ranged_) {
+    const auto first = seq.find_first_not_of('-');
+    range = (first == std::string::npos)
+          ? range_type(0, 0)
+          : range_type(first, seq.find_last_not_of('-') + 1);
+  }
+
+  Blo_Block block(partition_.get(), false);
+  return place_blo_(seq.c_str(), range, block);
+}
+
+Placement Tiny_Tree::place_blo_(const char * seq,
+                                const range_type& range,
+                                Blo_Block& block,
+                                const double tolerance)
+{
+  assert(opt_branches_);
   assert(partition_);
   assert(tree_);
 
@@ -162,9 +194,16 @@ Placement Tiny_Tree::place(const Sequence &s)
   auto distal_length = distal->length;
   auto pendant_length = inner->length;
   double logl = 0.0;
-  std::vector<unsigned int> param_indices(partition_->rate_cats, 0);
 
-  if (opt_branches_) {
+  const size_t sites = partition_->sites;
+  const size_t span = range.second - range.first;
+  // ranged: the partition covers the informative range only, for the duration of the BLO
+  const bool shifted = ranged_ and span != sites;
+
+  if (shifted and span == 0) {
+    // nothing to optimize for a sequence consisting only of gaps
+    logl = gap_prefix_[sites];
+  } else {
 
     /* differentiate between the normal case and the tip tip case:
       in the normal case we want to compute the partial toward the newly placed sequence.
@@ -182,17 +221,52 @@ Placement Tiny_Tree::place(const Sequence &s)
       // virtual_root = tree_->next->next;
     }
 
-    // init the new tip with s.sequence(), branch length
+    if (blo_priors_) {
+      // start from the estimated pendant length instead of the default one. The partial
+      // toward the new tip does not depend on it, only the matrix of the pendant branch
+      double guess = estimate_pendant_length( partition_.get(),
+                                              consensus_,
+                                              seq,
+                                              range.first,
+                                              range.second);
+      unsigned int matrix_index = inner->pmatrix_index;
+      std::vector<unsigned int> param_indices(partition_->rate_cats, 0);
+      inner->length = inner->back->length = guess;
+      pll_update_prob_matrices(partition_.get(), &param_indices[0], &matrix_index, &guess, 1);
+    }
+
+    if (shifted) {
+      shift_partition_focus(partition_.get(), range.first, span);
+    }
+
+    // init the new tip with the sequence, branch length
     auto err_check = pll_set_tip_states(partition_.get(), 
                                         new_tip->clv_index, 
                                         get_char_map(partition_.get()),
-                                        s.sequence().c_str());
+                                        seq + (shifted ? range.first : 0));
 
     if (err_check == PLL_FAILURE) {
       throw std::runtime_error{"Set tip states during placement failed!"};
     }
 
-    logl = optimize_branch_triplet(partition_.get(), virtual_root, sliding_blo_);
+    // the tree is in its original state, in which the partial toward the new tip is valid
+    logl = optimize_branch_triplet( partition_.get(),
+                                    virtual_root,
+                                    sliding_blo_,
+                                    &block.workspace,
+                                    true,
+                                    tolerance);
+
+    const auto iterations = block.workspace.iterations();
+    ++blo_stats_.optimized;
+    blo_stats_.iterations += iterations;
+    blo_stats_.max_iterations = std::max(blo_stats_.max_iterations, iterations);
+
+    if (shifted) {
+      shift_partition_focus(partition_.get(), -static_cast<int>(range.first), sites);
+      // the gap sites outside of the range, as computed for the original branch lengths
+      logl += gap_prefix_[range.first] + (gap_prefix_[sites] - gap_prefix_[range.second]);
+    }
 
     assert(inner->length >= 0);
     assert(inner->next->length >= 0);
@@ -204,28 +278,13 @@ Placement Tiny_Tree::place(const Sequence &s)
     distal_length = (original_branch_length_ / new_total_branch_length) * distal_length;
     pendant_length = inner->length;
 
-    reset_triplet_lengths(inner, 
-                          partition_.get(), 
-                          original_branch_length_);
-    
-    // re-update the partial
-    auto child1 = virtual_root->next->back;
-    auto child2 = virtual_root->next->next->back;
-
-    pll_operation_t op;
-    op.parent_clv_index = virtual_root->clv_index;
-    op.parent_scaler_index = virtual_root->scaler_index;
-    op.child1_clv_index = child1->clv_index;
-    op.child1_scaler_index = child1->scaler_index;
-    op.child1_matrix_index = child1->pmatrix_index;
-    op.child2_clv_index = child2->clv_index;
-    op.child2_scaler_index = child2->scaler_index;
-    op.child2_matrix_index = child2->pmatrix_index;
-
-    pll_update_partials(partition_.get(), &op, 1);
-
-  } else {
-    logl = lookup_->sum_precomputed_sitelk(branch_id_, s.sequence());
+    if (block.saved) {
+      reset_triplet_lengths(inner, partition_.get(), original_branch_length_);
+      block.restore(partition_.get(), inner);
+    } else {
+      reset();
+      block.save(partition_.get(), inner);
+    }
   }
 
   assert(distal_length <= original_branch_length_);
@@ -233,3 +292,163 @@ Placement Tiny_Tree::place(const Sequence &s)
 
   return Placement(branch_id_, logl, pendant_length, distal_length);
 }
+
+double Tiny_Tree::blo_tolerance_(const double logl_gap) const
+{
+  if (not blo_priors_) {
+    return OPT_BRANCH_EPSILON;
+  }
+  // the error a tolerance causes in the LWR of a placement shrinks with its weight, which
+  // is about exp(-logl_gap) of the best one of the query: scale it up by as much
+  return std::min(OPT_BRANCH_EPSILON * std::exp(std::max(logl_gap, 0.0)),
+                  OPT_BRANCH_EPSILON_MAX);
+}
+
+Blo_Stats Tiny_Tree::take_blo_stats()
+{
+  Blo_Stats stats;
+  std::swap(stats, blo_stats_);
+  return stats;
+}
+
+bool Tiny_Tree::logl_bounds(const Lookup_Store& lookup, Matrix<double>& table) const
+{
+  assert(partition_);
+  assert(tree_);
+  return precompute_bounds(lookup, table, partition_.get(), tree_.get());
+}
+
+void Tiny_Tree::reset()
+{
+  if (not opt_branches_) {
+    // lookups leave the tree untouched
+    return;
+  }
+
+  const auto inner = tree_->nodes[3];
+
+  reset_triplet_lengths(inner, 
+                        partition_.get(), 
+                        original_branch_length_);
+  
+  // re-update the partial
+  auto child1 = inner->next->back;
+  auto child2 = inner->next->next->back;
+
+  pll_operation_t op;
+  op.parent_clv_index = inner->clv_index;
+  op.parent_scaler_index = inner->scaler_index;
+  op.child1_clv_index = child1->clv_index;
+  op.child1_scaler_index = child1->scaler_index;
+  op.child1_matrix_index = child1->pmatrix_index;
+  op.child2_clv_index = child2->clv_index;
+  op.child2_scaler_index = child2->scaler_index;
+  op.child2_matrix_index = child2->pmatrix_index;
+
+  pll_update_partials(partition_.get(), &op, 1);
+}
+
+Placement Tiny_Tree::place(const unsigned char * states)
+{
+  return place(states, range_type(0, partition_->sites));
+}
+
+Placement Tiny_Tree::place(const unsigned char * states, const range_type& range)
+{
+  assert(tree_);
+
+  if (opt_branches_) {
+    std::string seq;
+    const auto blo_range = decode_(states, range, seq);
+    Blo_Block block(partition_.get(), false);
+    return place_blo_(seq.c_str(), blo_range, block);
+  }
+
+  const auto distal_length  = tree_->nodes[1]->length;
+  const auto pendant_length = tree_->nodes[3]->length;
+
+  const auto logl = lookup_->ranged()
+                    ? lookup_->sum_precomputed_sitelk(branch_id_, states, range)
+                    : lookup_->sum_precomputed_sitelk(branch_id_, states);
+
+  return Placement(branch_id_, logl, pendant_length, distal_length);
+}
+
+Tiny_Tree::range_type Tiny_Tree::decode_( const unsigned char * states,
+                                          const range_type& range,
+                                          std::string& seq) const
+{
+  // BLO operates on the character representation. Outside of the range, the
+  // sequence consists of gaps
+  seq.assign(partition_->sites, '-');
+  const auto first = ranged_ ? range.first : 0;
+  const auto last = ranged_ ? range.second : seq.size();
+  for (size_t i = first; i < last; ++i) {
+    seq[i] = lookup_->char_map(states[i]);
+  }
+  return range_type(first, last);
+}
+
+std::vector<Placement> Tiny_Tree::place(const std::vector<const unsigned char *>& seqs,
+                                        const std::vector<range_type>& ranges,
+                                        const std::vector<double>& logl_gaps)
+{
+  assert(tree_);
+
+  if (opt_branches_) {
+    Blo_Block block(partition_.get(), seqs.size() > 1);
+    std::string seq;
+    const range_type all_sites(0, partition_->sites);
+
+    // per placed sequence: the range it was placed over and the tolerance it converged to
+    std::vector<range_type> placed_ranges;
+    std::vector<double> tolerances;
+    std::unordered_multimap<size_t, size_t> placed_by_hash;
+
+    std::vector<Placement> result;
+    result.reserve(seqs.size());
+    for (size_t i = 0; i < seqs.size(); ++i) {
+      const auto range = decode_(seqs[i], ranges.empty() ? all_sites : ranges[i], seq);
+      const auto tolerance = blo_tolerance_(logl_gaps.empty() ? 0.0 : logl_gaps[i]);
+      const auto hash = std::hash<std::string>{}(seq);
+
+      // an identical sequence, optimized at least as tightly, has the same placement
+      size_t identical = seqs.size();
+      const auto candidates = placed_by_hash.equal_range(hash);
+      for (auto it = candidates.first; it != candidates.second; ++it) {
+        const auto j = it->second;
+        if (placed_ranges[j] == range
+            and tolerances[j] <= tolerance
+            and std::equal(seqs[i] + range.first, seqs[i] + range.second, seqs[j] + range.first)) {
+          identical = j;
+          break;
+        }
+      }
+
+      if (identical < seqs.size()) {
+        result.push_back(result[identical]);
+        ++blo_stats_.reused;
+      } else {
+        result.push_back(place_blo_(seq.c_str(), range, block, tolerance));
+        placed_by_hash.emplace(hash, i);
+      }
+      placed_ranges.push_back(range);
+      tolerances.push_back(tolerance);
+    }
+    return result;
+  }
+
+  const auto distal_length  = tree_->nodes[1]->length;
+  const auto pendant_length = tree_->nodes[3]->length;
+
+  std::vector<double> logls;
+  lookup_->sum_precomputed_sitelk(branch_id_, seqs, ranges, logls);
+
+  std::vector<Placement> result;
+  result.reserve(logls.size());
+  for (const auto logl : logls) {
+    result.emplace_back(branch_id_, logl, pendant_length, distal_length);
+  }
+
+  return result;
+}
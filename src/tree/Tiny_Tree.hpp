@@ -1,7 +1,11 @@
 #pragma once
 
+#include <algorithm>
 #include <memory>
+#include <string>
 #include <unordered_map>
+#include <vector>
+#include <utility>
 
 #include "core/pll/pllhead.hpp"
 #include "seq/Sequence.hpp"
@@ -10,8 +14,32 @@
 #include "sample/Placement.hpp"
 #include "tree/Tree.hpp"
 #include "core/pll/pll_util.hpp"
+#include "core/pll/optimize.hpp"
 #include "core/Lookup_Store.hpp"
 
+/**
+ * Work done by the branch length optimization of placements.
+ */
+struct Blo_Stats
+{
+  // placements whose branch lengths were optimized
+  size_t optimized = 0;
+  // placements taken over from an identical query on the same branch
+  size_t reused = 0;
+  // smoothing iterations of the optimized placements (sliding BLO only)
+  size_t iterations = 0;
+  size_t max_iterations = 0;
+
+  Blo_Stats& operator+=(const Blo_Stats& other)
+  {
+    optimized += other.optimized;
+    reused += other.reused;
+    iterations += other.iterations;
+    max_iterations = std::max(max_iterations, other.max_iterations);
+    return *this;
+  }
+};
+
 /* Encapsulates a smallest possible unrooted tree (3 tip nodes, 1 inner node)
   for use in edge insertion:
 
@@ -48,9 +76,45 @@ public:
   Tiny_Tree& operator= (Tiny_Tree const& other) = delete;
   Tiny_Tree& operator= (Tiny_Tree && other)     = default;
 
+  using range_type = std::pair<size_t, size_t>;
+
   Placement place(const Sequence& s);
+  // encoded variants, taking one state index per site (see Encoded_MSA). In ranged
+  // mode, only the given range of sites is considered, the rest is assumed to be gaps
+  Placement place(const unsigned char * states, const range_type& range);
+  Placement place(const unsigned char * states);
+  // places a block of sequences: without BLO in one pass over the lookup table, with
+  // BLO one after the other, sharing the buffers and the reference partial between them.
+  // Identical sequences are optimized only once.
+  //
+  // <logl_gaps> optionally holds, per sequence, how far the preplacement logl of this
+  // branch is below the best one of the sequence. The BLO of placements too unlikely
+  // to carry weight then converges to a looser tolerance (see Options::blo_priors)
+  std::vector<Placement> place(const std::vector<const unsigned char *>& seqs,
+                               const std::vector<range_type>& ranges={},
+                               const std::vector<double>& logl_gaps={});
+
+  // restores the branch lengths and partials of the reference branch. Placing a
+  // sequence does so on its own, so the tree can be reused for the next one
+  void reset();
+
+  // the BLO work done since the last call
+  Blo_Stats take_blo_stats();
+
+  // per-site bounds of the placement logl over all branch lengths, laid out like the
+  // tables of <lookup> (see precompute_bounds). False if the model is not supported
+  bool logl_bounds(const Lookup_Store& lookup, Matrix<double>& table) const;
 
 private:
+  struct Blo_Block;
+
+  Placement place_blo_( const char * seq,
+                        const range_type& range,
+                        Blo_Block& block,
+                        const double tolerance=OPT_BRANCH_EPSILON);
+  double blo_tolerance_(const double logl_gap) const;
+  range_type decode_(const unsigned char * states, const range_type& range, std::string& seq) const;
+
   // pll structures
   std::unique_ptr<pll_partition_t, partition_deleter> partition_;
   std::unique_ptr<pll_utree_t, utree_deleter> tree_;
@@ -59,8 +123,19 @@ private:
   double original_branch_length_;
   bool tip_tip_case_ = false;
   bool sliding_blo_;
+  // see Options::blo_priors: most likely state per site at the insertion point, from
+  // which the pendant length of a query is estimated to start the BLO with
+  bool blo_priors_;
+  std::vector<unsigned int> consensus_;
+  Blo_Stats blo_stats_;
   unsigned int branch_id_;
+  // ranged BLO (see Options::ranged): per-site prefix sums of the all-gap logl
+  bool ranged_ = false;
+  std::vector<double> gap_prefix_;
 
   std::shared_ptr<Lookup_Store> lookup_;
+  // keeps the lookup table of the branch from being evicted (declared after lookup_,
+  // such that it is released first)
+  Lookup_Store::pin_type lookup_pin_;
 
 };
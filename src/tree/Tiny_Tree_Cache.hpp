@@ -0,0 +1,83 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <tuple>
+
+#include "tree/Tiny_Tree.hpp"
+
+/**
+ * Bounded cache of constructed Tiny_Trees, meant to be owned by one thread for the whole
+ * run, such that branches recurring in later chunks do not need to be rebuilt.
+ *
+ * Trees are keyed by branch id, BLO mode and lookup store. Placing leaves a Tiny_Tree in
+ * its original state (see Tiny_Tree::reset), so a tree taken from the cache behaves like
+ * a freshly built one. Once full, the least recently used tree is dropped.
+ *
+ * Cached trees keep their lookup table pinned (see Lookup_Store::pin).
+ */
+class Tiny_Tree_Cache
+{
+public:
+  explicit Tiny_Tree_Cache(const size_t capacity) : capacity_(capacity) { }
+  Tiny_Tree_Cache() = delete;
+  ~Tiny_Tree_Cache() = default;
+
+  Tiny_Tree_Cache(Tiny_Tree_Cache const&) = delete;
+  Tiny_Tree_Cache(Tiny_Tree_Cache&&) = default;
+  Tiny_Tree_Cache& operator=(Tiny_Tree_Cache const&) = delete;
+  Tiny_Tree_Cache& operator=(Tiny_Tree_Cache&&) = default;
+
+  /**
+   * Returns the Tiny_Tree of the branch, building it (with the same arguments as the
+   * Tiny_Tree constructor) if it is not cached.
+   */
+  std::shared_ptr<Tiny_Tree> get( pll_unode_t * edge_node,
+                                  const unsigned int branch_id,
+                                  Tree& reference_tree,
+                                  const bool opt_branches,
+                                  const Options& options,
+                                  std::shared_ptr<Lookup_Store>& lookup)
+  {
+    const auto key = std::make_tuple(branch_id, opt_branches, lookup.get());
+
+    for (auto it = trees_.begin(); it != trees_.end(); ++it) {
+      if (it->first == key) {
+        ++hits_;
+        trees_.splice(trees_.begin(), trees_, it);
+        return trees_.front().second;
+      }
+    }
+
+    ++misses_;
+    auto tree = std::make_shared<Tiny_Tree>(edge_node,
+                                            branch_id,
+                                            reference_tree,
+                                            opt_branches,
+                                            options,
+                                            lookup);
+    if (capacity_) {
+      if (trees_.size() >= capacity_) {
+        trees_.pop_back();
+      }
+      trees_.emplace_front(key, tree);
+    }
+    return tree;
+  }
+
+  void clear() { trees_.clear(); }
+
+  size_t size() const { return trees_.size(); }
+  size_t capacity() const { return capacity_; }
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+
+private:
+  using key_type = std::tuple<unsigned int, bool, const Lookup_Store *>;
+
+  size_t capacity_;
+  // most recently used first
+  std::list<std::pair<key_type, std::shared_ptr<Tiny_Tree>>> trees_;
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+};
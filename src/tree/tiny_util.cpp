@@ -1,9 +1,23 @@
 #include "tree/tiny_util.hpp"
 
 #include <type_traits>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <atomic>
+#include <cstring>
 
 #include "core/pll/pll_util.hpp"
+#include "core/raxml/Model.hpp"
+#include "util/constants.hpp"
+#include "util/logging.hpp"
 
+#ifdef __AVX
+#include <immintrin.h>
+#endif
+
+// compiled for the instruction set via the target attribute, chosen at runtime
+#define EPA_TARGET(isa) __attribute__((target(isa)))
 
 constexpr unsigned int proximal_clv_index         = 4;
 constexpr unsigned int inner_clv_index            = 3;
@@ -79,6 +93,169 @@ static void deep_copy_repeats(pll_partition_t* dest_part,
 }
 
 
+/*
+  Tiny partitions are recycled per thread instead of being destroyed: a recycled partition
+  keeps its own buffers (CLVs, scalers, p-matrices, tipchars) and only needs the shallow
+  copies of the reference CLVs and the deep copies of their scalers to be redone.
+  Partitions with site repeats or per-rate scalers, whose buffer sizes depend on the
+  branch, are not recycled.
+*/
+static std::atomic<size_t> recycle_capacity{4};
+
+static bool recyclable(pll_partition_t const * const partition)
+{
+  return not partition->repeats
+    and not (partition->attributes & (PLL_ATTRIB_SITE_REPEATS | PLL_ATTRIB_RATE_SCALERS));
+}
+
+static bool distal_is_tip(pll_partition_t const * const partition)
+{
+  return partition->clv_buffers != 3;
+}
+
+// destroys a tiny partition, without touching what it shares with the reference
+static void destroy_tiny_partition(pll_partition_t * partition)
+{
+  // unset shallow copied things
+  partition->rates              = nullptr;
+  partition->subst_params       = nullptr;
+  partition->frequencies        = nullptr;
+  partition->eigenvecs          = nullptr;
+  partition->inv_eigenvecs      = nullptr;
+  partition->eigenvals          = nullptr;
+  partition->prop_invar         = nullptr;
+  partition->eigen_decomp_valid = nullptr;
+  partition->pattern_weights    = nullptr;
+
+  partition->clv[proximal_clv_index] = nullptr;
+
+  const bool pattern_tip_mode = partition->attributes & PLL_ATTRIB_PATTERN_TIP;
+
+  if (distal_is_tip(partition)) {
+    if (pattern_tip_mode) {
+      partition->tipchars[distal_clv_index_if_tip] = nullptr;
+    } else {
+      partition->clv[distal_clv_index_if_tip] = nullptr;
+    }
+  } else {
+    partition->clv[distal_clv_index_if_inner] = nullptr;
+  }
+
+  pll_partition_destroy(partition);
+}
+
+namespace {
+  struct Partition_Pool
+  {
+    Partition_Pool() = default;
+    ~Partition_Pool()
+    {
+      for (auto partition : free) {
+        destroy_tiny_partition(partition);
+      }
+    }
+
+    std::vector<pll_partition_t *> free;
+  };
+
+  thread_local Partition_Pool partition_pool;
+}
+
+/*
+  Whether a pooled partition can stand in for a fresh one derived from <reference>: it
+  has to share all of the shallow copies, and have the dimensions a fresh one would
+  get. Addresses can be reused once a reference is destroyed, so the shallow copies
+  alone do not tell whether the own buffers are large enough.
+*/
+static bool derived_from(pll_partition_t const * const partition,
+                         pll_partition_t const * const reference,
+                         const bool tip_tip_case)
+{
+  return partition->rates == reference->rates
+    and partition->subst_params == reference->subst_params
+    and partition->frequencies == reference->frequencies
+    and partition->eigenvecs == reference->eigenvecs
+    and partition->inv_eigenvecs == reference->inv_eigenvecs
+    and partition->eigenvals == reference->eigenvals
+    and partition->prop_invar == reference->prop_invar
+    and partition->eigen_decomp_valid == reference->eigen_decomp_valid
+    and partition->pattern_weights == reference->pattern_weights
+    and partition->sites == reference->sites
+    and partition->states == reference->states
+    and partition->rate_cats == reference->rate_cats
+    and partition->rate_matrices == reference->rate_matrices
+    and partition->attributes == reference->attributes
+    and partition->clv_buffers == (tip_tip_case ? 2u : 3u);
+}
+
+// destroys the pooled partitions of this thread beyond the current capacity, oldest first
+static void trim_pool()
+{
+  auto& free = partition_pool.free;
+  const size_t capacity = recycle_capacity;
+  if (free.size() > capacity) {
+    const auto excess = free.begin() + (free.size() - capacity);
+    std::for_each(free.begin(), excess, destroy_tiny_partition);
+    free.erase(free.begin(), excess);
+  }
+}
+
+// takes a recycled partition derived from the given reference partition and layout
+static pll_partition_t * take_recycled(pll_partition_t const * const reference,
+                                       const bool tip_tip_case)
+{
+  trim_pool();
+  if (recycle_capacity == 0) {
+    return nullptr;
+  }
+
+  auto& free = partition_pool.free;
+  for (auto it = free.begin(); it != free.end(); ++it) {
+    if (derived_from(*it, reference, tip_tip_case)) {
+      auto partition = *it;
+      free.erase(it);
+      return partition;
+    }
+  }
+  return nullptr;
+}
+
+void tiny_partition_recycling(const size_t capacity)
+{
+  recycle_capacity = capacity;
+  trim_pool();
+}
+
+size_t tiny_partitions_pooled()
+{
+  return partition_pool.free.size();
+}
+
+// scaler copy into the buffers of a recycled partition, which all hold one entry per site
+static void copy_scaler(pll_partition_t * dest_part,
+                        pll_unode_t * dest_node,
+                        pll_partition_t const * const src_part,
+                        pll_unode_t const * const src_node)
+{
+  if (dest_node->scaler_index == PLL_SCALE_BUFFER_NONE) {
+    return;
+  }
+  auto& dest = dest_part->scale_buffer[dest_node->scaler_index];
+  if (dest == nullptr) {
+    dest = static_cast<unsigned int *>(calloc(dest_part->sites, sizeof(unsigned int)));
+  }
+
+  if (src_node->scaler_index != PLL_SCALE_BUFFER_NONE
+    and src_part->scale_buffer[src_node->scaler_index] != nullptr) {
+    memcpy( dest,
+            src_part->scale_buffer[src_node->scaler_index],
+            dest_part->sites * sizeof(unsigned int));
+  } else {
+    // as freshly created
+    memset(dest, 0, dest_part->sites * sizeof(unsigned int));
+  }
+}
+
 pll_partition_t * make_tiny_partition(Tree& reference_tree, 
                                       const pll_utree_t * tree, 
                                       pll_unode_t const * const old_proximal, 
@@ -105,6 +282,22 @@ pll_partition_t * make_tiny_partition(Tree& reference_tree,
   auto proximal = tree->nodes[0];
   auto distal = tree->nodes[1];
 
+  if (auto tiny = take_recycled(old_partition, tip_tip_case)) {
+    tiny->clv[proximal->clv_index] =
+      static_cast<double*>(reference_tree.get_clv(old_proximal));
+
+    if(tip_tip_case and use_tipchars) {
+      tiny->tipchars[distal->clv_index] = static_cast<unsigned char*>(reference_tree.get_clv(old_distal));
+    } else {
+      tiny->clv[distal->clv_index] = static_cast<double*>(reference_tree.get_clv(old_distal));
+    }
+
+    copy_scaler(tiny, proximal, old_partition, old_proximal);
+    copy_scaler(tiny, distal, old_partition, old_distal);
+
+    return tiny;
+  }
+
   pll_partition_t * tiny = pll_partition_create(
     3, // tips
     1 + num_clv_tips, // extra clv's
@@ -219,33 +412,13 @@ pll_partition_t * make_tiny_partition(Tree& reference_tree,
 void tiny_partition_destroy(pll_partition_t * partition)
 {
   if (partition) {
-    // unset shallow copied things
-    partition->rates              = nullptr;
-    partition->subst_params       = nullptr;
-    partition->frequencies        = nullptr;
-    partition->eigenvecs          = nullptr;
-    partition->inv_eigenvecs      = nullptr;
-    partition->eigenvals          = nullptr;
-    partition->prop_invar         = nullptr;
-    partition->eigen_decomp_valid = nullptr;
-    partition->pattern_weights    = nullptr;
-
-    partition->clv[proximal_clv_index] = nullptr;
-
-    const bool distal_is_tip    = partition->clv_buffers == 3 ? false : true;
-    const bool pattern_tip_mode = partition->attributes & PLL_ATTRIB_PATTERN_TIP;
-
-    if (distal_is_tip) {
-      if (pattern_tip_mode) {
-        partition->tipchars[distal_clv_index_if_tip] = nullptr;
-      } else {
-        partition->clv[distal_clv_index_if_tip] = nullptr;
-      }
+    trim_pool();
+    auto& free = partition_pool.free;
+    if (recyclable(partition) and free.size() < recycle_capacity) {
+      free.push_back(partition);
     } else {
-      partition->clv[distal_clv_index_if_inner] = nullptr;
+      destroy_tiny_partition(partition);
     }
-
-    pll_partition_destroy(partition);
   }
 }
 
@@ -323,3 +496,598 @@ pll_utree_t * make_tiny_tree_structure( const pll_unode_t * old_proximal,
 
   return tree;
 }
+
+void init_tiny_partials(pll_partition_t * partition, pll_utree_t const * const tree)
+{
+  auto proximal = tree->nodes[0];
+  auto distal   = tree->nodes[1];
+  auto inner    = tree->nodes[3];
+
+  pll_operation_t op;
+  op.parent_clv_index = inner->clv_index;
+  op.child1_clv_index = distal->clv_index;
+  op.child1_scaler_index = distal->scaler_index;
+  op.child2_clv_index = proximal->clv_index;
+  op.child2_scaler_index = proximal->scaler_index;
+  op.parent_scaler_index = inner->scaler_index;
+  op.child1_matrix_index = distal->pmatrix_index;
+  op.child2_matrix_index = proximal->pmatrix_index;
+
+  // wether heuristic is used or not, this is the initial branch length configuration
+  double branch_lengths[3] = {proximal->length, distal->length, inner->length};
+  unsigned int matrix_indices[3] = {proximal->pmatrix_index, distal->pmatrix_index, inner->pmatrix_index};
+
+  // use branch lengths to compute the probability matrices
+  std::vector<unsigned int> param_indices(partition->rate_cats, 0);
+  pll_update_prob_matrices( partition, 
+                            &param_indices[0], 
+                            matrix_indices, 
+                            branch_lengths, 
+                            3);
+
+  // use update_partials to compute the clv pointing toward the new tip
+  pll_update_partials(partition, &op, 1);
+}
+
+void precompute_sites_static( char nt,
+                              std::vector<double>& result,
+                              pll_partition_t * const partition,
+                              pll_utree_t const * const tree)
+{
+  const size_t sites  = partition->sites;
+  const auto new_tip  = tree->nodes[2];
+  const auto inner    = new_tip->back;
+  result.clear();
+  result.resize(sites);
+  std::string seq(sites, nt);
+
+  std::vector<unsigned int> param_indices(partition->rate_cats, 0);
+
+  auto map = get_char_map(partition);
+
+  auto err_check = pll_set_tip_states(partition, 
+                                      new_tip->clv_index, 
+                                      map,
+                                      seq.c_str());
+
+  if (err_check == PLL_FAILURE) {
+    throw std::runtime_error{
+      std::string("Set tip states during sites precompution failed! pll_errmsg: ")
+      + pll_errmsg
+    };
+  }
+
+  pll_compute_edge_loglikelihood( partition,
+                                  new_tip->clv_index,
+                                  PLL_SCALE_BUFFER_NONE, 
+                                  inner->clv_index,
+                                  inner->scaler_index,
+                                  inner->pmatrix_index,
+                                  &param_indices[0], 
+                                  &result[0]);
+}
+
+/*
+  Per site step of the fused table builder: z[j] = sum_r w_r * sum_k P_r[j][k] * clv_r[k],
+  for the p-matrices P_r and the CLV of the site, both with rows of <states_padded>.
+*/
+using rate_sums_type = void (*)(const double *, const double *, const double *,
+                                size_t, size_t, size_t, double *);
+
+static void rate_sums_scalar( const double * pmatrix,
+                              const double * site_clv,
+                              const double * rate_weights,
+                              const size_t states,
+                              const size_t states_padded,
+                              const size_t rate_cats,
+                              double * z)
+{
+  std::fill(z, z + states, 0.0);
+  for (size_t r = 0; r < rate_cats; ++r) {
+    const double * pmat = pmatrix + r * states * states_padded;
+    const double * rate_clv = site_clv + r * states_padded;
+    for (size_t j = 0; j < states; ++j) {
+      double term = 0.0;
+      for (size_t k = 0; k < states; ++k) {
+        term += pmat[j * states_padded + k] * rate_clv[k];
+      }
+      z[j] += rate_weights[r] * term;
+    }
+  }
+}
+
+#ifdef __AVX
+// the sums of a, b, c and d, in that order
+EPA_TARGET("avx")
+static inline __m256d horizontal_sums(const __m256d a,
+                                      const __m256d b,
+                                      const __m256d c,
+                                      const __m256d d)
+{
+  const __m256d ab = _mm256_hadd_pd(a, b);
+  const __m256d cd = _mm256_hadd_pd(c, d);
+  return _mm256_add_pd( _mm256_permute2f128_pd(ab, cd, 0x20),
+                        _mm256_permute2f128_pd(ab, cd, 0x31));
+}
+
+/*
+  Four rows of the p-matrix at a time, with the dot products over the states in
+  vectors of four. The states beyond a multiple of four are masked, as the padding of
+  the rows is not necessarily zero; rows beyond a multiple of four are done scalar.
+*/
+EPA_TARGET("avx")
+static void rate_sums_avx(const double * pmatrix,
+                          const double * site_clv,
+                          const double * rate_weights,
+                          const size_t states,
+                          const size_t states_padded,
+                          const size_t rate_cats,
+                          double * z)
+{
+  const size_t full = states & ~size_t(3);
+  const auto tail = static_cast<long long>(states - full);
+  const __m256i tail_mask = _mm256_set_epi64x(0,
+                                              tail > 2 ? -1 : 0,
+                                              tail > 1 ? -1 : 0,
+                                              tail > 0 ? -1 : 0);
+
+  for (size_t j = 0; j < full; j += 4) {
+    __m256d zj = _mm256_setzero_pd();
+    for (size_t r = 0; r < rate_cats; ++r) {
+      const double * row = pmatrix + (r * states + j) * states_padded;
+      const double * rate_clv = site_clv + r * states_padded;
+
+      __m256d acc_0 = _mm256_setzero_pd();
+      __m256d acc_1 = _mm256_setzero_pd();
+      __m256d acc_2 = _mm256_setzero_pd();
+      __m256d acc_3 = _mm256_setzero_pd();
+      for (size_t k = 0; k < full; k += 4) {
+        const __m256d clv = _mm256_loadu_pd(rate_clv + k);
+        acc_0 = _mm256_add_pd(acc_0, _mm256_mul_pd(_mm256_loadu_pd(row + k), clv));
+        acc_1 = _mm256_add_pd(acc_1, _mm256_mul_pd(
+          _mm256_loadu_pd(row + states_padded + k), clv));
+        acc_2 = _mm256_add_pd(acc_2, _mm256_mul_pd(
+          _mm256_loadu_pd(row + 2 * states_padded + k), clv));
+        acc_3 = _mm256_add_pd(acc_3, _mm256_mul_pd(
+          _mm256_loadu_pd(row + 3 * states_padded + k), clv));
+      }
+      if (tail) {
+        const __m256d clv = _mm256_maskload_pd(rate_clv + full, tail_mask);
+        acc_0 = _mm256_add_pd(acc_0, _mm256_mul_pd(
+          _mm256_maskload_pd(row + full, tail_mask), clv));
+        acc_1 = _mm256_add_pd(acc_1, _mm256_mul_pd(
+          _mm256_maskload_pd(row + states_padded + full, tail_mask), clv));
+        acc_2 = _mm256_add_pd(acc_2, _mm256_mul_pd(
+          _mm256_maskload_pd(row + 2 * states_padded + full, tail_mask), clv));
+        acc_3 = _mm256_add_pd(acc_3, _mm256_mul_pd(
+          _mm256_maskload_pd(row + 3 * states_padded + full, tail_mask), clv));
+      }
+
+      zj = _mm256_add_pd(zj, _mm256_mul_pd( _mm256_set1_pd(rate_weights[r]),
+                                            horizontal_sums(acc_0, acc_1, acc_2, acc_3)));
+    }
+    _mm256_storeu_pd(z + j, zj);
+  }
+
+  for (size_t j = full; j < states; ++j) {
+    z[j] = 0.0;
+    for (size_t r = 0; r < rate_cats; ++r) {
+      const double * row = pmatrix + (r * states + j) * states_padded;
+      const double * rate_clv = site_clv + r * states_padded;
+      double term = 0.0;
+      for (size_t k = 0; k < states; ++k) {
+        term += row[k] * rate_clv[k];
+      }
+      z[j] += rate_weights[r] * term;
+    }
+  }
+}
+#endif
+
+static rate_sums_type rate_sums_kernel()
+{
+#ifdef __AVX
+  static const rate_sums_type kernel = []() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx") ? rate_sums_avx : rate_sums_scalar;
+  }();
+  return kernel;
+#else
+  return rate_sums_scalar;
+#endif
+}
+
+bool precompute_sites_fused(const Lookup_Store& lookup,
+                            Matrix<double>& result,
+                            pll_partition_t const * const partition,
+                            pll_utree_t const * const tree)
+{
+  const auto inner = tree->nodes[2]->back;
+
+  if ((partition->attributes & PLL_ATTRIB_RATE_SCALERS)
+    or (partition->prop_invar and partition->prop_invar[0] > 0.0)) {
+    return false;
+  }
+
+  const size_t sites          = partition->sites;
+  const size_t states         = partition->states;
+  const size_t states_padded  = partition->states_padded;
+  const size_t rate_cats      = partition->rate_cats;
+  const size_t span           = states_padded * rate_cats;
+  const size_t cols           = lookup.char_map_size();
+
+  const double * clv          = partition->clv[inner->clv_index];
+  const double * pmatrix      = partition->pmatrix[inner->pmatrix_index];
+  const double * freqs        = partition->frequencies[0];
+  const double * rate_weights = partition->rate_weights;
+  const unsigned int * pattern_weights = partition->pattern_weights;
+  const unsigned int * scaler = (inner->scaler_index == PLL_SCALE_BUFFER_NONE)
+                              ? nullptr
+                              : partition->scale_buffer[inner->scaler_index];
+
+  // with site repeats, sites of the same class share one CLV entry (ids start at 1)
+  const unsigned int * site_id = nullptr;
+  if (partition->repeats and partition->repeats->pernode_ids[inner->clv_index]) {
+    site_id = partition->repeats->pernode_site_id[inner->clv_index];
+  }
+
+  // state bitmask of every column of the table
+  const auto char_map = get_char_map(partition);
+  std::vector<unsigned int> masks(cols);
+  for (size_t c = 0; c < cols; ++c) {
+    masks[c] = char_map[lookup.char_map(c)];
+  }
+
+  const double log_scale_threshold = std::log(PLL_SCALE_THRESHOLD);
+  const auto rate_sums = rate_sums_kernel();
+
+  result = Matrix<double>(sites, cols);
+  std::vector<double> z(states);
+
+  for (size_t i = 0; i < sites; ++i) {
+    const size_t id = site_id ? site_id[i] - 1 : i;
+    const double * site_clv = clv + id * span;
+
+    // z[j]: contribution of the new tip being in state j, summed over rate categories
+    rate_sums(pmatrix, site_clv, rate_weights, states, states_padded, rate_cats, &z[0]);
+    for (size_t j = 0; j < states; ++j) {
+      z[j] *= freqs[j];
+    }
+
+    const double scale = scaler ? scaler[id] * log_scale_threshold : 0.0;
+    const double weight = pattern_weights ? pattern_weights[i] : 1.0;
+
+    // every character is a subset of the states
+    for (size_t c = 0; c < cols; ++c) {
+      double site_lk = 0.0;
+      for (size_t j = 0; j < states; ++j) {
+        if (masks[c] & (1u << j)) {
+          site_lk += z[j];
+        }
+      }
+      result(i, c) = weight * (std::log(site_lk) + scale);
+    }
+  }
+
+  return true;
+}
+
+Matrix<double> precompute_sites( const Lookup_Store& lookup,
+                                 pll_partition_t * const partition,
+                                 pll_utree_t const * const tree)
+{
+  const auto size = lookup.char_map_size();
+
+  Matrix<double> table;
+  if (precompute_sites_fused(lookup, table, partition, tree)) {
+    // spot check one column of the first table of the store against pll
+    const bool valid = lookup.builder_valid([&]() {
+      const auto check_char = 'A';
+      const auto check_col = lookup.char_position(check_char);
+      std::vector<double> check;
+      precompute_sites_static(check_char, check, partition, tree);
+
+      for (size_t i = 0; i < check.size(); ++i) {
+        if (std::abs(table(i, check_col) - check[i])
+            > 1e-8 * std::max(1.0, std::abs(check[i]))) {
+          LOG_DBG << "Fused lookup table builder disagrees with pll, falling back";
+          return false;
+        }
+      }
+      return true;
+    });
+
+    if (valid) {
+      return table;
+    }
+  }
+
+  // one pll pass per character
+  table = Matrix<double>(partition->sites, size);
+  std::vector<double> column;
+  for (size_t ch = 0; ch < size; ++ch) {
+    precompute_sites_static(lookup.char_map(ch), column, partition, tree);
+    for (size_t i = 0; i < column.size(); ++i) {
+      table(i, ch) = column[i];
+    }
+  }
+  return table;
+}
+
+// relative room added to every site bound, for the rounding of the likelihood computation
+constexpr double BOUND_SLACK = 1e-9;
+
+/*
+  Entrywise bound of P(t) over all t >= 0 (states x states), from the eigendecomposition
+  P(t)[k][j] = sum_m U[k][m] * exp(l_m * t) * V[m][j]: as the eigenvalues l_m of a rate
+  matrix are not positive, every term is at most its coefficient where that is positive,
+  and at most 0 otherwise. Empty if an eigenvalue is positive after all.
+*/
+static std::vector<double> transition_bounds(pll_partition_t const * const partition)
+{
+  const size_t states         = partition->states;
+  const size_t states_padded  = partition->states_padded;
+  const double * evals        = partition->eigenvals[0];
+  const double * evecs        = partition->eigenvecs[0];
+  const double * inv_evecs    = partition->inv_eigenvecs[0];
+
+  for (size_t m = 0; m < states; ++m) {
+    if (evals[m] > 1e-12) {
+      return {};
+    }
+  }
+
+  std::vector<double> bounds(states * states, 1.0);
+  for (size_t k = 0; k < states; ++k) {
+    for (size_t j = 0; j < states; ++j) {
+      if (j == k) {
+        continue;
+      }
+      double sum = 0.0;
+      for (size_t m = 0; m < states; ++m) {
+        sum += std::max(evecs[k * states_padded + m] * inv_evecs[m * states_padded + j], 0.0);
+      }
+      bounds[k * states + j] = std::min(sum, 1.0);
+    }
+  }
+  return bounds;
+}
+
+// bound of (P(t)v)[k] over all t, for a vector v >= 0 and the bounds of transition_bounds
+static double propagated_bound( const std::vector<double>& transitions,
+                                const size_t k,
+                                const double * v,
+                                const size_t states)
+{
+  const double * row = &transitions[k * states];
+  double max = 0.0;
+  double sum = 0.0;
+  for (size_t j = 0; j < states; ++j) {
+    max = std::max(max, v[j]);
+    sum += row[j] * v[j];
+  }
+  return std::min(max, sum);
+}
+
+bool precompute_bounds( const Lookup_Store& lookup,
+                        Matrix<double>& result,
+                        pll_partition_t const * const partition,
+                        pll_utree_t const * const tree)
+{
+  if ((partition->attributes & PLL_ATTRIB_RATE_SCALERS)
+    or (partition->prop_invar and partition->prop_invar[0] > 0.0)
+    or not partition->eigen_decomp_valid[0]) {
+    return false;
+  }
+
+  const size_t sites          = partition->sites;
+  const size_t states         = partition->states;
+  const size_t states_padded  = partition->states_padded;
+  const size_t rate_cats      = partition->rate_cats;
+  const size_t span           = states_padded * rate_cats;
+  const size_t cols           = lookup.char_map_size();
+
+  const auto transitions = transition_bounds(partition);
+  if (transitions.empty()) {
+    return false;
+  }
+
+  const auto proximal = tree->nodes[0];
+  const auto distal   = tree->nodes[1];
+  const auto inner    = tree->nodes[3];
+
+  // the bound has to hold for the p-matrices the tree was set up with, at least
+  for (const auto node : {proximal, distal, inner}) {
+    const double * pmatrix = partition->pmatrix[node->pmatrix_index];
+    for (size_t r = 0; r < rate_cats; ++r) {
+      for (size_t k = 0; k < states; ++k) {
+        for (size_t j = 0; j < states; ++j) {
+          if (pmatrix[(r * states + k) * states_padded + j] > transitions[k * states + j] + 1e-12) {
+            LOG_DBG << "Transition bounds do not hold, not bounding placement logls";
+            return false;
+          }
+        }
+      }
+    }
+  }
+
+  // with site repeats, sites of the same class share one CLV entry (ids start at 1)
+  const auto site_ids = [partition](pll_unode_t const * const node) -> const unsigned int * {
+    if (partition->repeats and partition->repeats->pernode_ids[node->clv_index]) {
+      return partition->repeats->pernode_site_id[node->clv_index];
+    }
+    return nullptr;
+  };
+  const auto scaler = [partition](pll_unode_t const * const node) -> const unsigned int * {
+    return (node->scaler_index == PLL_SCALE_BUFFER_NONE)
+           ? nullptr
+           : partition->scale_buffer[node->scaler_index];
+  };
+
+  const unsigned int * proximal_ids     = site_ids(proximal);
+  const unsigned int * distal_ids       = site_ids(distal);
+  const unsigned int * proximal_scaler  = scaler(proximal);
+  const unsigned int * distal_scaler    = scaler(distal);
+
+  // in the tip-tip case, the distal tip may be stored as characters
+  const bool distal_chars = (partition->attributes & PLL_ATTRIB_PATTERN_TIP)
+                            and distal->clv_index < partition->tips;
+  const unsigned char * distal_tipchars = distal_chars
+                                          ? partition->tipchars[distal->clv_index]
+                                          : nullptr;
+
+  const double * proximal_clv = partition->clv[proximal->clv_index];
+  const double * distal_clv   = distal_chars ? nullptr : partition->clv[distal->clv_index];
+  const double * freqs        = partition->frequencies[0];
+  const double * rate_weights = partition->rate_weights;
+  const unsigned int * pattern_weights = partition->pattern_weights;
+
+  // bound of the factor of the new tip, per column of the table and state at the
+  // insertion point
+  const auto char_map = get_char_map(partition);
+  std::vector<double> pendant(cols * states);
+  for (size_t c = 0; c < cols; ++c) {
+    const auto mask = char_map[lookup.char_map(c)];
+    for (size_t k = 0; k < states; ++k) {
+      double sum = 0.0;
+      for (size_t j = 0; j < states; ++j) {
+        if (mask & (1u << j)) {
+          sum += transitions[k * states + j];
+        }
+      }
+      pendant[c * states + k] = std::min(sum, 1.0);
+    }
+  }
+
+  const double log_scale_threshold = std::log(PLL_SCALE_THRESHOLD);
+
+  result = Matrix<double>(sites, cols);
+  std::vector<double> z(states);
+  std::vector<double> tip(states);
+
+  for (size_t i = 0; i < sites; ++i) {
+    const size_t proximal_id = proximal_ids ? proximal_ids[i] - 1 : i;
+    const size_t distal_id = distal_ids ? distal_ids[i] - 1 : i;
+    const double * site_proximal = proximal_clv + proximal_id * span;
+    const double * site_distal = distal_chars ? &tip[0] : distal_clv + distal_id * span;
+
+    if (distal_chars) {
+      const auto mask = partition->tipmap[distal_tipchars[i]];
+      for (size_t j = 0; j < states; ++j) {
+        tip[j] = (mask & (1u << j)) ? 1.0 : 0.0;
+      }
+    }
+
+    // z[k]: bound of the contribution of state k at the insertion point, over all rates
+    std::fill(z.begin(), z.end(), 0.0);
+    for (size_t r = 0; r < rate_cats; ++r) {
+      const double * rate_proximal = site_proximal + r * states_padded;
+      const double * rate_distal = distal_chars ? site_distal : site_distal + r * states_padded;
+      for (size_t k = 0; k < states; ++k) {
+        z[k] += rate_weights[r]
+              * propagated_bound(transitions, k, rate_proximal, states)
+              * propagated_bound(transitions, k, rate_distal, states);
+      }
+    }
+
+    const double scale = ( (proximal_scaler ? proximal_scaler[proximal_id] : 0u)
+                         + (distal_scaler ? distal_scaler[distal_id] : 0u))
+                       * log_scale_threshold;
+    const double weight = pattern_weights ? pattern_weights[i] : 1.0;
+
+    for (size_t c = 0; c < cols; ++c) {
+      double site_lk = 0.0;
+      for (size_t k = 0; k < states; ++k) {
+        site_lk += freqs[k] * z[k] * pendant[c * states + k];
+      }
+      result(i, c) = weight * (std::log(site_lk * (1.0 + BOUND_SLACK)) + scale);
+    }
+  }
+
+  return true;
+}
+
+std::vector<unsigned int> insertion_consensus(pll_partition_t const * const partition,
+                                              pll_utree_t const * const tree)
+{
+  const auto inner = tree->nodes[2]->back;
+
+  const size_t sites          = partition->sites;
+  const size_t states         = partition->states;
+  const size_t states_padded  = partition->states_padded;
+  const size_t rate_cats      = partition->rate_cats;
+  const size_t span           = states_padded * rate_cats;
+
+  const double * clv          = partition->clv[inner->clv_index];
+  const double * freqs        = partition->frequencies[0];
+  const double * rate_weights = partition->rate_weights;
+
+  // with site repeats, sites of the same class share one CLV entry (ids start at 1)
+  const unsigned int * site_id = nullptr;
+  if (partition->repeats and partition->repeats->pernode_ids[inner->clv_index]) {
+    site_id = partition->repeats->pernode_site_id[inner->clv_index];
+  }
+
+  std::vector<unsigned int> consensus(sites);
+  for (size_t i = 0; i < sites; ++i) {
+    const size_t id = site_id ? site_id[i] - 1 : i;
+    const double * site_clv = clv + id * span;
+
+    size_t best = 0;
+    double best_lk = -1.0;
+    for (size_t j = 0; j < states; ++j) {
+      double lk = 0.0;
+      for (size_t r = 0; r < rate_cats; ++r) {
+        lk += rate_weights[r] * site_clv[r * states_padded + j];
+      }
+      lk *= freqs[j];
+      if (lk > best_lk) {
+        best_lk = lk;
+        best = j;
+      }
+    }
+    consensus[i] = 1u << best;
+  }
+
+  return consensus;
+}
+
+double estimate_pendant_length( pll_partition_t const * const partition,
+                                const std::vector<unsigned int>& consensus,
+                                const char * seq,
+                                const size_t first,
+                                const size_t last)
+{
+  // beyond this, the estimate is too unreliable to be of use
+  constexpr double max_estimate = 1.0;
+
+  const auto char_map = get_char_map(partition);
+  const unsigned int all_states = (1u << partition->states) - 1;
+
+  size_t informative = 0;
+  size_t mismatches = 0;
+  for (size_t i = first; i < last; ++i) {
+    const unsigned int mask = char_map[static_cast<unsigned char>(seq[i])];
+    if ((mask & all_states) == all_states) {
+      continue;
+    }
+    ++informative;
+    if (not (mask & consensus[i])) {
+      ++mismatches;
+    }
+  }
+
+  if (not informative) {
+    return DEFAULT_BRANCH_LENGTH;
+  }
+
+  // fraction of differing sites at which the distance diverges
+  const double saturation = (partition->states - 1.0) / partition->states;
+  const double p = static_cast<double>(mismatches) / informative;
+  if (p >= saturation) {
+    return max_estimate;
+  }
+
+  const double distance = -saturation * std::log(1.0 - p / saturation);
+  return std::min(std::max(distance, PLLMOD_OPT_MIN_BRANCH_LEN), max_estimate);
+}
@@ -1,9 +1,26 @@
 #pragma once
 
+#include <vector>
+
 #include "core/pll/pllhead.hpp"
+#include "core/Lookup_Store.hpp"
 #include "tree/Tree.hpp"
+#include "util/Matrix.hpp"
 
 void tiny_partition_destroy(pll_partition_t * partition);
+
+/**
+ * Destroyed tiny partitions are kept per thread, and handed out again by
+ * make_tiny_partition instead of allocating a new one, up to <capacity> of them
+ * (4 by default). 0 disables the recycling. Lowering the capacity destroys the
+ * partitions beyond it, in the pool of the calling thread right away, in those of the
+ * other threads once they make or destroy their next tiny partition.
+ */
+void tiny_partition_recycling(const size_t capacity);
+
+// number of tiny partitions waiting for reuse in the pool of the calling thread
+size_t tiny_partitions_pooled();
+
 pll_utree_t * make_tiny_tree_structure( const pll_unode_t * old_proximal, 
                                         const pll_unode_t * old_distal,
                                         const bool tip_tip_case);
@@ -12,3 +29,63 @@ pll_partition_t * make_tiny_partition(Tree& reference_tree,
                                       const pll_unode_t * old_proximal, 
                                       const pll_unode_t * old_distal, 
                                       const bool tip_tip_case);
+
+// computes the prob. matrices and the partial toward the new tip
+void init_tiny_partials(pll_partition_t * partition, pll_utree_t const * const tree);
+
+/**
+ * Lookup table construction for a tiny tree whose partials are initialized.
+ *
+ * precompute_sites_static computes one character column (all sites) via pll.
+ * precompute_sites_fused computes all columns in a single pass over the inner CLV,
+ * returning false for configurations it does not handle (invariant sites, per-rate
+ * scalers). precompute_sites picks the fused builder where possible. One column of
+ * the first table built into a store is checked against pll; on mismatch, all tables
+ * of that store fall back to the per-character path.
+ */
+void precompute_sites_static( char nt,
+                              std::vector<double>& result,
+                              pll_partition_t * const partition,
+                              pll_utree_t const * const tree);
+bool precompute_sites_fused(const Lookup_Store& lookup,
+                            Matrix<double>& result,
+                            pll_partition_t const * const partition,
+                            pll_utree_t const * const tree);
+Matrix<double> precompute_sites( const Lookup_Store& lookup,
+                                 pll_partition_t * const partition,
+                                 pll_utree_t const * const tree);
+
+/**
+ * Upper bounds of the per-site placement logl of a tiny tree over all lengths of its
+ * three branches, as used to prune thorough candidates exactly (see Blo_Pruner). Laid out,
+ * scaled and weighted like the lookup tables of <lookup>, such that the bound of a query
+ * is the sum over its sites.
+ *
+ * Every factor of the site likelihood is bounded on its own: P(t)v, for v >= 0, is at
+ * most the largest entry of v, and at most Mv, where M is an entrywise bound of P(t) over
+ * all t >= 0. Returns false for configurations it does not handle (invariant sites,
+ * per-rate scalers), or if M fails to bound the p-matrices of the tree.
+ */
+bool precompute_bounds( const Lookup_Store& lookup,
+                        Matrix<double>& result,
+                        pll_partition_t const * const partition,
+                        pll_utree_t const * const tree);
+
+/**
+ * Most likely state at the insertion point of every site, as a state bitmask, according
+ * to the partial toward the new tip of an initialized tiny tree.
+ */
+std::vector<unsigned int> insertion_consensus(pll_partition_t const * const partition,
+                                              pll_utree_t const * const tree);
+
+/**
+ * Quick estimate of the pendant length of a query, for sites [first, last): its
+ * distance to the insertion consensus, from the fraction of sites where they differ
+ * (Jukes-Cantor style, for any number of states). Sites where the query is fully
+ * ambiguous (gaps) are skipped.
+ */
+double estimate_pendant_length( pll_partition_t const * const partition,
+                                const std::vector<unsigned int>& consensus,
+                                const char * seq,
+                                const size_t first,
+                                const size_t last);
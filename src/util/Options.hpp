@@ -1,6 +1,14 @@
 #pragma once
 
+#include <cstddef>
 #include <limits>
+#include <string>
+
+// storage precision of the preplacement lookup tables
+enum class lookup_precision {DOUBLE, FLOAT, INT16};
+
+// skipping the BLO of candidates that cannot pass the final filter (see Blo_Pruner)
+enum class blo_pruning {OFF, EXACT, FAST};
 
 class Options {
 
@@ -12,6 +20,9 @@ public:
   bool opt_model                = false;
   bool opt_branches             = false;
   bool sliding_blo              = true;
+  // start the thorough BLO from estimates, and loosen it for unlikely placements
+  bool blo_priors               = false;
+  blo_pruning pruning           = blo_pruning::OFF;
   double support_threshold      = 0.9999;
   bool acc_threshold            = true;
   unsigned int filter_min       = 1;
@@ -22,6 +33,13 @@ public:
   bool dump_binary_mode         = false;
   bool load_binary_mode         = false;
   unsigned int chunk_size       = 5000;
+  // chunks read and decoded ahead of the placement, 0 for reading synchronously
+  unsigned int prefetch_depth   = 2;
   unsigned int num_threads      = 0;
   bool repeats                  = true;
+  lookup_precision precision    = lookup_precision::DOUBLE;
+  bool validate_precision       = false;
+  std::string lookup_cache_file = "";
+  size_t lookup_memory          = 0;
+  unsigned int tree_cache_size  = 32;
 };
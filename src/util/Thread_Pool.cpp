@@ -0,0 +1,126 @@
+#include "util/Thread_Pool.hpp"
+
+#include <stdexcept>
+
+Thread_Pool::Thread_Pool(const size_t num_workers)
+{
+  if (num_workers == 0) {
+    throw std::runtime_error{"Thread pool requires at least one worker!"};
+  }
+
+  for (size_t i = 0; i < num_workers; ++i) {
+    queues_.emplace_back(new Queue);
+  }
+  // worker 0 is whoever waits for the tasks
+  for (size_t i = 1; i < num_workers; ++i) {
+    threads_.emplace_back(&Thread_Pool::work_, this, i);
+  }
+}
+
+Thread_Pool::~Thread_Pool()
+{
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    stop_ = true;
+  }
+  sleep_cv_.notify_all();
+  for (auto& t : threads_) {
+    t.join();
+  }
+}
+
+void Thread_Pool::push(task_type task, const size_t worker)
+{
+  auto& queue = *queues_[worker % size()];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+  }
+  {
+    // under the lock, such that no worker misses it between checking and sleeping
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    ++queued_;
+  }
+  sleep_cv_.notify_one();
+}
+
+bool Thread_Pool::take_(const size_t worker, task_type& task)
+{
+  if (queued_ == 0) {
+    return false;
+  }
+
+  {
+    auto& own = *queues_[worker];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (not own.tasks.empty()) {
+      task = std::move(own.tasks.front());
+      own.tasks.pop_front();
+      --queued_;
+      return true;
+    }
+  }
+
+  for (size_t i = 1; i < size(); ++i) {
+    auto& other = *queues_[(worker + i) % size()];
+    std::lock_guard<std::mutex> lock(other.mutex);
+    if (not other.tasks.empty()) {
+      task = std::move(other.tasks.back());
+      other.tasks.pop_back();
+      --queued_;
+      ++steals_;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Thread_Pool::run_one(const size_t worker)
+{
+  task_type task;
+  if (not take_(worker, task)) {
+    return false;
+  }
+  task(worker);
+  return true;
+}
+
+void Thread_Pool::work_(const size_t worker)
+{
+  while (true) {
+    if (run_one(worker)) {
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    sleep_cv_.wait(lock, [this]() { return stop_ or queued_ > 0; });
+    if (stop_) {
+      return;
+    }
+  }
+}
+
+void Task_Group::wait()
+{
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (pending_ == 0) {
+        break;
+      }
+    }
+    if (pool_.run_one(0)) {
+      continue;
+    }
+
+    // the rest is running elsewhere
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return pending_ == 0; });
+  }
+
+  if (error_) {
+    auto error = error_;
+    error_ = nullptr;
+    std::rethrow_exception(error);
+  }
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Persistent pool of worker threads with one task queue per worker.
+ *
+ * Workers take tasks from the front of their own queue, and when it runs dry, steal
+ * from the back of the others. Tasks pushed for a worker in order are thus run in that
+ * order by it, unless taken over by an idle worker, which starts at the opposite end.
+ *
+ * Worker 0 is the thread waiting on a Task_Group, which runs tasks itself while it
+ * waits. With a single worker, no threads are started at all.
+ */
+class Thread_Pool
+{
+public:
+  // the argument is the id of the executing worker, in [0, size())
+  using task_type = std::function<void(size_t)>;
+
+  explicit Thread_Pool(const size_t num_workers);
+  ~Thread_Pool();
+
+  Thread_Pool(Thread_Pool const&) = delete;
+  Thread_Pool& operator=(Thread_Pool const&) = delete;
+
+  size_t size() const { return queues_.size(); }
+
+  // queues a task, to preferably be run by <worker>
+  void push(task_type task, const size_t worker);
+
+  // runs one queued task as <worker>, if there is any. Returns whether it did
+  bool run_one(const size_t worker);
+
+  // number of tasks taken from the queue of another worker so far
+  size_t steals() const { return steals_; }
+
+private:
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<task_type> tasks;
+  };
+
+  bool take_(const size_t worker, task_type& task);
+  void work_(const size_t worker);
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cv_;
+  std::atomic<size_t> queued_{0};
+  bool stop_ = false;
+
+  std::atomic<size_t> steals_{0};
+};
+
+/**
+ * Set of tasks on a Thread_Pool that can be waited for. Several groups may be in
+ * flight at once: waiting for one also runs tasks of the others.
+ *
+ * The first exception thrown by a task is rethrown by wait().
+ */
+class Task_Group
+{
+public:
+  explicit Task_Group(Thread_Pool& pool) : pool_(pool) { }
+  ~Task_Group() = default;
+
+  Task_Group(Task_Group const&) = delete;
+  Task_Group& operator=(Task_Group const&) = delete;
+
+  template <class F>
+  void run(F&& f, const size_t worker)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++pending_;
+    }
+    pool_.push([this, f](const size_t tid) mutable {
+      try {
+        f(tid);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (not error_) {
+          error_ = std::current_exception();
+        }
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--pending_ == 0) {
+        done_.notify_all();
+      }
+    }, worker);
+  }
+
+  // blocks until all tasks of the group are done, running queued tasks meanwhile
+  void wait();
+
+private:
+  Thread_Pool& pool_;
+  std::mutex mutex_;
+  std::condition_variable done_;
+  size_t pending_ = 0;
+  std::exception_ptr error_;
+};
@@ -1,11 +1,16 @@
 #include "Epatest.hpp"
 
 #include "io/Binary_Fasta.hpp"
+#include "io/fasta_conversion.hpp"
 #include "io/file_io.hpp"
 #include "seq/MSA.hpp"
+#include "seq/Encoded_MSA.hpp"
 
 #include "genesis/utils/core/options.hpp"
 
+#include <fstream>
+#include <iterator>
+
 static void compare_msas(const MSA& lhs, const MSA& rhs)
 {
   ASSERT_EQ(lhs.size(), rhs.size());
@@ -66,3 +71,180 @@ TEST(Binary_Fasta, reader)
 
   }
 }
+
+TEST(Binary_Fasta, reader_encoded)
+{
+  genesis::utils::Options::get().allow_file_overwriting(true);
+
+  const std::string orig_file(env->combined_file);
+  const std::string binfile_name(orig_file + ".bin");
+
+  auto msa = build_MSA_from_file(orig_file);
+
+  Binary_Fasta::save(msa, binfile_name);
+
+  Binary_Fasta_Reader reader(binfile_name);
+
+  Encoded_MSA read_msa;
+  size_t i = 0;
+  const size_t chunksize = 7;
+  size_t num_sequences = 0;
+  while ( (num_sequences = reader.read_next(read_msa, chunksize)) ) {
+
+    ASSERT_EQ(num_sequences, read_msa.size()) << "bad size at i=" << i;
+    ASSERT_EQ(msa.num_sites(), read_msa.num_sites());
+
+    for (size_t k = 0; k < num_sequences; ++k) {
+      EXPECT_STREQ(msa[i+k].header().c_str(), read_msa.header(k));
+
+      const auto& seq = msa[i+k].sequence();
+      for (size_t site = 0; site < seq.size(); ++site) {
+        EXPECT_EQ(std::toupper(seq[site]), NT_MAP[read_msa[k][site]]);
+      }
+    }
+
+    i+=num_sequences;
+  }
+  EXPECT_EQ(msa.size(), i);
+}
+
+TEST(Binary_Fasta, reader_prefetch)
+{
+  genesis::utils::Options::get().allow_file_overwriting(true);
+
+  const std::string orig_file(env->combined_file);
+  const std::string binfile_name(orig_file + ".bin");
+
+  auto msa = build_MSA_from_file(orig_file);
+
+  Binary_Fasta::save(msa, binfile_name);
+
+  for (const size_t depth : {1, 2, 4}) {
+    Binary_Fasta_Reader reader(binfile_name);
+
+    const size_t skip = 2;
+    reader.skip_to_sequence(skip);
+    reader.constrain(msa.size() - skip - 1);
+    reader.prefetch(depth, 3);
+
+    EXPECT_ANY_THROW(reader.skip_to_sequence(skip + 1));
+
+    Encoded_MSA read_msa;
+    size_t i = skip;
+    size_t num_sequences = 0;
+    while ( (num_sequences = reader.read_next(read_msa, 3)) ) {
+      ASSERT_EQ(num_sequences, read_msa.size()) << "bad size at i=" << i;
+
+      for (size_t k = 0; k < num_sequences; ++k) {
+        EXPECT_STREQ(msa[i+k].header().c_str(), read_msa.header(k));
+
+        const auto& seq = msa[i+k].sequence();
+        for (size_t site = 0; site < seq.size(); ++site) {
+          EXPECT_EQ(std::toupper(seq[site]), NT_MAP[read_msa[k][site]]);
+        }
+      }
+      i+=num_sequences;
+    }
+    EXPECT_EQ(msa.size() - 1, i) << "depth " << depth;
+    EXPECT_EQ(0u, reader.read_next(read_msa, 3));
+  }
+
+  // stopping before the end
+  Binary_Fasta_Reader reader(binfile_name);
+  reader.prefetch(2, 1);
+  Encoded_MSA read_msa;
+  EXPECT_EQ(1u, reader.read_next(read_msa, 1));
+  EXPECT_ANY_THROW(reader.read_next(read_msa, 2));
+}
+
+TEST(Binary_Fasta, map)
+{
+  genesis::utils::Options::get().allow_file_overwriting(true);
+
+  const std::string orig_file(env->combined_file);
+  const std::string binfile_name(orig_file + ".bin");
+
+  auto msa = build_MSA_from_file(orig_file);
+
+  Binary_Fasta::save(msa, binfile_name);
+
+  Binary_Fasta_Map map(binfile_name);
+  ASSERT_EQ(msa.size(), map.size());
+
+  // in any order
+  std::vector<unsigned char> states;
+  for (size_t i = msa.size(); i-- > 0;) {
+    const auto entry = map.entry(i);
+    EXPECT_EQ(msa[i].header(), std::string(entry.label, entry.label_size));
+
+    const auto& seq = msa[i].sequence();
+    ASSERT_EQ(seq.size(), entry.num_sites);
+    states.resize(entry.num_sites);
+    FourBit().to_states(entry.packed, entry.num_sites, states.data());
+    for (size_t site = 0; site < seq.size(); ++site) {
+      EXPECT_EQ(std::toupper(seq[site]), NT_MAP[states[site]]);
+    }
+  }
+  EXPECT_ANY_THROW(map.entry(msa.size()));
+
+  EXPECT_ANY_THROW(Binary_Fasta_Map map(orig_file));
+}
+
+static std::string file_contents(const std::string& file_name)
+{
+  std::ifstream file(file_name, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+TEST(Binary_Fasta, convert)
+{
+  genesis::utils::Options::get().allow_file_overwriting(true);
+
+  const std::string orig_file(env->combined_file);
+  const std::string saved_file(env->out_dir + "saved.bin");
+  const std::string converted_file(env->out_dir + "converted.bin");
+
+  auto msa = build_MSA_from_file(orig_file);
+  Binary_Fasta::save(msa, saved_file);
+  const auto expected = file_contents(saved_file);
+
+  // tiny segments, such that every thread gets several
+  for (const size_t threads : {1, 3}) {
+    for (const size_t segment_size : {1, 1000, 1000000}) {
+      EXPECT_EQ(msa.size(), convert_fasta_file(orig_file, converted_file, threads, segment_size));
+      EXPECT_EQ(expected, file_contents(converted_file))
+        << threads << " threads, segments of " << segment_size;
+    }
+  }
+
+  std::ifstream stream(orig_file);
+  EXPECT_EQ(msa.size(), convert_fasta_stream(stream, converted_file));
+  EXPECT_EQ(expected, file_contents(converted_file));
+}
+
+TEST(Binary_Fasta, convert_formatting)
+{
+  const std::string fasta_file(env->out_dir + "formatting.fasta");
+  const std::string converted_file(env->out_dir + "formatting.bin");
+  {
+    std::ofstream fasta(fasta_file);
+    fasta << "\n>first label \r\nAC GT\r\nac\n\n>empty\n>last\n-NN";
+  }
+
+  for (const size_t segment_size : {1, 100}) {
+    ASSERT_EQ(3u, convert_fasta_file(fasta_file, converted_file, 2, segment_size));
+
+    Binary_Fasta_Map map(converted_file);
+    ASSERT_EQ(3u, map.size());
+    EXPECT_EQ("first label", std::string(map.entry(0).label, map.entry(0).label_size));
+    EXPECT_EQ(6u, map.entry(0).num_sites);
+    EXPECT_EQ("ACGTAC", FourBit().from_fourbit(std::string(map.entry(0).packed, 3), 6));
+    EXPECT_EQ(0u, map.entry(1).num_sites);
+    EXPECT_EQ("-NN", FourBit().from_fourbit(std::string(map.entry(2).packed, 2), 3));
+  }
+
+  std::ofstream(fasta_file) << "ACGT\n>label\nACGT\n";
+  EXPECT_ANY_THROW(convert_fasta_file(fasta_file, converted_file));
+  std::ifstream stream(fasta_file);
+  EXPECT_ANY_THROW(convert_fasta_stream(stream, converted_file));
+}
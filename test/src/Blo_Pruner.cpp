@@ -0,0 +1,253 @@
+#include "Epatest.hpp"
+
+#include "core/Blo_Pruner.hpp"
+#include "core/Work.hpp"
+#include "core/Lookup_Store.hpp"
+#include "core/lookup_util.hpp"
+#include "core/pll/pll_util.hpp"
+#include "io/file_io.hpp"
+#include "io/jplace_util.hpp"
+#include "sample/Sample.hpp"
+#include "sample/Prescores.hpp"
+#include "seq/MSA.hpp"
+#include "seq/Encoded_MSA.hpp"
+#include "set_manipulators.hpp"
+#include "tree/Tiny_Tree.hpp"
+#include "tree/Tree.hpp"
+#include "util/Matrix.hpp"
+#include "util/Options.hpp"
+
+#include <memory>
+#include <string>
+#include <algorithm>
+
+using namespace std;
+
+// one query with a preplacement logl per branch
+static Sample<Placement> make_sample(const vector<double>& logls)
+{
+  Sample<Placement> sample;
+  sample.emplace_back(0);
+  for (size_t i = 0; i < logls.size(); ++i) {
+    sample.back().emplace_back(i, logls[i], 0.1, 0.1);
+  }
+  return sample;
+}
+
+static Options pruning_options(const blo_pruning mode)
+{
+  Options options;
+  options.pruning = mode;
+  options.acc_threshold = true;
+  options.support_threshold = 0.9999;
+  options.filter_min = 1;
+  return options;
+}
+
+TEST(Blo_Pruner, prune)
+{
+  auto preplace = make_sample({-100.0, -101.0, -200.0});
+  Prescores prescores(preplace);
+  EXPECT_DOUBLE_EQ(1.0, prescores.gap(0, 1));
+  EXPECT_DOUBLE_EQ(0.0, prescores.gap(0, 5));
+
+  Blo_Pruner pruner(pruning_options(blo_pruning::FAST));
+
+  // nothing to calibrate with yet
+  EXPECT_FALSE(pruner.calibrated());
+  EXPECT_EQ(3u, pruner.prune(Work(preplace), prescores).size());
+
+  // the second candidate gained 0.5 more than the first
+  auto thorough = make_sample({-90.0, -90.5});
+  pruner.calibrate(thorough, prescores, 0);
+  ASSERT_TRUE(pruner.calibrated());
+  EXPECT_DOUBLE_EQ(1.5, pruner.gain_bound());
+
+  auto work = pruner.prune(Work(preplace), prescores);
+  ASSERT_EQ(2u, work.size());
+  for (const auto& it : work) {
+    EXPECT_NE(2u, it.branch_id);
+  }
+  EXPECT_EQ(1u, pruner.pruned());
+
+  // fast mode does not check
+  EXPECT_TRUE(pruner.verify(thorough, 0).empty());
+
+  // disabled
+  Blo_Pruner off(pruning_options(blo_pruning::OFF));
+  off.calibrate(thorough, prescores, 0);
+  EXPECT_EQ(3u, off.prune(Work(preplace), prescores).size());
+}
+
+// logl bounds of a single site query <msa>, one per branch
+static shared_ptr<Lookup_Store> make_bounds(const vector<double>& logls, Encoded_MSA& msa)
+{
+  auto bounds = make_shared<Lookup_Store>(logls.size(), 4);
+  for (size_t i = 0; i < logls.size(); ++i) {
+    Matrix<double> table(1, bounds->char_map_size());
+    for (size_t c = 0; c < bounds->char_map_size(); ++c) {
+      table(0, c) = logls[i];
+    }
+    bounds->init_branch(i, std::move(table));
+  }
+  bounds->mark_complete();
+
+  msa = Encoded_MSA(1);
+  bounds->encode("A", msa.append("query", 1));
+  return bounds;
+}
+
+TEST(Blo_Pruner, verify)
+{
+  auto preplace = make_sample({-100.0, -100.5, -112.0});
+  Prescores prescores(preplace);
+  EXPECT_DOUBLE_EQ(-100.0, prescores.best(0));
+
+  Encoded_MSA msa;
+  auto bounds = make_bounds({-95.0, -95.0, -140.0}, msa);
+
+  // without bounds, exact mode prunes nothing
+  Blo_Pruner unbounded(pruning_options(blo_pruning::EXACT));
+  EXPECT_EQ(3u, unbounded.prune(Work(preplace), prescores, &msa).size());
+
+  // the third candidate cannot come close to the best one
+  Blo_Pruner pruner(pruning_options(blo_pruning::EXACT));
+  pruner.logl_bounds(bounds);
+  auto work = pruner.prune(Work(preplace), prescores, &msa);
+  ASSERT_EQ(2u, work.size());
+  for (const auto& it : work) {
+    EXPECT_NE(2u, it.branch_id);
+  }
+
+  // it makes no difference next to the optimized placements
+  EXPECT_TRUE(pruner.verify(make_sample({-100.0, -100.5}), 0).empty());
+
+  // the optimized placements turned out worse than its bound
+  auto recover = pruner.verify(make_sample({-150.0, -151.0}), 0);
+  ASSERT_EQ(1u, recover.size());
+  EXPECT_EQ(2u, (*recover.begin()).branch_id);
+  EXPECT_EQ(0u, (*recover.begin()).sequence_id);
+  EXPECT_EQ(1u, pruner.recovered());
+}
+
+// thorough placement of <work>, the placements joining those already in <sample>
+static void place_thorough( const Work& work,
+                            const Encoded_MSA& chunk,
+                            Tree& ref_tree,
+                            vector<pll_unode_t *>& branches,
+                            shared_ptr<Lookup_Store>& lookups,
+                            const Options& options,
+                            Sample<Placement>& sample)
+{
+  for (const auto& it : work) {
+    Tiny_Tree tt(branches[it.branch_id], it.branch_id, ref_tree, true, options, lookups);
+    auto pq = find_if(sample.begin(), sample.end(),
+      [&it](const PQuery<Placement>& q) { return q.sequence_id() == it.sequence_id; });
+    if (pq == sample.end()) {
+      sample.emplace_back(it.sequence_id);
+      pq = sample.end() - 1;
+    }
+    pq->emplace_back(tt.place(chunk[it.sequence_id]));
+  }
+}
+
+// the final filter of the output
+static void filter(Sample<Placement>& sample, const Options& options)
+{
+  compute_and_set_lwr(sample);
+  discard_by_accumulated_threshold( sample,
+                                    options.support_threshold,
+                                    options.filter_min,
+                                    options.filter_max);
+}
+
+// the placements of a query as written to the output, by branch id
+static vector<string> written(PQuery<Placement> pq)
+{
+  sort(pq.begin(), pq.end(),
+    [](const Placement& a, const Placement& b) { return a.branch_id() < b.branch_id(); });
+  vector<string> result;
+  for (const auto& p : pq) {
+    result.push_back(placement_to_jplace_string(p));
+  }
+  result.push_back(to_string(pq.entropy()));
+  return result;
+}
+
+static void exact_pruning_(const Options base)
+{
+  // buildup
+  auto options = base;
+  options.pruning = blo_pruning::EXACT;
+
+  MSA msa = build_MSA_from_file(env->reference_file);
+  MSA queries = build_MSA_from_file(env->query_file);
+
+  auto ref_tree = Tree(env->tree_file, msa, env->model, options);
+  const auto num_branches = ref_tree.nums().branches;
+  const auto sites = ref_tree.partition()->sites;
+
+  vector<pll_unode_t *> branches(num_branches);
+  utree_query_branches(ref_tree.tree(), &branches[0]);
+
+  auto lookups = make_shared<Lookup_Store>(num_branches, ref_tree.partition()->states);
+  auto bounds = build_logl_bounds(ref_tree, branches, options);
+  ASSERT_TRUE(bounds != nullptr);
+
+  Encoded_MSA chunk(sites);
+  for (const auto& q : queries) {
+    lookups->encode(q.sequence(), chunk.append(q.header(), sites));
+  }
+
+  // preplacement and candidate selection
+  Sample<Placement> preplace;
+  for (size_t i = 0; i < chunk.size(); ++i) {
+    preplace.emplace_back(i);
+  }
+  for (size_t b = 0; b < num_branches; ++b) {
+    Tiny_Tree tt(branches[b], b, ref_tree, false, options, lookups);
+    for (size_t i = 0; i < chunk.size(); ++i) {
+      preplace[i].emplace_back(tt.place(chunk[i]));
+    }
+  }
+  compute_and_set_lwr(preplace);
+  discard_by_accumulated_threshold(preplace, 0.99, options.filter_min, options.filter_max);
+  Prescores prescores(preplace);
+  Work work(preplace);
+
+  // tests
+  Sample<Placement> full;
+  place_thorough(work, chunk, ref_tree, branches, lookups, options, full);
+
+  // the bounds hold
+  for (const auto& pq : full) {
+    for (const auto& p : pq) {
+      EXPECT_LE(p.likelihood(),
+                bounds->sum_precomputed_sitelk(p.branch_id(), chunk[pq.sequence_id()]));
+    }
+  }
+  filter(full, options);
+
+  Blo_Pruner pruner(options);
+  pruner.logl_bounds(bounds);
+  Sample<Placement> pruned;
+  place_thorough(pruner.prune(work, prescores, &chunk), chunk, ref_tree, branches, lookups,
+                 options, pruned);
+  place_thorough(pruner.verify(pruned, 0), chunk, ref_tree, branches, lookups, options, pruned);
+  filter(pruned, options);
+
+  // the same output, placements and LWRs included
+  ASSERT_EQ(full.size(), pruned.size());
+  for (const auto& pq : full) {
+    auto other = find_if(pruned.begin(), pruned.end(),
+      [&pq](const PQuery<Placement>& q) { return q.sequence_id() == pq.sequence_id(); });
+    ASSERT_TRUE(other != pruned.end());
+    EXPECT_EQ(written(pq), written(*other));
+  }
+  // teardown
+}
+
+TEST(Blo_Pruner, exact_pruning)
+{
+  all_combinations(exact_pruning_);
+}
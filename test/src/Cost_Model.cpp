@@ -0,0 +1,89 @@
+#include "Epatest.hpp"
+
+#include "core/Cost_Model.hpp"
+#include "core/Work.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+using namespace std;
+
+TEST(Cost_Model, split_keeps_branches_together)
+{
+  const size_t num_branches = 40;
+  const size_t num_parts = 8;
+  // lookups: the setup of a branch dominates
+  Cost_Model model(vector<bool>(num_branches, false), 1000, 1000.0, 4, 4, 16, false, false);
+
+  Work work(make_pair(0, num_branches), make_pair(0, 50));
+  vector<Work> parts;
+  auto predicted = split(work, parts, num_parts, model);
+
+  ASSERT_EQ(num_parts, parts.size());
+  ASSERT_EQ(num_parts, predicted.size());
+
+  // parts are consecutive and complete
+  size_t total = 0;
+  for (auto& p : parts) {
+    total += p.size();
+  }
+  EXPECT_EQ(work.size(), total);
+
+  // no branch is spread over several parts
+  vector<size_t> part_of(num_branches, num_parts);
+  for (size_t k = 0; k < num_parts; ++k) {
+    for (auto it : parts[k]) {
+      EXPECT_TRUE(part_of[it.branch_id] == num_parts or part_of[it.branch_id] == k);
+      part_of[it.branch_id] = k;
+    }
+    EXPECT_DOUBLE_EQ(model.predict(parts[k]), predicted[k]);
+  }
+
+  // five branches each
+  for (auto& p : parts) {
+    EXPECT_EQ(250u, p.size());
+  }
+}
+
+TEST(Cost_Model, split_large_branch)
+{
+  // BLO: the pairs dominate, one branch holds most of them
+  Cost_Model model(vector<bool>(4, true), 100, 100.0, 4, 1, 16, true, false);
+
+  Sample<> sample;
+  for (unsigned int seq_id = 0; seq_id < 100; ++seq_id) {
+    sample.emplace_back(seq_id);
+    sample.back().emplace_back(2,-10,0.9,0.9);
+    if (seq_id < 4) {
+      sample.back().emplace_back(0,-10,0.9,0.9);
+      sample.back().emplace_back(3,-10,0.9,0.9);
+    }
+  }
+  Work work(sample);
+  vector<Work> parts;
+  auto predicted = split(work, parts, 4, model);
+
+  ASSERT_EQ(4u, parts.size());
+  const auto total = accumulate(predicted.begin(), predicted.end(), 0.0);
+  for (auto& p : parts) {
+    EXPECT_GT(p.size(), 0u);
+  }
+  // balanced up to a pair and the repeated setups
+  const auto largest = *max_element(predicted.begin(), predicted.end());
+  EXPECT_LT(largest, 1.1 * total / 4);
+}
+
+TEST(Cost_Model, split_empty)
+{
+  Cost_Model model(vector<bool>(), 100, 100.0, 4, 1, 16, false, true);
+
+  Work work;
+  vector<Work> parts;
+  auto predicted = split(work, parts, 5, model);
+
+  ASSERT_EQ(5u, parts.size());
+  for (size_t k = 0; k < parts.size(); ++k) {
+    EXPECT_EQ(0u, parts[k].size());
+    EXPECT_EQ(0.0, predicted[k]);
+  }
+}
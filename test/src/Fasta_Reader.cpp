@@ -0,0 +1,85 @@
+#include "Epatest.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+#include "io/Fasta_Reader.hpp"
+#include "io/Query_Source.hpp"
+#include "io/Binary_Fasta.hpp"
+#include "io/file_io.hpp"
+#include "seq/MSA.hpp"
+#include "seq/Encoded_MSA.hpp"
+
+#include "genesis/utils/core/options.hpp"
+
+using namespace std;
+
+static void compare_chunks(Query_Source& source, const MSA& msa, const size_t chunk_size)
+{
+  Encoded_MSA chunk;
+  size_t i = 0;
+  size_t num_sequences = 0;
+  while ( (num_sequences = source.read_next(chunk, chunk_size)) ) {
+    ASSERT_EQ(num_sequences, chunk.size());
+    for (size_t k = 0; k < num_sequences; ++k) {
+      EXPECT_STREQ(msa[i+k].header().c_str(), chunk.header(k));
+
+      const auto& seq = msa[i+k].sequence();
+      ASSERT_EQ(seq.size(), chunk.num_sites());
+      for (size_t site = 0; site < seq.size(); ++site) {
+        EXPECT_EQ(toupper(seq[site]), NT_MAP[chunk[k][site]]);
+      }
+    }
+    i += num_sequences;
+  }
+  EXPECT_EQ(msa.size(), i);
+  EXPECT_EQ(0u, source.read_next(chunk, chunk_size));
+}
+
+TEST(Fasta_Reader, read)
+{
+  const auto msa = build_MSA_from_file(env->combined_file);
+
+  for (const size_t depth : {0, 1, 3}) {
+    Fasta_Reader reader(env->combined_file);
+    reader.prefetch(depth, 4);
+    compare_chunks(reader, msa, 4);
+    EXPECT_EQ(msa.size(), reader.num_read());
+  }
+}
+
+TEST(Fasta_Reader, make_query_source)
+{
+  genesis::utils::Options::get().allow_file_overwriting(true);
+
+  const auto msa = build_MSA_from_file(env->combined_file);
+  const auto bfast_file = Binary_Fasta::fasta_to_bfast(env->combined_file, env->out_dir);
+
+  auto fasta = make_query_source(env->combined_file);
+  EXPECT_NE(nullptr, dynamic_cast<Fasta_Reader*>(fasta.get()));
+  compare_chunks(*fasta, msa, 5);
+
+  auto bfast = make_query_source(bfast_file);
+  EXPECT_NE(nullptr, dynamic_cast<Binary_Fasta_Reader*>(bfast.get()));
+  bfast->prefetch(2, 5);
+  compare_chunks(*bfast, msa, 5);
+}
+
+TEST(Fasta_Reader, invalid)
+{
+  const string fasta_file(env->out_dir + "invalid.fasta");
+
+  ofstream(fasta_file) << ">a\nACGT\n>b\nACXT\n";
+  Fasta_Reader reader(fasta_file);
+  reader.prefetch(1, 1);
+  Encoded_MSA chunk;
+  EXPECT_EQ(1u, reader.read_next(chunk, 1));
+  EXPECT_THROW(reader.read_next(chunk, 1), runtime_error);
+
+  ofstream(fasta_file) << ">a\nACGT\n>b\nACG\n";
+  Fasta_Reader unequal(fasta_file);
+  EXPECT_THROW(unequal.read_next(chunk, 2), runtime_error);
+
+  ofstream(fasta_file) << "ACGT\n>a\nACGT\n";
+  EXPECT_THROW(Fasta_Reader{fasta_file}, runtime_error);
+}
@@ -0,0 +1,87 @@
+#include "Epatest.hpp"
+
+#include <stdexcept>
+
+#include "seq/Label_Store.hpp"
+#include "seq/Encoded_MSA.hpp"
+#include "sample/Sample.hpp"
+#include "io/jplace_util.hpp"
+
+using namespace std;
+
+TEST(Label_Store, append_and_lookup)
+{
+  Label_Store labels;
+  labels.append(0, "a");
+  labels.append(1, "bb");
+  labels.append(5, "");
+  labels.append(6, "ccc");
+
+  EXPECT_EQ( 4u, labels.size() );
+  EXPECT_STREQ( "a", labels[0] );
+  EXPECT_STREQ( "bb", labels[1] );
+  EXPECT_STREQ( "", labels[5] );
+  EXPECT_STREQ( "ccc", labels[6] );
+  EXPECT_FALSE( labels.contains(2) );
+  EXPECT_FALSE( labels.contains(7) );
+  EXPECT_THROW( labels[3], runtime_error );
+  EXPECT_THROW( labels.append(4, "x"), runtime_error );
+
+  labels.clear();
+  EXPECT_TRUE( labels.empty() );
+  EXPECT_FALSE( labels.contains(0) );
+  labels.append(3, "d");
+  EXPECT_STREQ( "d", labels[3] );
+  EXPECT_FALSE( labels.contains(0) );
+}
+
+TEST(Label_Store, chunks_and_merge)
+{
+  // two ranks with two chunks each, gathered in the wrong order
+  Encoded_MSA chunk;
+  Label_Store rank_0;
+  Label_Store rank_1;
+
+  chunk.append("q0", 0);
+  chunk.append("q1", 0);
+  rank_0.append(chunk.labels(), 0);
+  chunk.clear();
+  chunk.append("q2", 0);
+  rank_0.append(chunk.labels(), 2);
+  chunk.clear();
+
+  chunk.append("q3", 0);
+  chunk.append("q4", 0);
+  rank_1.append(chunk.labels(), 3);
+  chunk.clear();
+  chunk.append("q5", 0);
+  rank_1.append(chunk.labels(), 5);
+
+  EXPECT_STREQ( "q5", chunk.header(0) );
+  EXPECT_THROW( rank_1.append(chunk.labels(), 4), runtime_error );
+
+  Label_Store all;
+  all.merge(std::move(rank_1));
+  all.merge(std::move(rank_0));
+  ASSERT_EQ( 6u, all.size() );
+  for (size_t i = 0; i < all.size(); ++i) {
+    EXPECT_EQ( "q" + to_string(i), string(all[i]) );
+  }
+
+  Label_Store overlap;
+  overlap.append(4, "x");
+  EXPECT_THROW( all.merge(std::move(overlap)), runtime_error );
+}
+
+TEST(Label_Store, jplace_names)
+{
+  Label_Store labels;
+  labels.append(7, "query_seven");
+
+  Sample<Placement> sample;
+  sample.emplace_back(7);
+  sample.back().emplace_back(1, -10.0, 0.1, 0.2);
+
+  const auto jplace = sample_to_jplace_string(sample, labels);
+  EXPECT_NE( string::npos, jplace.find("\"n\": [\"query_seven\"]") );
+}
@@ -0,0 +1,366 @@
+#include "Epatest.hpp"
+
+#include <array>
+#include <cmath>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "core/Lookup_Store.hpp"
+#include "core/lookup_kernels.hpp"
+#include "core/lookup_util.hpp"
+#include "seq/Encoded_MSA.hpp"
+#include "util/maps.hpp"
+
+static std::string random_sequence(std::mt19937& gen, const size_t sites)
+{
+  std::uniform_int_distribution<size_t> dist(0, NT_MAP_SIZE - 1);
+  std::string seq(sites, '-');
+  for (auto& c : seq) {
+    c = NT_MAP[dist(gen)];
+  }
+  return seq;
+}
+
+static void fill_random(Lookup_Store& store,
+                        const size_t branch_id,
+                        const size_t sites,
+                        std::mt19937& gen)
+{
+  std::uniform_real_distribution<double> dist(-20.0, 0.0);
+  std::vector<std::vector<double>> precomps(store.char_map_size(),
+                                            std::vector<double>(sites));
+  for (auto& col : precomps) {
+    for (auto& v : col) {
+      v = dist(gen);
+    }
+  }
+  store.init_branch(branch_id, precomps);
+}
+
+static void store_encode(const Lookup_Store& store,
+                         const std::string& seq,
+                         Encoded_MSA& encoded,
+                         const size_t i)
+{
+  store.encode(seq, encoded.append(std::to_string(i), seq.size()));
+}
+
+TEST(Lookup_Store, sum_precomputed_sitelk)
+{
+  std::mt19937 gen(42);
+  // not a multiple of the lane count, to exercise the remainder handling
+  const size_t sites = 1003;
+
+  Lookup_Store store(1, 4);
+  fill_random(store, 0, sites, gen);
+
+  const auto& lookup = store[0];
+
+  for (size_t i = 0; i < 10; ++i) {
+    const auto seq = random_sequence(gen, sites);
+    std::vector<unsigned char> states(sites);
+    store.encode(seq, states.data());
+
+    double naive = 0.0;
+    for (size_t site = 0; site < sites; ++site) {
+      naive += lookup(site, store.char_position(seq[site]));
+    }
+
+    std::array<double, LOOKUP_LANES> lanes{};
+    lookup_kernel_scalar( lookup.get_array().data(),
+                          lookup.cols(),
+                          states.data(),
+                          0,
+                          sites,
+                          lanes.data());
+    const auto scalar = reduce_lanes(lanes.data());
+
+    // the dispatched kernel must be bit-identical to the scalar one
+    EXPECT_EQ(scalar, store.sum_precomputed_sitelk(0, states.data()));
+    EXPECT_EQ(scalar, store.sum_precomputed_sitelk(0, seq));
+    // and agree with the naive summation up to rounding
+    EXPECT_NEAR(naive, scalar, 1e-8);
+  }
+}
+
+TEST(Lookup_Store, kernel_ranges)
+{
+  std::mt19937 gen(1337);
+  const size_t sites = 517;
+
+  Lookup_Store store(1, 4);
+  fill_random(store, 0, sites, gen);
+
+  const auto& lookup = store[0];
+  const auto seq = random_sequence(gen, sites);
+  std::vector<unsigned char> states(sites);
+  store.encode(seq, states.data());
+
+  std::array<double, LOOKUP_LANES> whole{};
+  lookup_kernel_scalar( lookup.get_array().data(), lookup.cols(), states.data(),
+                        0, sites, whole.data());
+
+  // splitting the site range anywhere must not change the result
+  for (size_t mid : {0ul, 1ul, 7ul, 8ul, 13ul, 256ul, 511ul, sites}) {
+    std::array<double, LOOKUP_LANES> split{};
+    lookup_kernel()(lookup.get_array().data(), lookup.cols(), states.data(),
+                    0, mid, split.data());
+    lookup_kernel()(lookup.get_array().data(), lookup.cols(), states.data(),
+                    mid, sites, split.data());
+
+    EXPECT_EQ(reduce_lanes(whole.data()), reduce_lanes(split.data())) << "mid = " << mid;
+  }
+}
+
+TEST(Lookup_Store, sum_precomputed_sitelk_block)
+{
+  std::mt19937 gen(7);
+  // spans several tiles, with a partial one at the end
+  const size_t sites = 1500;
+
+  Lookup_Store store(1, 4);
+  fill_random(store, 0, sites, gen);
+
+  std::vector<std::string> seqs;
+  Encoded_MSA encoded;
+  for (size_t i = 0; i < 23; ++i) {
+    seqs.push_back(random_sequence(gen, sites));
+    store_encode(store, seqs.back(), encoded, i);
+  }
+  std::vector<const unsigned char *> block;
+  for (size_t i = 0; i < encoded.size(); ++i) {
+    block.push_back(encoded[i]);
+  }
+
+  std::vector<double> result;
+  store.sum_precomputed_sitelk(0, block, result);
+
+  ASSERT_EQ(seqs.size(), result.size());
+  for (size_t i = 0; i < seqs.size(); ++i) {
+    EXPECT_EQ(store.sum_precomputed_sitelk(0, seqs[i]), result[i]);
+  }
+}
+
+TEST(Lookup_Store, reduced_precision)
+{
+  const size_t sites = 999;
+
+  Lookup_Store reference(1, 4);
+  Lookup_Store single(1, 4, lookup_precision::FLOAT);
+  Lookup_Store fixed(1, 4, lookup_precision::INT16);
+
+  // same tables in every store
+  std::mt19937 gen_ref(23), gen_single(23), gen_fixed(23);
+  fill_random(reference, 0, sites, gen_ref);
+  fill_random(single, 0, sites, gen_single);
+  fill_random(fixed, 0, sites, gen_fixed);
+
+  ASSERT_TRUE(single.has_branch(0));
+  ASSERT_TRUE(fixed.has_branch(0));
+  ASSERT_EQ(sites, fixed.sites(0));
+
+  EXPECT_EQ(sites * NT_MAP_SIZE * sizeof(double), reference.size_in_bytes());
+  EXPECT_EQ(sites * NT_MAP_SIZE * sizeof(float), single.size_in_bytes());
+  EXPECT_EQ(sites * NT_MAP_SIZE * sizeof(int16_t), fixed.size_in_bytes());
+
+  // per-site error bound of the fixed-point representation (value range is 20)
+  const double int16_bound = sites * 20.0 / (2.0 * 32767) / 2.0;
+
+  std::mt19937 gen(5);
+  Encoded_MSA encoded;
+  for (size_t i = 0; i < 17; ++i) {
+    store_encode(reference, random_sequence(gen, sites), encoded, i);
+  }
+  std::vector<const unsigned char *> block;
+  for (size_t i = 0; i < encoded.size(); ++i) {
+    block.push_back(encoded[i]);
+  }
+
+  std::vector<double> single_block, fixed_block;
+  single.sum_precomputed_sitelk(0, block, single_block);
+  fixed.sum_precomputed_sitelk(0, block, fixed_block);
+
+  for (size_t i = 0; i < encoded.size(); ++i) {
+    const auto expected = reference.sum_precomputed_sitelk(0, encoded[i]);
+
+    EXPECT_NEAR(expected, single_block[i], std::abs(expected) * 1e-6);
+    EXPECT_NEAR(expected, fixed_block[i], int16_bound);
+
+    // blocking must not change the results of the reduced variants either
+    EXPECT_EQ(single.sum_precomputed_sitelk(0, encoded[i]), single_block[i]);
+    EXPECT_EQ(fixed.sum_precomputed_sitelk(0, encoded[i]), fixed_block[i]);
+  }
+}
+
+TEST(Lookup_Store, cache_file)
+{
+  const size_t sites = 300;
+  const size_t num_branches = 5;
+  const std::string file_name(env->out_dir + "lookup_cache.bin");
+  const uint64_t key = 0xEA;
+
+  for (auto precision : { lookup_precision::DOUBLE,
+                          lookup_precision::FLOAT,
+                          lookup_precision::INT16}) {
+    std::mt19937 gen(11);
+    Lookup_Store built(num_branches, 4, precision);
+    for (size_t i = 0; i < num_branches; ++i) {
+      fill_random(built, i, sites, gen);
+    }
+    built.mark_complete();
+
+    save_lookup_cache(built, file_name, key);
+
+    // wrong key or layout: the file must be rejected
+    Lookup_Store other_key(num_branches, 4, precision);
+    EXPECT_FALSE(load_lookup_cache(other_key, file_name, key + 1));
+    Lookup_Store other_size(num_branches + 1, 4, precision);
+    EXPECT_FALSE(load_lookup_cache(other_size, file_name, key));
+
+    Lookup_Store mapped(num_branches, 4, precision);
+    ASSERT_TRUE(load_lookup_cache(mapped, file_name, key));
+    EXPECT_TRUE(mapped.complete());
+    EXPECT_EQ(built.size_in_bytes(), mapped.size_in_bytes());
+
+    Encoded_MSA encoded;
+    for (size_t i = 0; i < 4; ++i) {
+      store_encode(built, random_sequence(gen, sites), encoded, i);
+    }
+
+    for (size_t b = 0; b < num_branches; ++b) {
+      for (size_t i = 0; i < encoded.size(); ++i) {
+        EXPECT_EQ(built.sum_precomputed_sitelk(b, encoded[i]),
+                  mapped.sum_precomputed_sitelk(b, encoded[i]));
+      }
+    }
+  }
+}
+
+TEST(Lookup_Store, memory_budget)
+{
+  std::mt19937 gen(3);
+  const size_t sites = 100;
+  const size_t num_branches = 4;
+  const size_t table_bytes = sites * NT_MAP_SIZE * sizeof(double);
+
+  Lookup_Store store(num_branches, 4);
+  // room for two tables
+  store.memory_budget(2 * table_bytes);
+
+  auto use = [&](const size_t branch_id) {
+    const std::lock_guard<std::mutex> lock(store.get_mutex(branch_id));
+    if (not store.has_branch(branch_id)) {
+      fill_random(store, branch_id, sites, gen);
+    }
+    return store.pin(branch_id);
+  };
+
+  use(0);
+  use(1);
+  use(0);
+  EXPECT_EQ(1u, store.hits());
+  EXPECT_EQ(2u, store.misses());
+  EXPECT_EQ(0u, store.evictions());
+
+  // 1 is the least recently used table
+  use(2);
+  EXPECT_EQ(1u, store.evictions());
+  EXPECT_TRUE(store.has_branch(0));
+  EXPECT_FALSE(store.has_branch(1));
+  EXPECT_TRUE(store.has_branch(2));
+  EXPECT_EQ(2 * table_bytes, store.size_in_bytes());
+
+  {
+    // pinned tables are kept, even beyond the budget
+    auto pin_0 = use(0);
+    auto pin_2 = use(2);
+    auto pin_3 = use(3);
+    EXPECT_TRUE(store.has_branch(0));
+    EXPECT_TRUE(store.has_branch(2));
+    EXPECT_TRUE(store.has_branch(3));
+  }
+
+  // once released, the next use brings the store back within budget
+  use(1);
+  EXPECT_EQ(3u, store.evictions());
+  EXPECT_EQ(2 * table_bytes, store.size_in_bytes());
+  EXPECT_TRUE(store.has_branch(1));
+  EXPECT_TRUE(store.has_branch(3));
+  EXPECT_EQ(3u, store.hits());
+  EXPECT_EQ(5u, store.misses());
+}
+
+TEST(Lookup_Store, ranged)
+{
+  const size_t sites = 700;
+  const unsigned char gap = 0;
+
+  for (auto precision : { lookup_precision::DOUBLE,
+                          lookup_precision::FLOAT,
+                          lookup_precision::INT16}) {
+    std::mt19937 gen(17);
+    Lookup_Store store(1, 4, precision);
+    store.ranged(true);
+    fill_random(store, 0, sites, gen);
+    ASSERT_EQ(gap, store.char_position('-'));
+
+    // amplicon-like queries: gaps except for a stretch in the middle. The second to last
+    // is all gaps, the last one reaches to the end of the alignment
+    Encoded_MSA encoded;
+    for (size_t i = 0; i < 10; ++i) {
+      auto seq = random_sequence(gen, sites);
+      const size_t first = (i == 9) ? sites - 60 : 37 * i;
+      const size_t last = (i == 9) ? sites : (i == 8) ? first : first + 100 + i;
+      for (size_t s = 0; s < sites; ++s) {
+        if (s < first or s >= last) {
+          seq[s] = '-';
+        }
+      }
+      // first and last site of the range must not be gaps
+      if (first < last) {
+        seq[first] = 'A';
+        seq[last - 1] = 'C';
+      }
+      store_encode(store, seq, encoded, i);
+    }
+    encoded.compute_ranges(gap);
+    ASSERT_TRUE(encoded.has_ranges());
+    EXPECT_EQ(Encoded_MSA::range_type(37, 138), encoded.range(1));
+    EXPECT_EQ(Encoded_MSA::range_type(0, 0), encoded.range(8));
+    EXPECT_EQ(Encoded_MSA::range_type(sites - 60, sites), encoded.range(9));
+
+    std::vector<const unsigned char *> block;
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for (size_t i = 0; i < encoded.size(); ++i) {
+      block.push_back(encoded[i]);
+      ranges.push_back(encoded.range(i));
+    }
+
+    std::vector<double> full, partial;
+    store.sum_precomputed_sitelk(0, block, full);
+    store.sum_precomputed_sitelk(0, block, ranges, partial);
+
+    for (size_t i = 0; i < encoded.size(); ++i) {
+      if (precision == lookup_precision::INT16) {
+        // the integer sums are exact, regardless of the order
+        EXPECT_EQ(full[i], partial[i]);
+      } else {
+        EXPECT_NEAR(full[i], partial[i], std::abs(full[i]) * 1e-12);
+      }
+      EXPECT_EQ(partial[i], store.sum_precomputed_sitelk(0, block[i], ranges[i]));
+    }
+
+    // ranges beyond the alignment are cut off at its end
+    std::vector<std::pair<size_t, size_t>> wide(ranges);
+    wide[9].second = sites + 25;
+    wide[8] = {sites + 10, sites + 20};
+    std::vector<double> clamped;
+    store.sum_precomputed_sitelk(0, block, wide, clamped);
+    EXPECT_EQ(partial[9], clamped[9]);
+    EXPECT_EQ(partial[9], store.sum_precomputed_sitelk(0, block[9], wide[9]));
+    EXPECT_EQ(partial[8], clamped[8]);
+    EXPECT_EQ(partial[8], store.sum_precomputed_sitelk(0, block[8], wide[8]));
+  }
+}
@@ -0,0 +1,84 @@
+#include "Epatest.hpp"
+
+#include "core/Work.hpp"
+#include "sample/Sample.hpp"
+#include "sample/Result_Table.hpp"
+
+using namespace std;
+
+TEST(Result_Table, slots_and_flush)
+{
+  // three parts, with the queries spread over them
+  vector<Work> parts;
+  parts.emplace_back(vector<Work::Work_Pair>{ {0, 0}, {0, 2}, {1, 0} });
+  parts.emplace_back(vector<Work::Work_Pair>{ {2, 2}, {2, 0} });
+  parts.emplace_back(vector<Work::Work_Pair>{ {3, 2} });
+
+  Result_Table<Placement> table(parts, 4);
+  ASSERT_EQ( 4u, table.size() );
+
+  // as if every part was placed by another worker, in reverse
+  for (size_t i = parts.size(); i-- > 0;) {
+    size_t k = 0;
+    for (const auto& it : parts[i]) {
+      table.at(i, k++, it.sequence_id) = Placement(it.branch_id, -1.0 * it.branch_id, 0.1, 0.2);
+    }
+  }
+
+  // an existing PQuery of the chunk, and one of another chunk
+  const size_t offset = 10;
+  Sample<Placement> sample;
+  sample.emplace_back(offset + 2);
+  sample.back().emplace_back(7, -7.0, 0.1, 0.2);
+  sample.emplace_back(3);
+
+  table.flush(sample, offset);
+
+  // no PQuery for the queries without any pairs
+  ASSERT_EQ( 3u, sample.size() );
+
+  EXPECT_EQ( offset + 2, sample[0].sequence_id() );
+  ASSERT_EQ( 4u, sample[0].size() );
+  // in the order of the parts, after what was there
+  EXPECT_EQ( 7u, sample[0][0].branch_id() );
+  EXPECT_EQ( 0u, sample[0][1].branch_id() );
+  EXPECT_EQ( 2u, sample[0][2].branch_id() );
+  EXPECT_EQ( 3u, sample[0][3].branch_id() );
+
+  EXPECT_EQ( 0u, sample[1].size() );
+
+  EXPECT_EQ( offset, sample[2].sequence_id() );
+  ASSERT_EQ( 3u, sample[2].size() );
+  EXPECT_EQ( 0u, sample[2][0].branch_id() );
+  EXPECT_EQ( 1u, sample[2][1].branch_id() );
+  EXPECT_EQ( 2u, sample[2][2].branch_id() );
+  EXPECT_DOUBLE_EQ( -2.0, sample[2][2].likelihood() );
+}
+
+TEST(Result_Table, add_placement)
+{
+  Sample<Placement> sample;
+  sample.add_placement(0, 1, -1.0, 0.1, 0.2);
+  sample.add_placement(1, 2, -2.0, 0.1, 0.2);
+  sample.add_placement(1, 3, -3.0, 0.1, 0.2);
+  sample.add_placement(0, 4, -4.0, 0.1, 0.2);
+
+  ASSERT_EQ( 2u, sample.size() );
+  EXPECT_EQ( 2u, sample[0].size() );
+  EXPECT_EQ( 4u, sample[0][1].branch_id() );
+  EXPECT_EQ( 2u, sample[1].size() );
+
+  // pquerys added by other means are found as well
+  sample.push_back(PQuery<Placement>(5));
+  sample.add_placement(5, 5, -5.0, 0.1, 0.2);
+  ASSERT_EQ( 3u, sample.size() );
+  EXPECT_EQ( 1u, sample[2].size() );
+
+  sample.erase(sample.begin(), sample.begin() + 1);
+  sample.add_placement(1, 6, -6.0, 0.1, 0.2);
+  sample.add_placement(0, 7, -7.0, 0.1, 0.2);
+  ASSERT_EQ( 3u, sample.size() );
+  EXPECT_EQ( 3u, sample[0].size() );
+  EXPECT_EQ( 0u, sample[2].sequence_id() );
+  EXPECT_EQ( 7u, sample[2][0].branch_id() );
+}
@@ -0,0 +1,78 @@
+#include "Epatest.hpp"
+
+#include "util/Thread_Pool.hpp"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+TEST(Thread_Pool, run_all_tasks)
+{
+  for (size_t num_workers : {1, 2, 5}) {
+    Thread_Pool pool(num_workers);
+    ASSERT_EQ(num_workers, pool.size());
+
+    // reused across groups
+    for (size_t round = 0; round < 3; ++round) {
+      const size_t num_tasks = 1000;
+      vector<size_t> done(num_tasks, 0);
+      atomic<size_t> bad_worker{0};
+
+      Task_Group group(pool);
+      for (size_t i = 0; i < num_tasks; ++i) {
+        group.run([&, i](const size_t worker) {
+          if (worker >= num_workers) {
+            ++bad_worker;
+          }
+          ++done[i];
+        }, i % num_workers);
+      }
+      group.wait();
+
+      EXPECT_EQ(0u, bad_worker);
+      for (auto d : done) {
+        EXPECT_EQ(1u, d);
+      }
+    }
+  }
+}
+
+TEST(Thread_Pool, groups_in_flight)
+{
+  Thread_Pool pool(4);
+
+  atomic<size_t> first_sum{0};
+  atomic<size_t> second_sum{0};
+
+  Task_Group first(pool);
+  Task_Group second(pool);
+  for (size_t i = 1; i <= 100; ++i) {
+    first.run([&, i](size_t) { first_sum += i; }, i);
+    second.run([&, i](size_t) { second_sum += 2 * i; }, i);
+  }
+  first.wait();
+  EXPECT_EQ(5050u, first_sum);
+  second.wait();
+  EXPECT_EQ(10100u, second_sum);
+}
+
+TEST(Thread_Pool, exception)
+{
+  Thread_Pool pool(3);
+
+  atomic<size_t> done{0};
+  Task_Group group(pool);
+  for (size_t i = 0; i < 50; ++i) {
+    group.run([&, i](size_t) {
+      if (i == 17) {
+        throw runtime_error{"task failed"};
+      }
+      ++done;
+    }, i);
+  }
+  EXPECT_THROW(group.wait(), runtime_error);
+  // the other tasks still ran
+  EXPECT_EQ(49u, done);
+}
@@ -7,6 +7,8 @@
 #include "io/Binary.hpp"
 #include "tree/Tree_Numbers.hpp"
 #include "tree/Tiny_Tree.hpp"
+#include "tree/Tiny_Tree_Cache.hpp"
+#include "tree/tiny_util.hpp"
 #include "tree/Tree.hpp"
 #include "sample/Sample.hpp"
 #include "seq/MSA.hpp"
@@ -16,6 +18,8 @@
 
 #include <tuple>
 #include <limits>
+#include <cmath>
+#include <algorithm>
 
 using namespace std;
 
@@ -49,6 +53,87 @@ TEST(Tiny_Tree, place)
   all_combinations(place_);
 }
 
+static void precompute_sites_(const Options options)
+{
+  // buildup
+  MSA msa = build_MSA_from_file(env->reference_file);
+  auto ref_tree = Tree(env->tree_file, msa, env->model, options);
+
+  Lookup_Store lookup(ref_tree.nums().branches, ref_tree.partition()->states);
+
+  vector<pll_unode_t *> branches(ref_tree.nums().branches);
+  auto num_traversed = utree_query_branches(ref_tree.tree(), &branches[0]);
+
+  // tests
+  for (size_t i = 0; i < num_traversed; ++i) {
+    auto proximal = branches[i]->back;
+    auto distal = branches[i];
+    bool tip_tip_case = false;
+    if (!distal->next) {
+      tip_tip_case = true;
+    } else if (!proximal->next) {
+      tip_tip_case = true;
+      distal = proximal;
+      proximal = distal->back;
+    }
+
+    auto tree = make_tiny_tree_structure(proximal, distal, tip_tip_case);
+    auto partition = make_tiny_partition(ref_tree, tree, proximal, distal, tip_tip_case);
+    init_tiny_partials(partition, tree);
+
+    Matrix<double> fused;
+    ASSERT_TRUE(precompute_sites_fused(lookup, fused, partition, tree));
+
+    // every column must agree with the per-character pll computation
+    vector<double> expected;
+    for (size_t ch = 0; ch < lookup.char_map_size(); ++ch) {
+      precompute_sites_static(lookup.char_map(ch), expected, partition, tree);
+      ASSERT_EQ(expected.size(), fused.rows());
+      for (size_t site = 0; site < expected.size(); ++site) {
+        EXPECT_NEAR(expected[site], fused(site, ch), 1e-10 * std::max(1.0, std::abs(expected[site])));
+      }
+    }
+
+    tiny_partition_destroy(partition);
+    utree_destroy(tree);
+  }
+  // teardown
+}
+
+TEST(Tiny_Tree, precompute_sites_fused)
+{
+  all_combinations(precompute_sites_);
+}
+
+TEST(Tiny_Tree, place_ranged)
+{
+  // buildup
+  Options options;
+  options.repeats = false;
+  MSA msa = build_MSA_from_file(env->reference_file);
+  MSA queries = build_MSA_from_file(env->query_file);
+
+  auto ref_tree = Tree(env->tree_file, msa, env->model, options);
+  auto lookup = make_shared<Lookup_Store>(ref_tree.nums().branches, ref_tree.partition()->states);
+  auto root = get_root(ref_tree.tree());
+
+  Options ranged_options(options);
+  ranged_options.ranged = true;
+
+  // tests
+  Tiny_Tree full(root, 0, ref_tree, true, options, lookup);
+  Tiny_Tree ranged(root, 0, ref_tree, true, ranged_options, lookup);
+
+  for (auto const &x : queries) {
+    const auto full_place = full.place(x);
+    const auto ranged_place = ranged.place(x);
+    // the gap sites outside of the range do not depend on the position on the branch
+    EXPECT_NEAR(full_place.likelihood(), ranged_place.likelihood(),
+                std::abs(full_place.likelihood()) * 1e-3);
+  }
+  // teardown
+}
+
 static void compare_samples(Sample<>& orig_samp, Sample<>& read_samp, bool verbose=false, unsigned int head=0)
 {
   for (size_t seq_id = 0; seq_id < read_samp.size(); ++seq_id) {
@@ -152,8 +237,8 @@ static void place_from_binary(const Options options)
 
       ASSERT_DOUBLE_EQ(orig_place.likelihood(), read_place.likelihood());
 
-      orig_samp.add_placement(seq_id, "", orig_place);
-      read_samp.add_placement(seq_id, "",read_place);
+      orig_samp.add_placement(seq_id, orig_place);
+      read_samp.add_placement(seq_id, read_place);
       
       ++seq_id;
     }
@@ -191,3 +276,356 @@ TEST(Tiny_Tree, place_from_binary)
   // o.repeats = true;
   // place_from_binary(o);
 }
+
+static void tree_cache_(const Options options)
+{
+  // buildup
+  MSA msa = build_MSA_from_file(env->reference_file);
+  MSA queries = build_MSA_from_file(env->query_file);
+
+  auto ref_tree = Tree(env->tree_file, msa, env->model, options);
+
+  shared_ptr<Lookup_Store> lu_ptr(new Lookup_Store(ref_tree.nums().branches, ref_tree.partition()->states));
+
+  vector<pll_unode_t *> branches(ref_tree.nums().branches);
+  utree_query_branches(ref_tree.tree(), &branches[0]);
+
+  const bool blo = not options.prescoring;
+  Tiny_Tree_Cache cache(2);
+
+  // tests
+  auto first = cache.get(branches[0], 0, ref_tree, blo, options, lu_ptr);
+  auto again = cache.get(branches[0], 0, ref_tree, blo, options, lu_ptr);
+  EXPECT_EQ(first, again);
+  EXPECT_EQ(1u, cache.hits());
+  EXPECT_EQ(1u, cache.misses());
+
+  // a different mode is a different tree
+  auto other_mode = cache.get(branches[0], 0, ref_tree, not blo, options, lu_ptr);
+  EXPECT_NE(first, other_mode);
+
+  // the least recently used one is dropped
+  cache.get(branches[1], 1, ref_tree, blo, options, lu_ptr);
+  EXPECT_EQ(2u, cache.size());
+  cache.get(branches[0], 0, ref_tree, not blo, options, lu_ptr);
+  EXPECT_EQ(2u, cache.hits());
+  cache.get(branches[0], 0, ref_tree, blo, options, lu_ptr);
+  EXPECT_EQ(2u, cache.hits());
+
+  // a reused tree places like a fresh one
+  auto reused = cache.get(branches[1], 1, ref_tree, blo, options, lu_ptr);
+  for (auto const &x : queries) {
+    reused->place(x);
+  }
+  Tiny_Tree fresh(branches[1], 1, ref_tree, blo, options, lu_ptr);
+  for (auto const &x : queries) {
+    auto expected = fresh.place(x);
+    auto place = reused->place(x);
+    EXPECT_NEAR(expected.likelihood(), place.likelihood(), 1e-6);
+    EXPECT_NEAR(expected.pendant_length(), place.pendant_length(), 1e-6);
+    EXPECT_NEAR(expected.distal_length(), place.distal_length(), 1e-6);
+  }
+
+  // without capacity, nothing is kept
+  Tiny_Tree_Cache no_cache(0);
+  no_cache.get(branches[0], 0, ref_tree, blo, options, lu_ptr);
+  no_cache.get(branches[0], 0, ref_tree, blo, options, lu_ptr);
+  EXPECT_EQ(0u, no_cache.hits());
+  EXPECT_EQ(0u, no_cache.size());
+  // teardown
+}
+
+TEST(Tiny_Tree, tree_cache)
+{
+  all_combinations(tree_cache_);
+}
+
+static void partition_recycling_(const Options options)
+{
+  // buildup
+  MSA msa = build_MSA_from_file(env->reference_file);
+  MSA queries = build_MSA_from_file(env->query_file);
+
+  auto ref_tree = Tree(env->tree_file, msa, env->model, options);
+
+  shared_ptr<Lookup_Store> lu_ptr(new Lookup_Store(ref_tree.nums().branches, ref_tree.partition()->states));
+
+  vector<pll_unode_t *> branches(ref_tree.nums().branches);
+  auto num_branches = utree_query_branches(ref_tree.tree(), &branches[0]);
+
+  const bool blo = not options.prescoring;
+
+  // results with fresh partitions
+  tiny_partition_recycling(0);
+  vector<Placement> expected;
+  for (size_t i = 0; i < num_branches; ++i) {
+    Tiny_Tree tt(branches[i], i, ref_tree, blo, options, lu_ptr);
+    expected.push_back(tt.place(queries[0]));
+  }
+
+  // tests
+  tiny_partition_recycling(4);
+  for (size_t i = 0; i < num_branches; ++i) {
+    Tiny_Tree tt(branches[i], i, ref_tree, blo, options, lu_ptr);
+    auto place = tt.place(queries[0]);
+    EXPECT_DOUBLE_EQ(expected[i].likelihood(), place.likelihood());
+    EXPECT_DOUBLE_EQ(expected[i].pendant_length(), place.pendant_length());
+    EXPECT_DOUBLE_EQ(expected[i].distal_length(), place.distal_length());
+  }
+
+  // teardown
+  tiny_partition_recycling(4);
+}
+
+TEST(Tiny_Tree, partition_recycling)
+{
+  all_combinations(partition_recycling_);
+}
+
+static void place_block_blo_(const Options options)
+{
+  // buildup
+  MSA msa = build_MSA_from_file(env->reference_file);
+  MSA queries = build_MSA_from_file(env->query_file);
+
+  auto ref_tree = Tree(env->tree_file, msa, env->model, options);
+
+  shared_ptr<Lookup_Store> lu_ptr(new Lookup_Store(ref_tree.nums().branches, ref_tree.partition()->states));
+
+  vector<pll_unode_t *> branches(ref_tree.nums().branches);
+  auto num_branches = utree_query_branches(ref_tree.tree(), &branches[0]);
+
+  vector<vector<unsigned char>> states;
+  vector<const unsigned char *> block;
+  for (auto const &x : queries) {
+    states.emplace_back(x.sequence().size());
+    lu_ptr->encode(x.sequence(), states.back().data());
+    block.push_back(states.back().data());
+  }
+
+  // tests
+  for (size_t i = 0; i < std::min(num_branches, size_t(3)); ++i) {
+    Tiny_Tree single(branches[i], i, ref_tree, true, options, lu_ptr);
+    Tiny_Tree blocked(branches[i], i, ref_tree, true, options, lu_ptr);
+
+    auto places = blocked.place(block);
+    ASSERT_EQ(block.size(), places.size());
+
+    for (size_t k = 0; k < block.size(); ++k) {
+      auto expected = single.place(block[k]);
+      EXPECT_DOUBLE_EQ(expected.likelihood(), places[k].likelihood());
+      EXPECT_DOUBLE_EQ(expected.pendant_length(), places[k].pendant_length());
+      EXPECT_DOUBLE_EQ(expected.distal_length(), places[k].distal_length());
+    }
+
+    // the block leaves the tree in its original state
+    auto again = blocked.place(block[0]);
+    EXPECT_DOUBLE_EQ(places[0].likelihood(), again.likelihood());
+    blocked.take_blo_stats();
+
+    // identical queries are optimized once
+    auto duplicates = blocked.place({block[0], block[1], block[0]});
+    EXPECT_DOUBLE_EQ(duplicates[0].likelihood(), duplicates[2].likelihood());
+    EXPECT_DOUBLE_EQ(duplicates[0].pendant_length(), duplicates[2].pendant_length());
+    const auto stats = blocked.take_blo_stats();
+    EXPECT_EQ(2u, stats.optimized);
+    EXPECT_EQ(1u, stats.reused);
+    EXPECT_EQ(0u, blocked.take_blo_stats().optimized);
+  }
+  // teardown
+}
+
+TEST(Tiny_Tree, place_block_blo)
+{
+  all_combinations(place_block_blo_);
+}
+
+static void blo_priors_estimate_(Options options)
+{
+  // buildup
+  MSA msa = build_MSA_from_file(env->reference_file);
+  MSA queries = build_MSA_from_file(env->query_file);
+
+  options.blo_priors = false;
+  auto ref_tree = Tree(env->tree_file, msa, env->model, options);
+
+  shared_ptr<Lookup_Store> lu_ptr(new Lookup_Store(ref_tree.nums().branches, ref_tree.partition()->states));
+
+  vector<pll_unode_t *> branches(ref_tree.nums().branches);
+  auto num_branches = utree_query_branches(ref_tree.tree(), &branches[0]);
+
+  Options priors_options(options);
+  priors_options.blo_priors = true;
+
+  // tests
+  for (size_t i = 0; i < num_branches; ++i) {
+    Tiny_Tree plain(branches[i], i, ref_tree, true, options, lu_ptr);
+    Tiny_Tree priors(branches[i], i, ref_tree, true, priors_options, lu_ptr);
+
+    for (auto const &x : queries) {
+      // only the starting pendant length differs: both converge to within the tolerance
+      auto expected = plain.place(x);
+      auto place = priors.place(x);
+      EXPECT_NEAR(expected.likelihood(), place.likelihood(), 2 * OPT_BRANCH_EPSILON);
+    }
+  }
+  // teardown
+}
+
+TEST(Tiny_Tree, blo_priors_estimate)
+{
+  all_combinations(blo_priors_estimate_);
+}
+
+// the LWRs of the placements of one query on all branches
+static vector<double> branch_lwrs(const vector<double>& logls)
+{
+  const auto best = *std::max_element(logls.begin(), logls.end());
+  vector<double> lwrs;
+  double sum = 0.0;
+  for (auto const logl : logls) {
+    lwrs.push_back(std::exp(logl - best));
+    sum += lwrs.back();
+  }
+  for (auto& lwr : lwrs) {
+    lwr /= sum;
+  }
+  return lwrs;
+}
+
+static void blo_priors_tolerance_(Options options)
+{
+  // buildup
+  MSA msa = build_MSA_from_file(env->reference_file);
+  MSA queries = build_MSA_from_file(env->query_file);
+
+  options.blo_priors = false;
+  auto ref_tree = Tree(env->tree_file, msa, env->model, options);
+
+  shared_ptr<Lookup_Store> lu_ptr(new Lookup_Store(ref_tree.nums().branches, ref_tree.partition()->states));
+
+  vector<pll_unode_t *> branches(ref_tree.nums().branches);
+  auto num_branches = utree_query_branches(ref_tree.tree(), &branches[0]);
+
+  Options priors_options(options);
+  priors_options.blo_priors = true;
+
+  vector<vector<unsigned char>> states;
+  vector<const unsigned char *> block;
+  for (auto const &x : queries) {
+    states.emplace_back(x.sequence().size());
+    lu_ptr->encode(x.sequence(), states.back().data());
+    block.push_back(states.back().data());
+  }
+
+  // logls with full tolerance, per query and branch
+  vector<vector<double>> expected(block.size(), vector<double>(num_branches));
+  for (size_t i = 0; i < num_branches; ++i) {
+    Tiny_Tree plain(branches[i], i, ref_tree, true, options, lu_ptr);
+    auto places = plain.place(block);
+    for (size_t k = 0; k < block.size(); ++k) {
+      expected[k][i] = places[k].likelihood();
+    }
+  }
+
+  // how far each placement is below the best one of its query
+  vector<vector<double>> gaps(block.size(), vector<double>(num_branches));
+  for (size_t k = 0; k < block.size(); ++k) {
+    const auto best = *std::max_element(expected[k].begin(), expected[k].end());
+    for (size_t i = 0; i < num_branches; ++i) {
+      gaps[k][i] = best - expected[k][i];
+    }
+  }
+
+  // tests
+  vector<vector<double>> loosened(block.size(), vector<double>(num_branches));
+  for (size_t i = 0; i < num_branches; ++i) {
+    Tiny_Tree priors(branches[i], i, ref_tree, true, priors_options, lu_ptr);
+    vector<double> branch_gaps;
+    for (size_t k = 0; k < block.size(); ++k) {
+      branch_gaps.push_back(gaps[k][i]);
+    }
+    auto places = priors.place(block, {}, branch_gaps);
+    for (size_t k = 0; k < block.size(); ++k) {
+      loosened[k][i] = places[k].likelihood();
+
+      // the logl is off by at most the tolerance it converged to
+      const auto tolerance = std::min(OPT_BRANCH_EPSILON * std::exp(gaps[k][i]),
+                                      OPT_BRANCH_EPSILON_MAX);
+      EXPECT_NEAR(expected[k][i], loosened[k][i], 2 * tolerance);
+    }
+  }
+
+  // which scales down with the weight of the placement, keeping the LWRs as close as
+  // the full tolerance does
+  for (size_t k = 0; k < block.size(); ++k) {
+    const auto expected_lwrs = branch_lwrs(expected[k]);
+    const auto lwrs = branch_lwrs(loosened[k]);
+    for (size_t i = 0; i < num_branches; ++i) {
+      EXPECT_NEAR(expected_lwrs[i], lwrs[i], 2 * OPT_BRANCH_EPSILON);
+    }
+  }
+  // teardown
+}
+
+TEST(Tiny_Tree, blo_priors_tolerance)
+{
+  all_combinations(blo_priors_tolerance_);
+}
+
+static void partition_recycling_references_(const Options options)
+{
+  // buildup
+  MSA msa = build_MSA_from_file(env->reference_file);
+  MSA queries = build_MSA_from_file(env->query_file);
+
+  // a reference alignment of half the sites
+  const size_t sites = msa.num_sites() / 2;
+  MSA short_msa(sites);
+  for (auto const &x : msa) {
+    short_msa.append(x.header(), x.sequence().substr(0, sites));
+  }
+  const auto query = queries[0].sequence().substr(0, sites);
+
+  const bool blo = not options.prescoring;
+
+  auto short_tree = Tree(env->tree_file, short_msa, env->model, options);
+  shared_ptr<Lookup_Store> lu_ptr(new Lookup_Store(short_tree.nums().branches, short_tree.partition()->states));
+  vector<pll_unode_t *> branches(short_tree.nums().branches);
+  auto num_branches = utree_query_branches(short_tree.tree(), &branches[0]);
+
+  // results with fresh partitions
+  tiny_partition_recycling(0);
+  vector<Placement> expected;
+  for (size_t i = 0; i < num_branches; ++i) {
+    Tiny_Tree tt(branches[i], i, short_tree, blo, options, lu_ptr);
+    expected.push_back(tt.place(Sequence("q", query)));
+  }
+
+  // fill the pool with partitions of a reference that goes away
+  tiny_partition_recycling(4);
+  {
+    auto ref_tree = Tree(env->tree_file, msa, env->model, options);
+    shared_ptr<Lookup_Store> ref_lu_ptr(new Lookup_Store(ref_tree.nums().branches, ref_tree.partition()->states));
+    vector<pll_unode_t *> ref_branches(ref_tree.nums().branches);
+    auto ref_num_branches = utree_query_branches(ref_tree.tree(), &ref_branches[0]);
+    for (size_t i = 0; i < ref_num_branches; ++i) {
+      Tiny_Tree tt(ref_branches[i], i, ref_tree, blo, options, ref_lu_ptr);
+    }
+  }
+  ASSERT_GT(tiny_partitions_pooled(), 0u);
+
+  // tests: the pooled partitions of the first reference must not be used
+  for (size_t i = 0; i < num_branches; ++i) {
+    Tiny_Tree tt(branches[i], i, short_tree, blo, options, lu_ptr);
+    auto place = tt.place(Sequence("q", query));
+    EXPECT_DOUBLE_EQ(expected[i].likelihood(), place.likelihood());
+    EXPECT_DOUBLE_EQ(expected[i].pendant_length(), place.pendant_length());
+  }
+  // teardown
+}
+
+TEST(Tiny_Tree, partition_recycling_references)
+{
+  all_combinations(partition_recycling_references_);
+}
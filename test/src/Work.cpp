@@ -24,3 +24,70 @@ TEST(Work, create_from_range)
 
   EXPECT_EQ( upper_branch * upper_sequences, work.size() );
 }
+
+TEST(Work, implicit_iteration_and_slice)
+{
+  Work work(make_pair(3,6), make_pair(10,14));
+
+  EXPECT_TRUE( work.implicit() );
+  ASSERT_EQ( 12u, work.size() );
+
+  // branch major order
+  size_t i = 0;
+  for (auto it : work) {
+    EXPECT_EQ( 3 + i / 4, it.branch_id );
+    EXPECT_EQ( 10 + i % 4, it.sequence_id );
+    ++i;
+  }
+  EXPECT_EQ( work.size(), i );
+
+  auto part = work.slice(5, 10);
+  ASSERT_EQ( 5u, part.size() );
+  i = 5;
+  for (auto it : part) {
+    EXPECT_EQ( 3 + i / 4, it.branch_id );
+    EXPECT_EQ( 10 + i % 4, it.sequence_id );
+    ++i;
+  }
+  EXPECT_EQ( 10u, i );
+
+  EXPECT_EQ( 0u, work.slice(4, 4).size() );
+  EXPECT_ANY_THROW( work.slice(4, 13) );
+}
+
+TEST(Work, create_from_sample)
+{
+  Sample<> sample;
+  sample.emplace_back(0);
+  sample.back().emplace_back(7,-10,0.9,0.9);
+  sample.back().emplace_back(2,-10,0.9,0.9);
+  sample.emplace_back(1);
+  sample.back().emplace_back(2,-10,0.9,0.9);
+  sample.emplace_back(2);
+  sample.back().emplace_back(7,-10,0.9,0.9);
+  sample.back().emplace_back(4,-10,0.9,0.9);
+
+  Work work(sample);
+
+  EXPECT_FALSE( work.implicit() );
+  ASSERT_EQ( 5u, work.size() );
+
+  // grouped by branch, in order of appearance within a branch
+  const vector<pair<size_t, size_t>> expected{{2,0}, {2,1}, {4,2}, {7,0}, {7,2}};
+  size_t i = 0;
+  for (auto it : work) {
+    EXPECT_EQ( expected[i].first, it.branch_id );
+    EXPECT_EQ( expected[i].second, it.sequence_id );
+    ++i;
+  }
+
+  // slices may start and end within a branch
+  auto part = work.slice(1, 4);
+  ASSERT_EQ( 3u, part.size() );
+  i = 1;
+  for (auto it : part) {
+    EXPECT_EQ( expected[i].first, it.branch_id );
+    EXPECT_EQ( expected[i].second, it.sequence_id );
+    ++i;
+  }
+}
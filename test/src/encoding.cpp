@@ -2,6 +2,10 @@
 
 #include "io/encoding.hpp"
 
+#include <random>
+#include <string>
+#include <vector>
+
 TEST(encoding, 4bit)
 {
   FourBit converter;
@@ -18,3 +22,69 @@ TEST(encoding, 4bit)
   // printf("%s\n", input.c_str());
   // printf("%s\n", unpacked.c_str());
 }
+
+TEST(encoding, 4bit_to_states)
+{
+  FourBit converter;
+
+  // odd and even length, to cover the padded case
+  for (const std::string input : {"AATGCTTCGTAA---NNNATTCBDAVMKWYR",
+                                  "acgtACGT-NnRYKM"}) {
+    auto packed = converter.to_fourbit(input);
+
+    std::vector<unsigned char> states(input.size());
+    converter.to_states(packed.data(), input.size(), states.data());
+
+    for (size_t i = 0; i < input.size(); ++i) {
+      EXPECT_EQ(std::toupper(input[i]), NT_MAP[states[i]]) << "i = " << i;
+    }
+  }
+}
+
+TEST(encoding, 4bit_vectorized)
+{
+  FourBit vectorized;
+  FourBit scalar(false);
+
+  // NT_MAP characters of either case, sometimes with characters outside of it mixed in,
+  // across the block boundaries of the kernels
+  std::string alphabet;
+  for (size_t i = 0; i < NT_MAP_SIZE; ++i) {
+    alphabet.push_back(NT_MAP[i]);
+    alphabet.push_back(std::tolower(NT_MAP[i]));
+  }
+
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<size_t> length(0, 300);
+  std::uniform_int_distribution<size_t> pick(0, alphabet.size() - 1);
+  std::uniform_int_distribution<int> other(0, 127);
+  std::bernoulli_distribution invalid(0.002);
+
+  for (size_t round = 0; round < 500; ++round) {
+    const bool with_invalid = round % 2;
+    std::string input(length(gen), '\0');
+    for (auto& c : input) {
+      c = (with_invalid and invalid(gen)) ? other(gen) : alphabet[pick(gen)];
+    }
+
+    const auto packed = vectorized.to_fourbit(input);
+    ASSERT_EQ( scalar.to_fourbit(input), packed ) << "input: " << input;
+
+    if (not input.empty()) {
+      EXPECT_EQ( scalar.from_fourbit(packed, input.size()),
+                 vectorized.from_fourbit(packed, input.size()) );
+    }
+
+    std::vector<unsigned char> expected(input.size());
+    std::vector<unsigned char> states(input.size());
+    scalar.to_states(packed.data(), input.size(), expected.data());
+    vectorized.to_states(packed.data(), input.size(), states.data());
+    EXPECT_EQ( expected, states );
+
+    if (not with_invalid) {
+      for (size_t i = 0; i < input.size(); ++i) {
+        ASSERT_EQ( std::toupper(input[i]), NT_MAP[states[i]] ) << "i = " << i;
+      }
+    }
+  }
+}
@@ -2,8 +2,11 @@
 
 #include "set_manipulators.hpp"
 #include "io/jplace_util.hpp"
+#include "sample/Candidates.hpp"
 
 #include <vector>
+#include <set>
+#include <random>
 #include <iostream>
 
 using namespace std;
@@ -427,6 +430,71 @@ TEST(set_manipulators, discard_by_accumulated_threshold)
   }
 }
 
+static void bounded_candidates(const Options options)
+{
+  std::mt19937 gen(13);
+  const size_t num_branches = 1000;
+
+  for (double spread : {3.0, 30.0}) {
+    // setup
+    std::normal_distribution<double> dist(-5000.0, spread);
+    Sample<> sample;
+    sample.emplace_back(0);
+    for (size_t i = 0; i < num_branches; ++i) {
+      sample.back().emplace_back(i, dist(gen), 0.9, 0.9);
+    }
+
+    // bounded: three "threads" seeing interleaved parts of the branches
+    const Candidate_Filter filter(options, num_branches);
+    vector<Candidates<Placement>> parts(3);
+    for (size_t i = 0; i < num_branches; ++i) {
+      parts[(i / 50) % 3].add(sample[0].at(i), filter);
+    }
+    parts[0].merge(move(parts[1]), filter);
+    parts[0].merge(move(parts[2]), filter);
+
+    set<unsigned int> bounded;
+    for (auto& p : parts[0].select(filter)) {
+      bounded.insert(p.branch_id());
+    }
+
+    // complete
+    compute_and_set_lwr(sample);
+    if (options.prescoring_by_percentage) {
+      discard_bottom_x_percent(sample, 1.0 - options.prescoring_threshold);
+    } else {
+      discard_by_accumulated_threshold(sample,
+                                       options.prescoring_threshold,
+                                       options.filter_min,
+                                       options.filter_max);
+    }
+    set<unsigned int> complete;
+    for (auto& p : sample[0]) {
+      complete.insert(p.branch_id());
+    }
+
+    // tests
+    EXPECT_EQ(complete, bounded);
+  }
+}
+
+TEST(set_manipulators, bounded_candidates)
+{
+  Options options;
+  bounded_candidates(options);
+
+  options.prescoring_threshold = 0.99999;
+  bounded_candidates(options);
+
+  options.filter_min = 4;
+  options.filter_max = 7;
+  bounded_candidates(options);
+
+  options.prescoring_by_percentage = true;
+  options.prescoring_threshold = 0.1;
+  bounded_candidates(options);
+}
+
 TEST(set_manipulators, discard_by_support_threshold)
 {
   // setup